@@ -4,15 +4,33 @@
 #include <string>
 
 #include "../utils/colors.h"
+#include "../utils/arena.h"
 
 using namespace std;
 
+// kind tag used for dispatching on AIMs without string comparison
+enum AimKind {
+	AIM_INIT,
+	AIM_CONSTLOAD,
+	AIM_CONSTMOVE,
+	AIM_READLOAD,
+	AIM_READMOVE,
+	AIM_PUSH,
+	AIM_POP,
+	AIM_DECJUMP,
+	AIM_NEGJUMP
+};
+
 class Aim {
 private:
 	friend class Policy;
+	const AimKind kind;
 
 public:
-	Aim(){};
+	Aim(AimKind kind) : kind(kind){};
+	virtual ~Aim(){};
+
+	AimKind get_kind() { return this->kind; }
 	virtual string to_string()= 0;
 	virtual void print() = 0;
 	virtual string get_aim_name() = 0;
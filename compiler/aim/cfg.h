@@ -0,0 +1,192 @@
+#ifndef _CFG_H
+#define _CFG_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "aim.h"
+#include "constload.h"
+#include "constmove.h"
+#include "decjump.h"
+#include "init.h"
+#include "negjump.h"
+#include "pop.h"
+#include "push.h"
+#include "readload.h"
+#include "readmove.h"
+
+using namespace std;
+
+/**
+ * Control flow graph over the merged AIM sequence.
+ *
+ * Edges are derived from the QPN states: an access leaving through state s
+ * is connected to every AIM that lists s as a previous QPN. Jumps and the
+ * register AIMs (Move($), Load($), Push, Pop) are connected to the access
+ * issuing their target/post QPN.
+ * Successors and predecessors are kept in flat CSR arrays.
+ *
+ * Next to the graph, the positional lookups used by the code generator
+ * (next state issuing AIM, next NegJump, next Move) are precomputed with
+ * one backward sweep so that every backend pass stays linear.
+ */
+class AimCFG {
+private:
+    vector<int> succ_begin, succ_edges;
+    vector<int> pred_begin, pred_edges;
+    vector<int> next_post;    // see find_next_post_qpn()
+    vector<int> next_negjump; // index of the next NegJump, -1 if none
+    vector<int> next_move;    // index of the next ConstMove/ReadMove, -1 if none
+
+    static void compress(int n, vector<pair<int, int> > &edges, vector<int> &begin, vector<int> &flat, bool by_src) {
+        begin.assign(n + 1, 0);
+        for (auto &e: edges)
+            begin[(by_src ? e.first : e.second) + 1]++;
+        for (int i = 0; i < n; i++)
+            begin[i + 1] += begin[i];
+        flat.assign(edges.size(), 0);
+        vector<int> fill(begin.begin(), begin.end() - 1);
+        for (auto &e: edges)
+            flat[fill[by_src ? e.first : e.second]++] = by_src ? e.second : e.first;
+    }
+
+    static const qpn_list* prev_qpns_of(Aim *aim) {
+        switch (aim->get_kind()) {
+            case AIM_CONSTLOAD: return &((ConstLoad *)aim)->get_prev_qpn();
+            case AIM_CONSTMOVE: return &((ConstMove *)aim)->get_prev_qpn();
+            case AIM_READLOAD: return &((ReadLoad *)aim)->get_prev_qpn();
+            case AIM_READMOVE: return &((ReadMove *)aim)->get_prev_qpn();
+            case AIM_PUSH: return &((Push *)aim)->get_prev_qpn();
+            case AIM_POP: return &((Pop *)aim)->get_prev_qpn();
+            default: return nullptr;
+        }
+    }
+
+    static int post_qpn_of(Aim *aim) {
+        switch (aim->get_kind()) {
+            case AIM_CONSTLOAD: return ((ConstLoad *)aim)->get_post_qpn();
+            case AIM_CONSTMOVE: return ((ConstMove *)aim)->get_post_qpn();
+            case AIM_READLOAD: return ((ReadLoad *)aim)->get_post_qpn();
+            case AIM_READMOVE: return ((ReadMove *)aim)->get_post_qpn();
+            case AIM_PUSH: return ((Push *)aim)->get_post_qpn();
+            case AIM_POP: return ((Pop *)aim)->get_post_qpn();
+            case AIM_DECJUMP: return ((DecJump *)aim)->get_post_qpn();
+            case AIM_NEGJUMP: return ((NegJump *)aim)->get_post_qpn();
+            default: return -1;
+        }
+    }
+
+public:
+    AimCFG(){};
+
+    // qpn_tran_coef translates an issued QPN into the state seen on the response
+    void build(const vector<Aim*> &aims, int qpn_tran_coef) {
+        int n = aims.size();
+        unordered_map<int, vector<int> > by_prev, by_post;
+        by_prev.reserve(2 * n);
+        by_post.reserve(n);
+        for (int i = 0; i < n; i++) {
+            const qpn_list *prev = prev_qpns_of(aims[i]);
+            if (prev)
+                for (int q: *prev)
+                    by_prev[q].push_back(i);
+            AimKind k = aims[i]->get_kind();
+            if (k == AIM_DECJUMP || k == AIM_NEGJUMP)
+                by_prev[post_qpn_of(aims[i])].push_back(i); // jumps test the state they are invoked with
+            else if (k == AIM_READLOAD || k == AIM_READMOVE)
+                by_post[post_qpn_of(aims[i])].push_back(i); // the access issuing that QPN
+        }
+
+        vector<pair<int, int> > edges;
+        auto link = [&](int src, unordered_map<int, vector<int> > &index, int state) {
+            auto hit = index.find(state);
+            if (hit == index.end())
+                return;
+            for (int dst: hit->second)
+                if (dst != src)
+                    edges.push_back(make_pair(src, dst));
+        };
+        for (int i = 0; i < n; i++) {
+            Aim *aim = aims[i];
+            switch (aim->get_kind()) {
+                case AIM_INIT:
+                    link(i, by_prev, ((Init *)aim)->get_init_qpn());
+                    break;
+                case AIM_READLOAD:
+                    link(i, by_prev, ((ReadLoad *)aim)->get_post_qpn() + qpn_tran_coef);
+                    if (((ReadLoad *)aim)->get_tran_qpn() != -1)
+                        link(i, by_prev, ((ReadLoad *)aim)->get_tran_qpn());
+                    break;
+                case AIM_READMOVE:
+                    link(i, by_prev, ((ReadMove *)aim)->get_post_qpn() + qpn_tran_coef);
+                    if (((ReadMove *)aim)->get_qpn_null() != -1)
+                        link(i, by_prev, ((ReadMove *)aim)->get_qpn_null());
+                    break;
+                case AIM_NEGJUMP:
+                    link(i, by_post, ((NegJump *)aim)->get_true_post_qpn());
+                    link(i, by_post, ((NegJump *)aim)->get_false_post_qpn());
+                    break;
+                case AIM_DECJUMP:
+                    link(i, by_post, ((DecJump *)aim)->get_true_post_qpn());
+                    link(i, by_post, ((DecJump *)aim)->get_false_post_qpn());
+                    break;
+                default: // Move($)/Load($)/Push/Pop act on the transition into their post QPN
+                    link(i, by_post, post_qpn_of(aim));
+                    break;
+            }
+        }
+        compress(n, edges, succ_begin, succ_edges, true);
+        compress(n, edges, pred_begin, pred_edges, false);
+
+        // positional lookups, one backward sweep
+        next_post.assign(n, 0);
+        next_negjump.assign(n, -1);
+        next_move.assign(n, -1);
+        for (int i = n - 2; i >= 0; i--) {
+            Aim *nx = aims[i + 1];
+            next_post[i] = next_post[i + 1];
+            next_negjump[i] = next_negjump[i + 1];
+            next_move[i] = next_move[i + 1];
+            switch (nx->get_kind()) {
+                case AIM_READMOVE:
+                    next_post[i] = ((ReadMove *)nx)->get_post_qpn();
+                    next_move[i] = i + 1;
+                    break;
+                case AIM_READLOAD:
+                    next_post[i] = ((ReadLoad *)nx)->get_post_qpn();
+                    break;
+                case AIM_NEGJUMP:
+                    next_post[i] = -1;
+                    next_negjump[i] = i + 1;
+                    break;
+                case AIM_DECJUMP:
+                    next_post[i] = -1;
+                    break;
+                case AIM_CONSTMOVE:
+                    next_move[i] = i + 1;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    int size() { return next_post.size(); }
+    int num_edges() { return succ_edges.size(); }
+
+    // successors of aim i are succ_edges[succ_begin(i) .. succ_end(i))
+    const int* succ_begin_of(int i) { return succ_edges.data() + succ_begin[i]; }
+    const int* succ_end_of(int i) { return succ_edges.data() + succ_begin[i + 1]; }
+    const int* pred_begin_of(int i) { return pred_edges.data() + pred_begin[i]; }
+    const int* pred_end_of(int i) { return pred_edges.data() + pred_begin[i + 1]; }
+    int num_succ(int i) { return succ_begin[i + 1] - succ_begin[i]; }
+    int num_pred(int i) { return pred_begin[i + 1] - pred_begin[i]; }
+
+    // post QPN of the next ReadMove/ReadLoad after i, -1 if a jump comes first, 0 if none
+    int get_next_post_qpn(int i) { return next_post[i]; }
+    int get_next_negjump(int i) { return next_negjump[i]; }
+    int get_next_move(int i) { return next_move[i]; }
+};
+
+
+#endif // _CFG_H
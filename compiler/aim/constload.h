@@ -12,12 +12,12 @@ private:
 	friend class Policy;
 	int reg_index = -1;
 	int value = -1;
-    vector<int> prev_qpns;
+    qpn_list prev_qpns;
 	int post_qpn = 0;
     int seq = -1;
 
 public:
-	ConstLoad(int reg_index){
+	ConstLoad(int reg_index) : Aim(AIM_CONSTLOAD){
 		this->reg_index = reg_index;
 		// this->value = value;
 	};
@@ -45,7 +45,7 @@ public:
         return this->post_qpn;
     }
 
-    vector<int> get_prev_qpn(){
+    const qpn_list& get_prev_qpn(){
         return this->prev_qpns;
     }
 
@@ -11,11 +11,11 @@ class ConstMove : public Aim  {
 private:
 	friend class Policy;
 	int offset;
-    vector<int> prev_qpns;	
+    qpn_list prev_qpns;	
     int post_qpn = -1;
 
 public:
-	ConstMove(int offset){
+	ConstMove(int offset) : Aim(AIM_CONSTMOVE){
 		this->offset = offset;
 	};
 
@@ -28,7 +28,7 @@ public:
     }
 
     int get_post_qpn() { return this->post_qpn;}
-    vector<int> get_prev_qpn() { return this->prev_qpns;}
+    const qpn_list& get_prev_qpn() { return this->prev_qpns;}
 
 	string to_string(){
         string ans;
@@ -0,0 +1,156 @@
+#ifndef _COST_H
+#define _COST_H
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "aim.h"
+#include "constload.h"
+#include "constmove.h"
+#include "decjump.h"
+#include "negjump.h"
+#include "push.h"
+#include "readload.h"
+#include "readmove.h"
+
+using namespace std;
+
+#ifndef throw_error
+#define throw_error(msg) throw std::runtime_error(string(__FILE__)+":"+std::to_string(__LINE__)+" --> "+msg);
+#endif
+
+// expected cardinalities of what the loops of a policy walk
+struct CostParams {
+    double list = 100;   // elements of a traversed list, e.g. tasks
+    double fds = 16;     // entries of an .iter whose length is read at run time, e.g. max_fds
+    double vmalloc = 0;  // share of Move() targets in vmalloc space, each takes a 4 level page walk
+    double rtt_us = 0;   // RDMA round trip, 0 leaves the latency out
+};
+
+// what one trigger of a policy is expected to take
+struct PolicyCost {
+    double reads = 0;       // RDMA READs of the AIMs, Load() and Move()
+    double walks = 0;       // READs of the page walks after Move()
+    double clones = 0;      // Load() responses mirrored to the collector
+    double round_trips = 0; // reads + walks
+    double passes = 0;      // switch pipeline passes: the trigger, every response and every clone
+    double bytes = 0;       // on the wire: READ requests, responses and clones
+
+    double latency_us(const CostParams &p) const { return this->round_trips * p.rtt_us; }
+
+    void add(const PolicyCost &c) {
+        this->reads += c.reads;
+        this->walks += c.walks;
+        this->clones += c.clones;
+        this->round_trips += c.round_trips;
+        this->passes += c.passes;
+        this->bytes += c.bytes;
+    }
+
+    string report(const CostParams &p) const {
+        char line[200];
+        snprintf(line, sizeof(line), "%.1f round trips (%.1f reads, %.1f page walk), %.1f switch passes, %.0f bytes",
+            this->round_trips, this->reads, this->walks, this->passes, this->bytes);
+        string s = line;
+        if (p.rtt_us > 0) {
+            snprintf(line, sizeof(line), ", %.1f us", this->latency_us(p));
+            s += line;
+        }
+        return s;
+    }
+};
+
+/**
+ * Cost of one trigger of a policy, over its merged AIMs.
+ *
+ * Every Load() and Move() is an RDMA READ: one round trip and one pass of
+ * its response through the switch. A loop runs from its Push to the jump
+ * that closes it, so what lies in between (the body, Pop, Move(next) or
+ * Move($)) runs once per iteration, times the iterations of the loops
+ * around it. The recirculation Load(0) after the jump runs once per loop,
+ * unless -O threaded it away. Iterations come from the ConstLoad of a
+ * fixed size .iter, the list length for a
+ * traverse and fds for an .iter whose length is read at run time.
+ *
+ * Move() targets in vmalloc space are translated by the 4 READs of the
+ * page walk first. Load() responses are also cloned to the collector.
+ * A READ request takes ROCE_READ_REQ bytes on the wire, its response
+ * ROCE_READ_RESP and the payload; the trigger is left out.
+ */
+class AimCost {
+private:
+    static const int ROCE_READ_REQ = 74;  // Eth, IPv4, UDP, BTH, RETH, ICRC
+    static const int ROCE_READ_RESP = 62; // Eth, IPv4, UDP, BTH, AETH, ICRC
+    static const int MOVE_SIZE = 8;       // Move() reads a pointer
+    static const int WALK_READS = 4;      // pgd, pud, pmd, pte
+
+    // iterations of the loop pushed at aims[p], closed by the jump of kind jump
+    static double iterations(const vector<Aim*> &aims, int p, AimKind jump, const CostParams &params) {
+        if (jump == AIM_NEGJUMP)
+            return params.list;
+        for (int i = p - 1; i >= 0 && aims[i]->get_kind() != AIM_PUSH; i--) {
+            if (aims[i]->get_kind() == AIM_CONSTLOAD)
+                return ((ConstLoad *)aims[i])->get_value();
+            if (aims[i]->get_kind() != AIM_CONSTMOVE)
+                break;
+        }
+        return params.fds;
+    }
+
+public:
+    static PolicyCost estimate(const vector<Aim*> &aims, const CostParams &params) {
+        // loops nest: the Push of each loop is closed by the jump that ends it
+        vector<double> iters(aims.size(), 1);
+        vector<int> open;
+        for (int i = 0; i < (int)aims.size(); i++) {
+            AimKind kind = aims[i]->get_kind();
+            if (kind == AIM_PUSH)
+                open.push_back(i);
+            else if (kind == AIM_NEGJUMP || kind == AIM_DECJUMP) {
+                if (open.empty())
+                    throw_error("jump without the Push of its loop");
+                iters[open.back()] = iterations(aims, open.back(), kind, params);
+                open.pop_back();
+            }
+        }
+        if (!open.empty())
+            throw_error("loop without a jump to close it");
+
+        PolicyCost c;
+        vector<double> runs = {1}; // runs of the body of each open loop per trigger
+        for (int i = 0; i < (int)aims.size(); i++) {
+            double n = runs.back();
+            switch (aims[i]->get_kind()) {
+                case AIM_PUSH:
+                    runs.push_back(n * iters[i]);
+                    break;
+                case AIM_NEGJUMP:
+                case AIM_DECJUMP:
+                    runs.pop_back();
+                    break;
+                case AIM_READLOAD: {
+                    int size = ((ReadLoad *)aims[i])->get_size();
+                    c.reads += n;
+                    c.clones += n;
+                    c.bytes += n * (ROCE_READ_REQ + 2 * (ROCE_READ_RESP + size));
+                    break;
+                }
+                case AIM_READMOVE:
+                    c.reads += n;
+                    c.walks += n * params.vmalloc * WALK_READS;
+                    c.bytes += n * (1 + params.vmalloc * WALK_READS) * (ROCE_READ_REQ + ROCE_READ_RESP + MOVE_SIZE);
+                    break;
+                default: // Init, Move($), Load($), Pop: switch only
+                    break;
+            }
+        }
+        c.round_trips = c.reads + c.walks;
+        c.passes = 1 + c.round_trips + c.clones;
+        return c;
+    }
+};
+
+
+#endif // _COST_H
@@ -18,9 +18,10 @@ private:
     int false_post_qpn = -1;
 	int label1 = 0;
 	int label2 = 0;
+	bool direct_exit = false; // false branch leaves the loop without a recirculation load
 
 public:
-	DecJump(int reg_index){
+	DecJump(int reg_index) : Aim(AIM_DECJUMP){
 		this->reg_index = reg_index;
 	};
 
@@ -54,6 +55,8 @@ public:
 	}
 
     int get_reg_idx(){return this->reg_index;}
+	void set_direct_exit(bool on) { this->direct_exit = on; }
+	bool get_direct_exit() { return this->direct_exit; }
 	int get_true_post_qpn(){ return this->true_post_qpn;}
 	int get_false_post_qpn(){ return this->false_post_qpn;}
 
@@ -15,7 +15,7 @@ private:
 	int post_qpn = 999;
 
 public:
-	Init(){};
+	Init() : Aim(AIM_INIT){};
 
 	void set_init_qpn(int prev_qpn) {
 		this->init_qpn = prev_qpn;
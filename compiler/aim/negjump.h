@@ -21,9 +21,10 @@ private:
 
 	int label1 = 0;
 	int label2 = 0;
+	bool direct_exit = false; // false branch leaves the loop without a recirculation load
 
 public:
-	NegJump(string addr_h, string addr_l){
+	NegJump(string addr_h, string addr_l) : Aim(AIM_NEGJUMP){
 		this->addr_h = addr_h;
         this->addr_l = addr_l;
 	};
@@ -64,6 +65,8 @@ public:
 
 	string get_addr_h(){ return this->addr_h;}
 	string get_addr_l(){ return this->addr_l;}
+	void set_direct_exit(bool on) { this->direct_exit = on; }
+	bool get_direct_exit() { return this->direct_exit; }
 	int get_true_post_qpn(){ return this->true_post_qpn;}
 	int get_false_post_qpn(){ return this->false_post_qpn;}
 	int get_fake_qpn() {return this->fake_state;}
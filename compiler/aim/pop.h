@@ -11,11 +11,11 @@ class Pop : public Aim  {
 private:
 	friend class Policy;
 
-	vector<int> prev_qpns;
+	qpn_list prev_qpns;
 	int post_qpn = -1;
 
 public:
-	Pop(){};
+	Pop() : Aim(AIM_POP){};
 
 	void add_prev_qpn(int prev_qpn) {
 		this->prev_qpns.push_back(prev_qpn);
@@ -25,6 +25,14 @@ public:
 		this->post_qpn = post_qpn;
 	}
 
+	int get_post_qpn() {
+		return this->post_qpn;
+	}
+
+	const qpn_list& get_prev_qpn() {
+		return this->prev_qpns;
+	}
+
     string to_string(){
         string ans;
 
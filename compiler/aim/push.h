@@ -11,11 +11,11 @@ class Push : public Aim  {
 private:
 	friend class Policy;
 
-	vector<int> prev_qpns;
+	qpn_list prev_qpns;
 	int post_qpn = 0;
 
 public:
-	Push(){};
+	Push() : Aim(AIM_PUSH){};
 
 	void add_prev_qpn(int prev_qpn) {
 		this->prev_qpns.push_back(prev_qpn);
@@ -29,7 +29,7 @@ public:
 		return this->post_qpn;
 	}
 
-    vector<int> get_prev_qpn(){
+    const qpn_list& get_prev_qpn(){
         return this->prev_qpns;
     }
 
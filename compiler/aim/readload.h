@@ -14,18 +14,20 @@ private:
 	int reg_index = -1;
 	int offset = 0; 
     int size = 8; // need to specify size somehow
-    vector<int> prev_qpns;
+    qpn_list fields; // offsets from the base of the fields a wide read returns
+    int pos = 0; // position of the base in the object
+    qpn_list prev_qpns;
     int post_qpn = -1;
     int tran_qpn = -1;
     int tran_dqpn = -1;
-    int range_check = -1;
+    int range_check = -1; // 1: range checked by the switch
 
     // range check bound
     string addr_h = "0";
     string addr_l = "0";
 
 public:
-	ReadLoad(int offset){
+	ReadLoad(int offset) : Aim(AIM_READLOAD){
 		this->offset = offset;
 	};
 
@@ -33,6 +35,20 @@ public:
         this->range_check = check;
     }
 
+    // read size bytes from a base at pos in the object, holding the fields at these offsets from the base
+    void set_window(int size, int pos){
+        this->size = size;
+        this->pos = pos;
+    }
+
+    void add_field(int offset){
+        this->fields.push_back(offset);
+    }
+
+    void set_offset(int offset){
+        this->offset = offset;
+    }
+
     void set_reg_index(int idx){
         this->reg_index = idx;
     }
@@ -58,6 +74,8 @@ public:
 	void set_low(string low) { this->addr_l = low; }
 
 
+    string get_high(){ return this->addr_h;}
+    string get_low(){ return this->addr_l;}
     string get_high_prev(){ return this->addr_h.substr(2, 4);}
 	string get_high_post(){ return this->addr_h.substr(6, 4);}
     string get_low_prev(){ return this->addr_l.substr(2, 4);}
@@ -67,9 +85,12 @@ public:
     int get_tran_dqpn() { return this->tran_dqpn; }
     int get_tran_qpn(){ return this->tran_qpn; }
     int get_reg_index(){ return this->reg_index;}
-    vector<int> get_prev_qpn(){ return this->prev_qpns; }
+    const qpn_list& get_prev_qpn(){ return this->prev_qpns; }
     int get_prev_qpn_size(){ return this->prev_qpns.size();}
     int get_offset(){return this->offset;}
+    int get_size(){return this->size;}
+    int get_pos(){return this->pos;}
+    const qpn_list& get_fields(){ return this->fields; }
     int get_range_check() { return this->range_check;}
 
 
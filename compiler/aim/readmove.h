@@ -11,12 +11,12 @@ class ReadMove : public Aim  {
 private:
 	friend class Policy;
 	int offset;
-    vector<int> prev_qpns;
+    qpn_list prev_qpns;
     int post_qpn = -1;
 	int qpn_null = -1; // handle null ptr redirection
     int dqpn_null = -1;
 public:
-	ReadMove(int offset){
+	ReadMove(int offset) : Aim(AIM_READMOVE){
 		this->offset = offset;
 	};
 
@@ -70,7 +70,7 @@ public:
     int get_dqpn_null(){ return this->dqpn_null;}
     int get_prev_qpn_size(){ return this->prev_qpns.size();}
     int get_offset(){return this->offset;}
-    vector<int> get_prev_qpn() {return this->prev_qpns;}
+    const qpn_list& get_prev_qpn() {return this->prev_qpns;}
     // int get_qpn_tran() { return this->qpn_next; }
 
 
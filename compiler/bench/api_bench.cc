@@ -0,0 +1,58 @@
+// In-process compile through librdmi against the file-in/file-out flow of
+// the RDMI executable (spawn, read exe/policy*.c, write gencode/, read the
+// rules back), on the exe/policy*.c pool.
+//
+//   ./api_bench [rounds=20]
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../rdmi.h"
+#include "../ir/serializer.h"
+#include "bench_util.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? stoi(argv[1]) : 20;
+
+    vector<string> sources = policy_pool();
+    if (sources.empty()) {
+        cout << "run from the compiler directory, ./exe/policy*.c not found" << endl;
+        return 1;
+    }
+    int num = sources.size();
+
+    NullBuf null;
+    streambuf *saved = cout.rdbuf(&null);
+    size_t bytes = 0;
+    double lib = mean_of(rounds, [&] {
+        Compiler compiler(3000, 300);
+        CompileOutput out = compiler.compile(sources);
+        bytes = 0;
+        for (PolicyOutput &po: out.policies) {
+            BufferSink sink;
+            BfshellSerializer().write(po.rules, sink);
+            bytes += sink.str().size();
+        }
+    });
+    cout.rdbuf(saved);
+
+    string cmd = "./RDMI 3000 300 " + to_string(num) + " > /dev/null";
+    size_t exe_bytes = 0;
+    double exe = mean_of(rounds, [&] {
+        if (system(cmd.c_str()) != 0)
+            exit(1);
+        exe_bytes = 0;
+        for (int i = 0; i < num; i++)
+            exe_bytes += read_all("./gencode/code_gen" + to_string(i) + ".cmd").size();
+        read_all("./gencode/summary");
+    });
+
+    cout << num << " policies, " << bytes << " bytes of rules, mean of " << rounds << endl;
+    cout << "  librdmi in process:     " << lib << " ms" << endl;
+    cout << "  RDMI spawn + files:     " << exe << " ms (" << exe_bytes << " bytes read back)" << endl;
+    cout << "  speedup: " << exe / lib << "x" << endl;
+    return 0;
+}
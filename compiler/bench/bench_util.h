@@ -0,0 +1,104 @@
+#ifndef _BENCH_UTIL_H
+#define _BENCH_UTIL_H
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Timing helpers and policy fixtures shared by the benchmarks, which run from the compiler directory.
+
+static const int QPN_S = 3000, QPN_R = 300;
+
+// swallows the progress prints of the passes
+class NullBuf : public streambuf {
+protected:
+    int overflow(int c) { return c; }
+    streamsize xsputn(const char *, streamsize n) { return n; }
+};
+
+inline string read_all(const string &path) {
+    ifstream in(path);
+    stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// the policy pool with concrete offsets, exe/policy0.c up to the first one missing
+inline vector<string> policy_pool() {
+    vector<string> pool;
+    for (int i = 0; ; i++) {
+        string path = "./exe/policy" + to_string(i) + ".c";
+        if (!ifstream(path).is_open())
+            break;
+        pool.push_back(read_all(path));
+    }
+    return pool;
+}
+
+// mean wall time of rounds runs of fn, in ms
+template <class Fn>
+double mean_of(int rounds, Fn fn) {
+    auto t0 = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        fn();
+    auto t1 = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(t1 - t0).count() / rounds;
+}
+
+// best wall time of rounds runs of fn, in ms
+template <class Fn>
+double best_of(int rounds, Fn fn) {
+    double best = 1e300;
+    for (int r = 0; r < rounds; r++) {
+        auto t0 = chrono::steady_clock::now();
+        fn();
+        auto t1 = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double, milli>(t1 - t0).count());
+    }
+    return best;
+}
+
+// KernelGraph, a traverse, then a long chain of .in/.values pairs with
+// nested iters every 50 statements.
+inline string synth_policy(int stmts) {
+    string s = "KernelGraph(init_task)\n.traverse(1960, 0xffffffffa1013c28, 1960)\n";
+    for (int i = 0; i < stmts; i++) {
+        if (i % 50 == 49)
+            s += ".iter(0, 4, 8)\n.in(0)\n";
+        else if (i % 2 == 0)
+            s += ".in(" + to_string(8 * (i % 64)) + ")\n";
+        else
+            s += ".values(8, 16, 24)\n";
+    }
+    s += ".values(8)\nEnd\n";
+    return s;
+}
+
+// policies of different shapes and sizes by seed, so the footprints differ
+inline string synth_policy(int stmts, int seed) {
+    string s = "KernelGraph(init_task)\n";
+    if (seed % 3 == 0)
+        s += ".traverse(1960, 0xffffffffa1013c28, 1960)\n";
+    int n = stmts / 2 + (seed * 37) % stmts;
+    for (int i = 0; i < n; i++) {
+        if (i % 50 == 49 && seed % 2 == 0)
+            s += ".iter(0, 4, 8)\n.in(0)\n";
+        else if (i % 2 == 0)
+            s += ".in(" + to_string(8 * ((i + seed) % 64)) + ")\n";
+        else if (i % 3 == 0)
+            s += ".values(8)\n";
+        else
+            s += ".values(8, 16, 24)\n";
+    }
+    s += ".values(8)\nEnd\n";
+    return s;
+}
+
+
+#endif // _BENCH_UTIL_H
@@ -0,0 +1,54 @@
+// Delta install on large rule sets: the installed rules against a compile
+// where 1% of the entries changed their params, 0.5% are gone and 0.5%
+// belong to new QPN states.
+//
+//   ./delta_bench [max_rules=1000000]
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../ir/rule_ir.h"
+#include "../ir/rule_diff.h"
+#include "../utils/rule_sink.h"
+
+using namespace std;
+
+static const char *TABLES[] = {"end_transfer_tab", "direct_transfer_tab", "cloning_tab", "check_null_tab",
+    "mod_field_parameters_tab", "encode_mod_offset_tab", "read_update_psn_tab", "add_offset_1_tab"};
+
+// n rules on QPN states from qpn on, 8 tables round robin; rules with i % 100 == 7 get other params
+static void synth(RuleSet &rules, int n, int qpn, bool changed) {
+    for (int i = 0; i < n; i++) {
+        rules.add(TABLES[i % 8], "mod_qpn_dqpn")
+            .key("ib_aeth_valid", 1).key("md_qpn", qpn + i / 8).key("md_end_bit", i % 2)
+            .param("qpn", qpn + i / 8 + 1).param("dqpn", changed && i % 100 == 7 ? 7 : i);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int max_rules = argc > 1 ? stoi(argv[1]) : 1000000;
+    for (int n = 10000; n <= max_rules; n *= 10) {
+        RuleSet installed, next;
+        synth(installed, n, 0, false);
+        // the last 0.5% are gone, 0.5% more on new states
+        synth(next, n - n / 200, 0, true);
+        RuleSet fresh;
+        synth(fresh, n / 200, 100000000, false);
+        next.append(fresh);
+
+        auto t0 = chrono::steady_clock::now();
+        RuleDelta delta;
+        RuleDiff::diff(installed, next, delta);
+        auto t1 = chrono::steady_clock::now();
+        CountingSink script;
+        RuleDiff::write_script(installed, next, delta, script);
+        auto t2 = chrono::steady_clock::now();
+
+        cout << n << " rules: +" << delta.adds() << " ~" << delta.modifies() << " -" << delta.deletes()
+             << " (" << delta.kept << " kept), "
+             << "diff " << chrono::duration<double, milli>(t1 - t0).count() << " ms, script "
+             << chrono::duration<double, milli>(t2 - t1).count() << " ms, " << script.get_lines() << " lines" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Relinking relocatable policies against compiling them again, on the
+// exe/policy*.c pool: a reconnect hands out new QPN bases and the policies
+// are installed in reverse order.
+//
+//   ./link_bench [rounds=50]
+
+#include <string>
+#include <vector>
+
+#include "../rdmi.h"
+#include "bench_util.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? stoi(argv[1]) : 50;
+
+    vector<string> sources = policy_pool();
+    if (sources.empty()) {
+        cout << "run from the compiler directory, ./exe/policy*.c not found" << endl;
+        return 1;
+    }
+    int num = sources.size();
+    vector<string> reversed(sources.rbegin(), sources.rend());
+
+    NullBuf null;
+    streambuf *saved = cout.rdbuf(&null);
+    CompileOutput first;
+    double reloc = mean_of(1, [&] {
+        Compiler compiler(3000, 300);
+        compiler.set_relocatable(true);
+        first = compiler.compile(sources);
+    });
+    vector<RelocatableRules> objects;
+    size_t relocs = 0, fields = 0;
+    for (int i = num - 1; i >= 0; i--) {
+        objects.push_back(first.policies[i].object);
+        relocs += objects.back().relocs.size();
+        fields += objects.back().rules.num_fields();
+    }
+
+    CompileOutput compiled;
+    double compile = mean_of(rounds, [&] {
+        Compiler compiler(5120, 777);
+        compiled = compiler.compile(reversed);
+    });
+    cout.rdbuf(saved);
+
+    CompileOutput linked;
+    double link = mean_of(rounds * 20, [&] {
+        Compiler compiler(5120, 777);
+        linked = compiler.link(objects);
+    });
+
+    bool same = compiled.summary == linked.summary;
+    for (int i = 0; i < num && same; i++)
+        same = compiled.policies[i].rules.field_value == linked.policies[i].rules.field_value;
+
+    cout << num << " policies, " << fields << " fields, " << relocs << " relocations" << endl;
+    cout << "  relocatable compile: " << reloc << " ms" << endl;
+    cout << "  compile:             " << compile << " ms" << endl;
+    cout << "  link:                " << link << " ms" << endl;
+    cout << "  speedup: " << compile / link << "x, output " << (same ? "identical" : "DIFFERS") << endl;
+    return same ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// Table entry minimization and its lookup model: the exe/policy*.c pool
+// compiled with set_minimize(), then synthetic assert and page walk
+// entries laid out so that every step of RuleMinimizer fires. Each rule
+// set is checked against the generated one by MatchModel::verify, and a
+// minimized set with one range widened by a single address must fail it.
+//
+//   ./minimize_bench [max_rules=100000]
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../ir/rule_ir.h"
+#include "../ir/rule_opt.h"
+#include "../rdmi.h"
+#include "bench_util.h"
+
+using namespace std;
+
+static string hex16(int v) {
+    static const char *digits = "0123456789abcdef";
+    string s;
+    for (int sh = 12; sh >= 0; sh -= 4)
+        s += digits[(v >> sh) & 0xf];
+    return s;
+}
+
+/**
+ * n rules on QPN states from qpn on, groups of 16 per state:
+ *   - the low 16 bits of a module window as four adjacent ranges, they
+ *     merge into one
+ *   - four page walk entries whose addresses differ in their two lowest
+ *     bits, they merge into one ternary entry
+ *   - one range and one page walk entry again, dropped as duplicates
+ *   - the two entries of gen_mark_vmalloc_bit_p1_tab, different
+ *     priorities and params, left alone
+ *   - four alarm entries, exact only, two of them duplicates
+ */
+static void synth(RuleSet &rules, int n, int qpn) {
+    for (int i = 0; i < n / 16; i++) {
+        int q = qpn + i;
+        string h16 = hex16(0xc0a0 + i % 8);
+        for (int k = 0; k < 5; k++) {
+            rules.add("exact_match_tab", "mark_range_k1")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", q).key_hex("md_addr_h_16", h16)
+                .key_hex("md_addr_l_16_start", hex16(k % 4 * 0x4000))
+                .key_hex("md_addr_l_16_end", hex16(k % 4 * 0x4000 + 0x3fff)).prio(0);
+        }
+        for (int k = 0; k < 5; k++) {
+            rules.add("mark_vmalloc_bit_p1_tab", "mark_addr_type")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", q).key_hex("md_aeth_addr_h", "c0a0" + hex16(k % 4))
+                .key_hex("md_aeth_addr_h_mask", "ffffffff").prio(10).param("tp", 3);
+        }
+        rules.add("mark_vmalloc_bit_p1_tab", "mark_addr_type")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", q).key_hex("md_aeth_addr_h", "ffffffff")
+            .key_hex("md_aeth_addr_h_mask", "ffffffff").prio(10).param("tp", 1);
+        rules.add("mark_vmalloc_bit_p1_tab", "mark_addr_type")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", q).key_hex("md_aeth_addr_h", "ffff0000")
+            .key_hex("md_aeth_addr_h_mask", "ffff0000").prio(100).param("tp", 2);
+        for (int k = 0; k < 4; k++) {
+            rules.add("gen_mali_alarm_tab", "gen_mali_alarm")
+                .key_dqpn("ib_bth_dqpn", q).key("md_k1", 0).key("md_k2", 0)
+                .key("eg_intr_md_from_parser_aux_clone_src", k % 2);
+        }
+    }
+}
+
+static void print(const string &what, const MinimizeStats &s, double minimize, double verify) {
+    cout << what << ": " << s.before() << " -> " << s.after() << " entries, " << s.duplicates
+         << " duplicates, " << s.merged << " merged, " << s.conflicts.size() << " conflicts, minimize "
+         << minimize << " ms, verify " << verify << " ms" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    int max_rules = argc > 1 ? stoi(argv[1]) : 100000;
+
+    vector<string> sources = policy_pool();
+    if (sources.empty()) {
+        cout << "run from the compiler directory, ./exe/policy*.c not found" << endl;
+        return 1;
+    }
+    NullBuf null;
+    streambuf *saved = cout.rdbuf(&null);
+    Compiler compiler(QPN_S, QPN_R);
+    CompileOutput out = compiler.compile(sources);
+    cout.rdbuf(saved);
+    MinimizeStats pool;
+    double minimize = 0, verify = 0;
+    for (PolicyOutput &po: out.policies) {
+        RuleSet generated = po.rules;
+        minimize += mean_of(1, [&] { RuleMinimizer::minimize(po.rules, pool); });
+        verify += mean_of(1, [&] { MatchModel::verify(generated, po.rules); });
+    }
+    print(to_string(sources.size()) + " policies", pool, minimize, verify);
+
+    for (int n = 10000; n <= max_rules; n *= 10) {
+        RuleSet generated;
+        synth(generated, n, 100000);
+        RuleSet rules = generated;
+        MinimizeStats stats;
+        double m = mean_of(1, [&] { RuleMinimizer::minimize(rules, stats); });
+        double v = mean_of(1, [&] { MatchModel::verify(generated, rules); });
+        print(to_string(n) + " rules", stats, m, v);
+
+        // one address past the merged window must not match
+        for (int r = 0; r < rules.size(); r++) {
+            if (rules.syms.name(rules.table[r]) != "exact_match_tab")
+                continue;
+            rules.field_value[rules.keys_end(r) - 1]++;
+            break;
+        }
+        try {
+            MatchModel::verify(generated, rules);
+            cout << "  widened range not caught" << endl;
+            return 1;
+        } catch (const runtime_error &e) {
+            cout << "  widened range caught: " << e.what() << endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+// Multi-policy compile benchmark: the former sequential chain, where each
+// policy starts from the avail_state left by the previous one, against the
+// footprint / prefix sum / thread pool compile of Compiler at 1 to 64
+// threads. Every parallel run is checked byte for byte against the chain.
+//
+//   ./parallel_bench [policies=64] [stmts=400] [rounds=3]
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../rdmi.h"
+#include "../ir/serializer.h"
+#include "bench_util.h"
+
+using namespace std;
+
+static string render(const RuleSet &rules) {
+    BufferSink sink;
+    BfshellSerializer().write(rules, sink);
+    return sink.str();
+}
+
+// the former main(): one policy after the other
+static void compile_chain(const vector<string> &sources, vector<string> &out) {
+    int avail_state = QPN_S;
+    for (int i = 0; i < (int)sources.size(); i++) {
+        Policy *d = new Policy();
+        d->load(sources[i], avail_state, avail_state + QPN_R - QPN_S, i, QPN_S);
+        d->parse();
+        d->mark_iter();
+        d->mark_assert();
+        d->frontend_compile();
+        d->gen_pgt_walk_aim();
+        RuleSet rules;
+        d->gen_rules(rules);
+        out[i] = render(rules);
+        avail_state = d->avail_state;
+        delete d;
+    }
+}
+
+// footprints, prefix sum, then every policy on its own
+static void compile_parallel(const vector<string> &sources, int threads, vector<string> &out) {
+    Compiler compiler(QPN_S, QPN_R, threads);
+    compiler.set_budget(false); // far more policies than the switch holds
+    CompileOutput res = compiler.compile(sources);
+    for (int i = 0; i < (int)sources.size(); i++)
+        out[i] = render(res.policies[i].rules);
+}
+
+int main(int argc, char *argv[]) {
+    int num = argc > 1 ? stoi(argv[1]) : 64;
+    int stmts = argc > 2 ? stoi(argv[2]) : 400;
+    int rounds = argc > 3 ? stoi(argv[3]) : 3;
+
+    vector<string> sources;
+    for (int i = 0; i < num; i++)
+        sources.push_back(synth_policy(stmts, i));
+
+    NullBuf null;
+    streambuf *saved = cout.rdbuf(&null);
+    vector<string> ref(num), out(num);
+    double chain = best_of(rounds, [&] { compile_chain(sources, ref); });
+    size_t bytes = 0;
+    for (const string &s: ref)
+        bytes += s.size();
+    cout.rdbuf(saved);
+
+    cout << num << " policies, " << bytes << " bytes of rules, " << thread::hardware_concurrency()
+         << " hardware threads, best of " << rounds << endl;
+    cout << "  sequential chain: " << chain << " ms" << endl;
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        cout.rdbuf(&null);
+        double ms = best_of(rounds, [&] { compile_parallel(sources, threads, out); });
+        cout.rdbuf(saved);
+        bool same = out == ref;
+        cout << "  " << threads << " threads: " << ms << " ms, " << chain / ms << "x"
+             << (same ? "" : ", OUTPUT DIFFERS") << endl;
+        if (!same)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Parser benchmark: the single pass lexer/recursive descent parser against
+// the former per-line std::regex parser.
+//
+// The workload is the policy pool with concrete offsets (exe/policy*.c)
+// replicated N times into one bundle.
+//
+//   ./parse_bench [replicas=10000] [legacy_replicas=100]
+
+#include <chrono>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../parser/parser.h"
+#include "../utils/utils.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Former Policy::parse(), kept here as the baseline.
+static int legacy_parse(const string &src, vector<Op*> &ops) {
+    stringstream in(src);
+    string l;
+    int stmts = 0;
+    while (getline(in, l)) {
+        regex r("//.*|/\\*.*\\*/");
+        if (l.empty() || regex_match(l, r))
+            continue;
+        string line = trim(l);
+        smatch m;
+        if (0 == line.rfind(".traverse")) {
+            regex reg_t("\\.traverse\\s*\\((\\d+,\\s*\\w+,\\s*\\d+)\\)");
+            regex sreg_t("\\.traverse\\s*\\((\\w+),\\s*(\\w+),\\s*(\\w+)\\)");
+            if (!regex_match(line, reg_t) || !regex_search(line, m, sreg_t))
+                throw_error("Invalid traverse statement");
+            Traverse *t = new Traverse();
+            t->set_offset(m.str(1)); t->set_end(m.str(2)); t->set_type(m.str(3));
+            ops.push_back(t);
+        } else if (0 == line.rfind(".in")) {
+            regex reg_in(".in\\s*\\((\\w+)\\)");
+            regex reg_dec(".in\\s*\\((\\w+),\\s*@(\\w+),\\s*(\\w+)\\)");
+            In *i = new In();
+            if (regex_search(line, m, reg_in)) {
+                i->set_offset(m.str(1));
+            } else if (regex_search(line, m, reg_dec)) {
+                i->set_offset(m.str(1)); i->set_dec(true); i->set_type(m.str(2)); i->set_var(m.str(3));
+            } else {
+                throw_error("Invalid in statement");
+            }
+            ops.push_back(i);
+        } else if (0 == line.rfind(".iter")) {
+            regex reg_fixed("\\.iter\\s*\\(\\w+,\\s*\\d+,\\s*\\w+\\)");
+            regex reg_dynamic("\\.iter\\s*\\(\\w+,\\s*\\w+,\\s*\\w+\\)");
+            regex sreg_dynamic("\\.iter\\s*\\((\\w+),\\s*(\\w+),\\s*(\\w+)\\)");
+            regex sreg_fixed("\\.iter\\s*\\((\\w+),\\s*(\\d+),\\s*(\\w+)\\)");
+            if (!regex_match(line, reg_dynamic) && !regex_match(line, reg_fixed))
+                throw_error("Invalid iter statement");
+            Iter *it = new Iter();
+            bool fixed = regex_search(line, m, sreg_fixed);
+            if (!fixed)
+                regex_search(line, m, sreg_dynamic);
+            it->set_offset(m.str(1)); it->set_sstep(m.str(2)); it->set_size(m.str(3));
+            it->set_dynamic(fixed ? 0 : 1);
+            ops.push_back(it);
+        } else if (0 == line.rfind(".values")) {
+            regex reg_clone("\\.values\\s*\\(\\w+(,\\s*\\w+)*\\)");
+            regex reg_fd("\\.values\\s*\\(@\\w+,\\s*\\w+\\)");
+            regex sreg_clone("\\.values\\s*\\((\\w+(,\\s*\\w+)*)\\)");
+            regex sreg_fd("\\.values\\s*\\(@(\\w+),\\s*(\\w+)\\)");
+            if (!regex_match(line, reg_clone) && !regex_match(line, reg_fd))
+                throw_error("Invalid values statement");
+            Values *vs = new Values();
+            if (regex_search(line, m, sreg_clone)) {
+                for (string f: split(m.str(1), ","))
+                    vs->add_field(f);
+            } else if (regex_search(line, m, sreg_fd)) {
+                vs->set_name(m.str(1)); vs->add_field(m.str(2));
+            }
+            ops.push_back(vs);
+        } else if (0 == line.rfind("KernelGraph")) {
+            regex reg_kg("KernelGraph\\s*\\((\\w+)\\)");
+            if (!regex_match(line, reg_kg) || !regex_search(line, m, reg_kg))
+                throw_error("Invalid kernelgraph statement");
+            KernelGraph *kg = new KernelGraph();
+            kg->set_root(m.str(1));
+            ops.push_back(kg);
+        } else if (0 == line.rfind(".assert")) {
+            regex reg_t("\\.assert\\s*\\((\\s*\\w+,\\s*\\w+)\\)");
+            regex sreg_t("\\.assert\\s*\\(\\s*(\\w+),\\s*(\\w+)\\)");
+            if (!regex_match(line, reg_t) || !regex_search(line, m, sreg_t))
+                throw_error("Invalid assert statement");
+            Asser *a = new Asser();
+            a->set_high(m.str(1)); a->set_low(m.str(2));
+            ops.push_back(a);
+        } else if (0 == line.rfind("End")) {
+            regex reg_end("End");
+            if (!regex_match(line, reg_end))
+                throw_error("Invalid end statement");
+            ops.push_back(new End());
+        } else {
+            throw_error("Cannot recognize line the operator!");
+        }
+        stmts++;
+    }
+    return stmts;
+}
+
+static void release(vector<Op*> &ops) {
+    for (Op *op: ops)
+        delete op;
+    ops.clear();
+}
+
+static string replicate(const string &s, int n) {
+    string out;
+    out.reserve(s.size() * n);
+    for (int i = 0; i < n; i++)
+        out += s;
+    return out;
+}
+
+int main(int argc, char *argv[]) {
+    int replicas = argc > 1 ? stoi(argv[1]) : 10000;
+    int legacy_replicas = argc > 2 ? stoi(argv[2]) : 100;
+
+    string pool;
+    for (const string &policy: policy_pool())
+        pool += policy + '\n';
+    if (pool.empty()) {
+        cout << "run from the compiler directory, ./exe/policy*.c not found" << endl;
+        return 1;
+    }
+
+    vector<Op*> ops;
+    using clk = chrono::steady_clock;
+
+    string bundle = replicate(pool, replicas);
+    auto t0 = clk::now();
+    Arena arena;
+    Parser parser(bundle, arena, false);
+    ops = parser.parse();
+    auto t1 = clk::now();
+    double ns = chrono::duration<double, nano>(t1 - t0).count();
+    size_t stmts = ops.size();
+    cout << "recursive descent: " << replicas << " replicas, " << stmts << " statements, "
+         << bundle.size() << " bytes, " << ns / 1e6 << " ms, " << ns / stmts << " ns/stmt, arena peak "
+         << arena.peak_bytes() << " bytes" << endl;
+    ops.clear();
+    arena.release();
+
+    string small = replicate(pool, legacy_replicas);
+    t0 = clk::now();
+    int legacy_stmts = legacy_parse(small, ops);
+    t1 = clk::now();
+    double legacy_ns = chrono::duration<double, nano>(t1 - t0).count();
+    cout << "std::regex:        " << legacy_replicas << " replicas, " << legacy_stmts << " statements, "
+         << legacy_ns / 1e6 << " ms, " << legacy_ns / legacy_stmts << " ns/stmt" << endl;
+    release(ops);
+
+    cout << "speedup: " << (legacy_ns / legacy_stmts) / (ns / stmts) << "x per statement" << endl;
+    return 0;
+}
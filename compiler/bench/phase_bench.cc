@@ -0,0 +1,180 @@
+// Per phase compile benchmark on synthetic workloads that stress one shape
+// of policy each, so a regression shows up in the phase and shape it hits:
+//
+//   in_chain  a KernelGraph followed by a long chain of .in
+//   nested    traverses and iters nested into each other, a .values per level
+//   values    .values with many fields each
+//   bundle    the policy pool (exe/policy*.c) replicated into N policies,
+//             installed one after the other
+//
+// Each policy goes through the passes of Compiler::compile(), timed by its
+// PolicyProfile: parse, mark_iter, mark_assert, frontend_compile,
+// gen_pgt_walk_aim and every gen_* pass of gen_rules(), then the bfshell
+// output to a file. Per phase the
+// best of the rounds is reported in ms and ns per statement, the whole
+// compile also in rules per second.
+//
+//   ./phase_bench [stmts=2000] [policies=64] [rounds=5]
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../policy.h"
+#include "../ir/serializer.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// the passes of utils/profile.h, then the file output
+static const int PH_OUTPUT = PH_NUM, PHASES = PH_NUM + 1;
+
+static const char* phase_name(int p) { return p == PH_OUTPUT ? "file output" : PHASE_NAMES[p]; }
+
+struct Workload {
+    string name;
+    vector<string> sources;
+    long stmts = 0;
+};
+
+// statements of a policy text: KernelGraph, End and every .primitive
+static long count_stmts(const string &text) {
+    long n = 0;
+    stringstream in(text);
+    string l;
+    while (getline(in, l)) {
+        size_t at = l.find_first_not_of(" \t");
+        if (at != string::npos && (l[at] == '.' || l.compare(at, 11, "KernelGraph") == 0 || l.compare(at, 3, "End") == 0))
+            n++;
+    }
+    return n;
+}
+
+static Workload make(const string &name, const vector<string> &sources) {
+    Workload w;
+    w.name = name;
+    w.sources = sources;
+    for (const string &s: sources)
+        w.stmts += count_stmts(s);
+    return w;
+}
+
+static string in_chain(int stmts) {
+    string s = "KernelGraph(init_task)\n";
+    for (int i = 0; i < stmts; i++)
+        s += ".in(" + to_string(8 * (i % 64)) + ")\n";
+    return s + ".values(8)\nEnd\n";
+}
+
+// loops nest up to depth, then the chain closes them all at End
+static string nested(int stmts, int depth) {
+    string s = "KernelGraph(init_task)\n";
+    int levels = 0;
+    for (int i = 0; i < stmts; i++) {
+        if (levels < depth && i % (stmts / depth + 1) == 0) {
+            s += levels % 2 == 0 ? ".traverse(1960, 0xffffffffa1013c28, 1960)\n" : ".iter(0, 4, 8)\n";
+            levels++;
+        }
+        else if (i % 2 == 0)
+            s += ".in(" + to_string(8 * (i % 64)) + ")\n";
+        else
+            s += ".values(8, 16)\n";
+    }
+    return s + ".values(8)\nEnd\n";
+}
+
+static string wide_values(int stmts, int fields) {
+    string s = "KernelGraph(init_task)\n";
+    for (int i = 0; i < stmts; i++) {
+        s += ".values(";
+        for (int f = 0; f < fields; f++)
+            s += (f ? ", " : "") + to_string(8 * f);
+        s += ")\n";
+    }
+    return s + "End\n";
+}
+
+static vector<string> bundle(int policies) {
+    vector<string> pool = policy_pool();
+    if (pool.empty())
+        throw runtime_error("no exe/policy*.c, run from the compiler directory");
+    vector<string> out;
+    for (int i = 0; i < policies; i++)
+        out.push_back(pool[i % pool.size()]);
+    return out;
+}
+
+template <class Fn>
+static void timed(double ns[PHASES], int p, Fn fn) {
+    auto t0 = chrono::steady_clock::now();
+    fn();
+    ns[p] += chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+}
+
+// one round over every policy of the workload, ns per phase into ns, returns the rules generated
+static size_t compile(const Workload &w, double ns[PHASES]) {
+    size_t rules_out = 0;
+    int avail_state = QPN_S;
+    BfshellSerializer bfshell;
+    for (int i = 0; i < (int)w.sources.size(); i++) {
+        Policy d;
+        d.load(w.sources[i], avail_state, avail_state + QPN_R - QPN_S, i, QPN_S);
+        RuleSet rules;
+        d.parse();
+        d.mark_iter();
+        d.mark_assert();
+        d.frontend_compile();
+        d.gen_pgt_walk_aim();
+        d.gen_rules(rules);
+        for (int p = 0; p < PH_NUM; p++) // as the policy timed its passes
+            ns[p] += d.profile.phases[p].ns;
+        timed(ns, PH_OUTPUT, [&] {
+            FileSink file("/tmp/rdmi_phase_bench" + to_string(i % 16) + ".cmd");
+            bfshell.write(rules, file);
+            file.flush();
+        });
+        rules_out += rules.size();
+        avail_state = d.avail_state;
+    }
+    return rules_out;
+}
+
+static void run(const Workload &w, int rounds) {
+    NullBuf null;
+    streambuf *saved = cout.rdbuf(&null);
+    double best[PHASES];
+    for (int p = 0; p < PHASES; p++)
+        best[p] = 1e300;
+    size_t rules = 0;
+    for (int r = 0; r < rounds; r++) {
+        double ns[PHASES] = {};
+        rules = compile(w, ns);
+        for (int p = 0; p < PHASES; p++)
+            best[p] = min(best[p], ns[p]);
+    }
+    cout.rdbuf(saved);
+
+    double total = 0;
+    for (int p = 0; p < PHASES; p++)
+        total += best[p];
+    printf("%s: %zu policies, %ld statements, %zu rules, best of %d\n", w.name.c_str(), w.sources.size(),
+        w.stmts, rules, rounds);
+    for (int p = 0; p < PHASES; p++)
+        printf("  %-28s %10.3f ms %10.1f ns/stmt\n", phase_name(p), best[p] / 1e6, best[p] / w.stmts);
+    printf("  %-28s %10.3f ms %10.1f ns/stmt %12.0f rules/s\n", "total", total / 1e6, total / w.stmts,
+        rules / (total / 1e9));
+}
+
+int main(int argc, char *argv[]) {
+    int stmts = argc > 1 ? stoi(argv[1]) : 2000;
+    int policies = argc > 2 ? stoi(argv[2]) : 64;
+    int rounds = argc > 3 ? stoi(argv[3]) : 5;
+
+    run(make("in_chain", {in_chain(stmts)}), rounds);
+    run(make("nested", {nested(stmts, 8)}), rounds);
+    run(make("values", {wide_values(stmts / 4, 16)}), rounds);
+    run(make("bundle", bundle(policies)), rounds);
+    return 0;
+}
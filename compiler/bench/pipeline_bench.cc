@@ -0,0 +1,133 @@
+// Full compile pipeline benchmark (the policy1() sequence of main.cc) on
+// large synthetic policies, plus rule IR construction and each serializer
+// on its own.
+//
+//   ./pipeline_bench [stmts=2000] [rounds=5]
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+#include "../policy.h"
+#include "../ir/serializer.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// heap allocations made by the process, counted by the operator new below
+static size_t num_allocs = 0;
+static size_t alloc_bytes = 0;
+
+void* operator new(size_t n) {
+    num_allocs++;
+    alloc_bytes += n;
+    void *p = malloc(n ? n : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static Policy* frontend(const string &path, int task) {
+    Policy *d = new Policy(path, 3000, 300, task, 3000);
+    d->parse();
+    d->mark_iter();
+    d->mark_assert();
+    d->frontend_compile();
+    d->gen_pgt_walk_aim();
+    return d;
+}
+
+struct Result {
+    double ms = 1e300;
+    size_t allocs = 0;
+    size_t bytes = 0;
+};
+
+// best of `rounds` runs of fn()
+template <class Fn>
+static Result bench(int rounds, Fn fn) {
+    Result res;
+    for (int r = 0; r < rounds; r++) {
+        size_t a0 = num_allocs, b0 = alloc_bytes;
+        auto t0 = chrono::steady_clock::now();
+        fn();
+        auto t1 = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(t1 - t0).count();
+        if (ms < res.ms)
+            res.ms = ms;
+        res.allocs = num_allocs - a0;
+        res.bytes = alloc_bytes - b0;
+    }
+    return res;
+}
+
+static void report(const char *name, const Result &r, size_t rule_bytes) {
+    cout << "  " << name << r.ms << " ms, " << r.allocs << " allocations (" << r.bytes << " bytes), "
+         << rule_bytes / (r.ms * 1e3) << " MB/s" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    int stmts = argc > 1 ? stoi(argv[1]) : 2000;
+    int rounds = argc > 2 ? stoi(argv[2]) : 5;
+
+    string path = "/tmp/rdmi_pipeline_bench.c";
+    ofstream(path) << synth_policy(stmts);
+
+    NullBuf null;
+    streambuf *saved = cout.rdbuf(&null);
+
+    // whole pipeline, bfshell rules written to a file as main.cc does
+    BfshellSerializer bfshell;
+    JsonSerializer json;
+    BinarySerializer binary;
+    double best = best_of(rounds, [&] {
+        Policy *d = frontend(path, 0);
+        RuleSet rules;
+        d->gen_rules(rules);
+        FileSink file("/tmp/rdmi_pipeline_bench.cmd");
+        bfshell.write(rules, file);
+        file.flush();
+        delete d;
+    });
+
+    // rule IR construction alone, then each serializer over the same IR
+    Policy *d = frontend(path, 0);
+    RuleSet rules;
+    Result build = bench(rounds, [&] {
+        rules.clear();
+        d->gen_rules(rules);
+    });
+    CountingSink counter;
+    bfshell.write(rules, counter);
+    size_t rule_bytes = counter.get_bytes();
+    Result cmd = bench(rounds, [&] { BufferSink out(rule_bytes); bfshell.write(rules, out); });
+    Result cmd_file = bench(rounds, [&] { FileSink out("/tmp/rdmi_pipeline_bench.cmd"); bfshell.write(rules, out); });
+    CountingSink json_counter, bin_counter;
+    json.write(rules, json_counter);
+    binary.write(rules, bin_counter);
+    Result js = bench(rounds, [&] { BufferSink out(json_counter.get_bytes()); json.write(rules, out); });
+    Result bin = bench(rounds, [&] { BufferSink out(bin_counter.get_bytes()); binary.write(rules, out); });
+    BufferSink image;
+    binary.write(rules, image);
+    Result load = bench(rounds, [&] {
+        RuleSet loaded;
+        BinarySerializer::read(image.str().data(), image.str().size(), loaded);
+    });
+    delete d;
+    cout.rdbuf(saved);
+
+    cout << "policy1 pipeline: " << stmts << " statements, " << rules.size() << " rules, "
+         << rule_bytes << " bytes / " << counter.get_lines() << " lines of bfshell, best of "
+         << rounds << ": " << best << " ms" << endl;
+    report("rule IR build:     ", build, rule_bytes);
+    report("bfshell to memory: ", cmd, rule_bytes);
+    report("bfshell to file:   ", cmd_file, rule_bytes);
+    report("json to memory:    ", js, json_counter.get_bytes());
+    report("binary to memory:  ", bin, bin_counter.get_bytes());
+    report("binary load:       ", load, bin_counter.get_bytes());
+    return 0;
+}
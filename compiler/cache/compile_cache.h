@@ -0,0 +1,328 @@
+#ifndef _COMPILE_CACHE_H
+#define _COMPILE_CACHE_H
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../parser/lexer.h"
+#include "../ir/rule_ir.h"
+#include "../ir/serializer.h"
+#include "../ir/relocation.h"
+
+using namespace std;
+
+// 128 bit content hash of a policy compile
+struct CacheKey {
+    uint64_t h[2] = {0, 0};
+
+    bool operator==(const CacheKey &o) const { return h[0] == o.h[0] && h[1] == o.h[1]; }
+};
+
+// what a cache hit hands back besides the rules
+struct CacheEntry {
+    int avail_state = 0; // avail_state after the policy was compiled, the QPN states it takes under a digest
+    int fake_states = 0;
+    int stack = 0;
+    int regs = 0;
+    uint32_t compile_us = 0; // time the compile took, reported as saved on a hit
+};
+
+/**
+ * Content addressed cache of compiled policies, kept in a directory:
+ *
+ *   index  open addressing hash table, mapped into memory
+ *   data   rule images (BinarySerializer format), or relocatable objects
+ *          (RelocatableRules) of relocatable compiles, appended one after the other
+ *
+ * The key covers the policy statements as the lexer sees them (comments
+ * and white space do not matter) and every base the policy is compiled
+ * at, see LinkBases. Under the digest of the statements and options alone
+ * an entry without rules keeps what the policy takes, which does not
+ * depend on the bases, so the bases can be laid out before the policies
+ * missing are parsed. Bump VERSION whenever the generated rules change for the
+ * same input. Processes sharing a directory serialize through flock()
+ * on the index.
+ */
+class CompileCache {
+private:
+    static const uint32_t VERSION = 3;
+    static const uint32_t FIRST_CAPACITY = 1024; // slots, a power of two
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t capacity;
+        uint32_t count;
+        uint32_t pad;
+        uint64_t data_size;
+    };
+    struct Slot {
+        CacheKey key;
+        uint64_t offset; // of the rule image in data
+        uint32_t length;
+        uint32_t used;
+        CacheEntry entry;
+    };
+
+    string dir;
+    int index_fd = -1;
+    int data_fd = -1;
+    Header *hdr = nullptr;
+    size_t mapped = 0;
+
+    Slot* slots() { return (Slot *)(this->hdr + 1); }
+
+    static size_t index_size(uint32_t capacity) { return sizeof(Header) + capacity * sizeof(Slot); }
+
+    static void fail(const string &what) {
+        throw runtime_error("compile cache: " + what + ": " + strerror(errno));
+    }
+
+    // map the index as large as the file currently is
+    void remap() {
+        struct stat st;
+        if (fstat(this->index_fd, &st) != 0)
+            fail("stat index");
+        if (this->hdr)
+            munmap(this->hdr, this->mapped);
+        this->mapped = st.st_size;
+        void *p = mmap(nullptr, this->mapped, PROT_READ | PROT_WRITE, MAP_SHARED, this->index_fd, 0);
+        if (p == MAP_FAILED)
+            fail("mmap index");
+        this->hdr = (Header *)p;
+    }
+
+    // another process may have grown the index
+    void sync() {
+        if (index_size(this->hdr->capacity) != this->mapped)
+            this->remap();
+    }
+
+    void init_index(uint32_t capacity) {
+        if (ftruncate(this->index_fd, index_size(capacity)) != 0)
+            fail("resize index");
+        this->remap();
+        memset((void *)this->hdr, 0, this->mapped);
+        memcpy(this->hdr->magic, "RDMICACH", 8);
+        this->hdr->version = VERSION;
+        this->hdr->capacity = capacity;
+    }
+
+    Slot* probe(const CacheKey &key) {
+        uint32_t mask = this->hdr->capacity - 1;
+        for (uint32_t i = key.h[0] & mask; ; i = (i + 1) & mask) {
+            Slot &s = this->slots()[i];
+            if (!s.used || s.key == key)
+                return &s;
+        }
+    }
+
+    // double the table, rehashing every slot in place
+    void grow() {
+        uint32_t capacity = this->hdr->capacity;
+        uint64_t data_size = this->hdr->data_size;
+        vector<Slot> old(this->slots(), this->slots() + capacity);
+        this->init_index(capacity * 2);
+        this->hdr->data_size = data_size;
+        for (Slot &s: old) {
+            if (!s.used)
+                continue;
+            *this->probe(s.key) = s;
+            this->hdr->count++;
+        }
+    }
+
+    // the image formats of the data file
+    static void parse(const vector<char> &image, RuleSet &rules) {
+        BinarySerializer::read(image.data(), image.size(), rules);
+    }
+    static void parse(const vector<char> &image, RelocatableRules &object) {
+        object.read(image.data(), image.size());
+    }
+    static void serialize(const RuleSet &rules, RuleSink &out) { BinarySerializer().write(rules, out); }
+    static void serialize(const RelocatableRules &object, RuleSink &out) { object.write(out); }
+
+    struct Lock {
+        int fd;
+        Lock(int fd, int op) : fd(fd) { flock(fd, op); }
+        ~Lock() { flock(fd, LOCK_UN); }
+    };
+
+    // append the image to data and enter it under key
+    void put(const CacheKey &key, const CacheEntry &entry, const string &buf) {
+        Lock lock(this->index_fd, LOCK_EX);
+        this->sync();
+        if ((this->hdr->count + 1) * 2 > this->hdr->capacity)
+            this->grow();
+        Slot *s = this->probe(key);
+        if (s->used)
+            return; // added by another process meanwhile
+        uint64_t offset = this->hdr->data_size;
+        if (pwrite(this->data_fd, buf.data(), buf.size(), offset) != (ssize_t)buf.size())
+            fail("write data");
+        this->hdr->data_size += buf.size();
+        s->key = key;
+        s->offset = offset;
+        s->length = buf.size();
+        s->entry = entry;
+        s->used = 1;
+        this->hdr->count++;
+    }
+
+public:
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t saved_us = 0;  // compile time of the policies served from the cache
+    uint64_t lookup_us = 0; // time spent in lookups, hits and misses
+
+    CompileCache(const string &dir) : dir(dir) {
+        mkdir(dir.c_str(), 0755);
+        this->index_fd = open((dir + "/index").c_str(), O_RDWR | O_CREAT, 0644);
+        if (this->index_fd < 0)
+            fail("open " + dir + "/index");
+        this->data_fd = open((dir + "/data").c_str(), O_RDWR | O_CREAT, 0644);
+        if (this->data_fd < 0)
+            fail("open " + dir + "/data");
+        Lock lock(this->index_fd, LOCK_EX);
+        struct stat st;
+        if (fstat(this->index_fd, &st) != 0)
+            fail("stat index");
+        if ((size_t)st.st_size < sizeof(Header)) {
+            this->init_index(FIRST_CAPACITY);
+            return;
+        }
+        this->remap();
+        if (memcmp(this->hdr->magic, "RDMICACH", 8) != 0 || this->hdr->version != VERSION) {
+            // unknown or outdated cache, start over
+            this->init_index(FIRST_CAPACITY);
+            if (ftruncate(this->data_fd, 0) != 0)
+                fail("truncate data");
+        }
+    }
+    CompileCache(const CompileCache&) = delete;
+    CompileCache& operator=(const CompileCache&) = delete;
+
+    ~CompileCache() {
+        if (this->hdr)
+            munmap(this->hdr, this->mapped);
+        if (this->index_fd >= 0)
+            close(this->index_fd);
+        if (this->data_fd >= 0)
+            close(this->data_fd);
+    }
+
+    // hash of the policy statements, the tokens as the parser will see them
+    static CacheKey hash_source(const string &src) {
+        CacheKey k;
+        uint64_t a = 0xcbf29ce484222325ull; // FNV-1a
+        uint64_t b = 0x9e3779b97f4a7c15ull;
+        Lexer lexer(src);
+        for (Token tok = lexer.next(); tok.kind != TOK_EOF; tok = lexer.next()) {
+            for (size_t i = 0; i <= tok.text.size(); i++) {
+                unsigned char c = i < tok.text.size() ? tok.text[i] : 0; // 0 ends the token
+                a = (a ^ c) * 0x100000001b3ull;
+                b = (b ^ c) * 0xff51afd7ed558ccdull;
+                b ^= b >> 32;
+            }
+        }
+        k.h[0] = a;
+        k.h[1] = b;
+        return k;
+    }
+
+    // key of one compile: statements plus every base the policy is compiled at and compile options
+    static CacheKey key(const CacheKey &source, const LinkBases &b, int options = 0) {
+        CacheKey k = source;
+        int64_t nums[] = {b.v[REL_QPN], b.v[REL_COEF], b.v[REL_TASK], b.v[REL_BASE], b.v[REL_FAKE], b.v[REL_STACK],
+                          b.v[REL_REG], VERSION, options};
+        for (int64_t n: nums) {
+            for (int i = 0; i < 8; i++) {
+                unsigned char c = (n >> (8 * i)) & 0xff;
+                k.h[0] = (k.h[0] ^ c) * 0x100000001b3ull;
+                k.h[1] = (k.h[1] ^ c) * 0xff51afd7ed558ccdull;
+                k.h[1] ^= k.h[1] >> 32;
+            }
+        }
+        return k;
+    }
+
+    // key of what the policy takes at any bases, no compile is at -1
+    static CacheKey digest(const CacheKey &source, int options = 0) {
+        return key(source, LinkBases(-1, -1, -1, -1, -1, -1, -1), options);
+    }
+
+    // fill entry and the rules, or the object of a relocatable compile, on a hit
+    template <class Image>
+    bool lookup(const CacheKey &key, CacheEntry &entry, Image &image) {
+        auto t0 = chrono::steady_clock::now();
+        bool hit = this->find(key, entry, image);
+        auto t1 = chrono::steady_clock::now();
+        this->lookup_us += chrono::duration_cast<chrono::microseconds>(t1 - t0).count();
+        if (hit) {
+            this->hits++;
+            this->saved_us += entry.compile_us;
+        } else {
+            this->misses++;
+        }
+        return hit;
+    }
+
+    // lookup() without touching the hit counters
+    template <class Image>
+    bool find(const CacheKey &key, CacheEntry &entry, Image &out) {
+        Lock lock(this->index_fd, LOCK_SH);
+        this->sync();
+        Slot *s = this->probe(key);
+        if (!s->used)
+            return false;
+        vector<char> image(s->length);
+        if (pread(this->data_fd, image.data(), s->length, s->offset) != (ssize_t)s->length)
+            return false; // data file cut short, compile again
+        try {
+            parse(image, out);
+        } catch (const runtime_error &) {
+            return false; // corrupt image, compile again
+        }
+        entry = s->entry;
+        return true;
+    }
+
+    // entry under a digest, no image to read
+    bool find(const CacheKey &key, CacheEntry &entry) {
+        Lock lock(this->index_fd, LOCK_SH);
+        this->sync();
+        Slot *s = this->probe(key);
+        if (!s->used)
+            return false;
+        entry = s->entry;
+        return true;
+    }
+
+    template <class Image>
+    void insert(const CacheKey &key, const CacheEntry &entry, const Image &in) {
+        BufferSink image;
+        serialize(in, image);
+        this->put(key, entry, image.str());
+    }
+
+    // entry under a digest
+    void insert(const CacheKey &key, const CacheEntry &entry) {
+        this->put(key, entry, string());
+    }
+
+    uint32_t size() { return this->hdr->count; }
+};
+
+
+#endif // _COMPILE_CACHE_H
@@ -0,0 +1,200 @@
+#ifndef _BUDGET_H
+#define _BUDGET_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#include "rule_ir.h"
+
+using namespace std;
+
+#ifndef throw_error
+#define throw_error(msg) throw std::runtime_error(string(__FILE__)+":"+std::to_string(__LINE__)+" --> "+msg);
+#endif
+
+// slots of one register of the master pipeline the rules index
+struct RegisterUse {
+    int size = 0;     // instance_count in master.p4
+    int slots = 0;    // distinct slots indexed
+    int highest = -1; // largest slot indexed
+};
+
+// entries of one table of the master pipeline
+struct TableUse {
+    int size = 0;
+    int entries = 0;
+};
+
+struct ResourceUsage {
+    map<string, RegisterUse> registers;
+    map<string, TableUse> tables;
+
+    // one line per register and per table with entries, as in gencode/utilization
+    string report() const {
+        string s;
+        char line[160];
+        for (const auto &r: this->registers) {
+            if (!r.second.slots) {
+                s += "register " + r.first + ": unused of " + to_string(r.second.size) + " slots\n";
+                continue;
+            }
+            snprintf(line, sizeof(line), "register %s: %d of %d slots, up to slot %d, %.1f%%\n", r.first.c_str(),
+                r.second.slots, r.second.size, r.second.highest, 100.0 * (r.second.highest + 1) / r.second.size);
+            s += line;
+        }
+        for (const auto &t: this->tables) {
+            if (!t.second.entries)
+                continue;
+            snprintf(line, sizeof(line), "table %s: %d of %d entries, %.1f%%\n", t.first.c_str(),
+                t.second.entries, t.second.size, 100.0 * t.second.entries / t.second.size);
+            s += line;
+        }
+        return s;
+    }
+};
+
+/**
+ * Static resource budget of the rules of one compile against the register
+ * and table sizes of switch/master/master.p4.
+ *
+ * A stateful action indexes its register with the state or idx param of
+ * its rule, the timestamp and toggle actions always with slot 0. Past the
+ * instance_count of the register the index wraps on the switch and the
+ * policy reads the state of another one. Slots are handed out per policy
+ * (PSN by QPN state, the stack of process_addr_h/l and the iter registers
+ * of max_entry by task, the page walk registers by task number), so two
+ * policies indexing the same slot alias each other too. Either fails the
+ * compile with one line per violation. Registers the setup scripts fill,
+ * like rkey, are not indexed by the generated rules.
+ *
+ * Tables are counted in entries over every policy, against their size.
+ */
+class ResourceBudget {
+private:
+    struct RegisterIndex {
+        const char *reg;
+        const char *param; // index param of the rule, nullptr for slot 0
+    };
+
+    static const map<string, int>& register_sizes() {
+        static const map<string, int> sizes = {
+            {"psn", 500}, {"psn_def", 500}, {"process_addr_h", 450}, {"process_addr_l", 450},
+            {"max_entry", 200}, {"dqpn_page_walk", 30}, {"qpn_page_walk", 30},
+            {"process_page_addr_h", 30}, {"process_page_addr_l", 30}, {"ts_start", 500}, {"toggle_start", 1},
+        };
+        return sizes;
+    }
+
+    // register each table's actions index
+    static const unordered_map<string, RegisterIndex>& register_tables() {
+        static const unordered_map<string, RegisterIndex> tables = {
+            {"read_update_psn_tab", {"psn", "state"}},
+            {"read_update_psn_def_tab", {"psn_def", "state"}},
+            {"cache_process_addr_to_reg_h_tab", {"process_addr_h", "state"}},
+            {"cache_process_addr_to_reg_l_tab", {"process_addr_l", "state"}},
+            {"read_update_max_entry_tab", {"max_entry", "idx"}},
+            {"cache_dqpn_page_walk_tab", {"dqpn_page_walk", "idx"}},
+            {"cache_qpn_page_walk_tab", {"qpn_page_walk", "idx"}},
+            {"cache_process_page_addr_to_reg_h_tab", {"process_page_addr_h", "idx"}},
+            {"cache_process_page_addr_to_reg_l_tab", {"process_page_addr_l", "idx"}},
+            {"read_update_ts_start_tab", {"ts_start", nullptr}},
+            {"read_update_toggle_start_tab", {"toggle_start", nullptr}},
+        };
+        return tables;
+    }
+
+    static const unordered_map<string, int>& table_sizes() {
+        static const unordered_map<string, int> sizes = {
+            {"add_offset_1_tab", 1024}, {"add_offset_2_tab", 1024}, {"add_offset_3_tab", 1024},
+            {"addr_translation_page_offset_tab", 1024}, {"cache_dqpn_page_walk_tab", 1024},
+            {"cache_len_into_md_tab", 1024}, {"cache_process_addr_to_reg_h_tab", 1024},
+            {"cache_process_addr_to_reg_l_tab", 1024}, {"cache_process_page_addr_to_reg_h_tab", 1024},
+            {"cache_process_page_addr_to_reg_l_tab", 1024}, {"cache_qpn_page_walk_tab", 1024},
+            {"cache_size_into_md_tab", 1024}, {"check_null_tab", 1024}, {"check_traverse_end_tab", 1024},
+            {"cloning_tab", 1024}, {"direct_transfer_tab", 1024}, {"encode_mod_offset_pre_tab", 1024},
+            {"encode_mod_offset_tab", 1024}, {"end_of_fetching_tab", 20}, {"end_transfer_tab", 1024},
+            {"exact_match_tab", 1024}, {"gen_mali_alarm_tab", 1024}, {"gen_range_digest_tab", 1024},
+            {"make_up_addr_tab", 1024}, {"mark_vmalloc_bit_p1_tab", 1024}, {"mark_vmalloc_bit_p2_tab", 1024},
+            {"mark_walking_bit_tab", 1024}, {"mask_base_addr_tab", 1024}, {"mod_field_parameters_pre_tab", 1024},
+            {"mod_field_parameters_tab", 1024}, {"move_transfer_tab", 1024}, {"pgt_transfer_tab", 1024},
+            {"range_match_tab", 1024}, {"read_update_max_entry_tab", 1024}, {"read_update_psn_def_tab", 1024},
+            {"read_update_psn_tab", 1024}, {"read_update_toggle_start_tab", 1024},
+            {"read_update_ts_start_tab", 1024}, {"update_cnt_tab", 1024},
+        };
+        return sizes;
+    }
+
+    static int64_t index_of(const RuleSet &rules, int r, const char *param) {
+        for (int f = rules.keys_end(r); f < rules.params_end(r); f++)
+            if (rules.syms.name(rules.field_name[f]) == param && rules.field_fmt[f] != FMT_SYM)
+                return rules.field_value[f];
+        throw_error(string("no number ") + param + " in a rule of " + rules.syms.name(rules.table[r]));
+    }
+
+    static string where(int policy, const RuleSet &rules, int r) {
+        return "policy " + to_string(policy) + " (" + rules.syms.name(rules.table[r]) + " " +
+            rules.syms.name(rules.action[r]) + ", rule " + to_string(r) + ")";
+    }
+
+public:
+    // usage of the rules of every policy, policies[i] being the rules of policy i
+    static void check(const vector<const RuleSet*> &policies, ResourceUsage &usage) {
+        usage = ResourceUsage();
+        for (const auto &s: register_sizes())
+            usage.registers[s.first].size = s.second;
+
+        vector<string> errors;
+        map<pair<string, int64_t>, int> owner; // policy that took each slot, past the shared slot 0 registers
+        for (int i = 0; i < (int)policies.size(); i++) {
+            const RuleSet &rules = *policies[i];
+            for (int r = 0; r < rules.size(); r++) {
+                const string &tab = rules.syms.name(rules.table[r]);
+                auto size = table_sizes().find(tab);
+                if (size == table_sizes().end()) {
+                    errors.push_back("table " + tab + " is not in the master pipeline, " + where(i, rules, r));
+                    continue;
+                }
+                TableUse &tu = usage.tables[tab];
+                tu.size = size->second;
+                tu.entries++;
+
+                auto idx = register_tables().find(tab);
+                if (idx == register_tables().end())
+                    continue;
+                const string reg = idx->second.reg;
+                RegisterUse &ru = usage.registers[reg];
+                int64_t slot = idx->second.param ? index_of(rules, r, idx->second.param) : 0;
+                auto taken = owner.emplace(make_pair(reg, slot), i);
+                if (taken.second) { // each slot is reported once, at the first rule indexing it
+                    ru.slots++;
+                    if (slot < 0 || slot >= ru.size)
+                        errors.push_back("register " + reg + ": slot " + to_string(slot) + " is out of its " +
+                            to_string(ru.size) + " slots, " + where(i, rules, r));
+                } else if (taken.first->second != i && idx->second.param) {
+                    errors.push_back("register " + reg + ": slot " + to_string(slot) + " of policy " +
+                        to_string(taken.first->second) + " is also indexed by " + where(i, rules, r));
+                    taken.first->second = i;
+                }
+                if (slot > ru.highest)
+                    ru.highest = slot;
+            }
+        }
+        for (const auto &t: usage.tables)
+            if (t.second.entries > t.second.size)
+                errors.push_back("table " + t.first + ": " + to_string(t.second.entries) + " entries, " +
+                    to_string(t.second.size) + " fit");
+
+        if (!errors.empty()) {
+            string msg = "over the resource budget of the master pipeline:";
+            for (const string &e: errors)
+                msg += "\n  " + e;
+            throw runtime_error(msg);
+        }
+    }
+};
+
+
+#endif // _BUDGET_H
@@ -0,0 +1,175 @@
+#ifndef _PAYLOAD_H
+#define _PAYLOAD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "rule_ir.h"
+
+using namespace std;
+
+#ifndef throw_error
+#define throw_error(msg) throw std::runtime_error(string(__FILE__)+":"+std::to_string(__LINE__)+" --> "+msg);
+#endif
+
+/**
+ * Fields of .values that are read with one wide RDMA READ. The response
+ * payload of the read to dqpn carries every such field, the collector
+ * splits them out at the listed bytes.
+ *
+ * Reads are 16 or 32 bytes, the payloads parse_ib_aeth and
+ * remove_payload_tab take besides 8. A window stays inside one
+ * PAYLOAD_ALIGN block of the object the fields belong to: with objects
+ * aligned that much (slab caches with SLAB_HWCACHE_ALIGN, kmalloc sizes
+ * from 64 on) it never crosses a page, so the physical base of the
+ * access covers the whole read.
+ */
+static const int PAYLOAD_ALIGN = 64;
+static const int PAYLOAD_FIELD_SIZE = 8; // what a field read on its own takes
+static const int PAYLOAD_MAX = 32;        // largest payload the parser extracts
+
+struct PayloadField {
+    int dqpn;   // QPN state of the wide read
+    int pos;    // position of the base in the object, as cur_pos
+    int offset; // of the field from the base
+    int at;     // first byte of the field in the response payload
+    int len;    // of the wide read
+};
+
+struct PayloadLayout {
+    vector<PayloadField> fields;
+    int reads = 0; // wide reads, each replacing one read per field
+
+    void add(const PayloadLayout &o) {
+        this->fields.insert(this->fields.end(), o.fields.begin(), o.fields.end());
+        this->reads += o.reads;
+    }
+    // round trips saved per pass over the policy
+    int saved() const { return (int)this->fields.size() - this->reads; }
+    // the same reads issued from QPN states delta further on, as a relinked policy does
+    PayloadLayout moved(int delta) const {
+        PayloadLayout m = *this;
+        for (PayloadField &f: m.fields)
+            f.dqpn += delta;
+        return m;
+    }
+};
+
+/**
+ * Field windows of one .values, in issue order. Merged, the fields are
+ * sorted by offset and packed greedily into reads of at most 32 bytes that
+ * stay inside an aligned block of the object, otherwise every field is a
+ * window of its own in statement order. Offsets are relative to the
+ * object, a window of one field is a plain 8 byte read. width[w] is the
+ * read length and start[w] its first byte.
+ */
+struct PayloadWindows {
+    vector<vector<int> > fields; // indices into the offsets given to pack()
+    vector<int> start;
+    vector<int> width;
+
+    void pack(const vector<int> &offsets, bool merge) {
+        vector<int> order(offsets.size());
+        for (int i = 0; i < (int)order.size(); i++)
+            order[i] = i;
+        if (merge)
+            stable_sort(order.begin(), order.end(), [&](int a, int b) { return offsets[a] < offsets[b]; });
+        for (int i = 0; i < (int)order.size(); ) {
+            int first = offsets[order[i]];
+            int block_end = (first / PAYLOAD_ALIGN + 1) * PAYLOAD_ALIGN;
+            int j = i + 1;
+            while (merge && first >= 0 && j < (int)order.size() && offsets[order[j]] + PAYLOAD_FIELD_SIZE - first <= PAYLOAD_MAX &&
+                   offsets[order[j]] + PAYLOAD_FIELD_SIZE <= block_end)
+                j++;
+            int span = offsets[order[j - 1]] + PAYLOAD_FIELD_SIZE - first;
+            int width = j - i == 1 ? PAYLOAD_FIELD_SIZE : span <= 16 ? 16 : PAYLOAD_MAX;
+            int start = min(first, block_end - width);
+            this->fields.push_back(vector<int>(order.begin() + i, order.begin() + j));
+            this->start.push_back(start);
+            this->width.push_back(width);
+            i = j;
+        }
+    }
+    int size() const { return this->fields.size(); }
+};
+
+/**
+ * Byte accurate model of the wide reads, run on the generated rules.
+ *
+ * Every wide read is replayed on a synthetic memory image, for objects at
+ * every PAYLOAD_ALIGN aligned address around a page boundary: the address
+ * and length come from the encode_mod_offset_tab and
+ * mod_field_parameters_tab entries of its dqpn, as the switch would build
+ * the RETH. Each field cut out of the payload must be the 8 bytes a read
+ * of that field on its own returns, the read may not cross the page and
+ * its length must be one the parser extracts.
+ */
+class PayloadModel {
+private:
+    static const int PAGE = 4096;
+
+    struct Read {
+        int64_t offset;
+        int64_t len;
+    };
+
+    static uint8_t byte_at(int64_t addr) {
+        uint64_t x = addr * 0x9e3779b97f4a7c15ull;
+        return x >> 56;
+    }
+
+    static int64_t field_value(const RuleSet &rules, int r, const char *name, bool keys) {
+        int begin = keys ? rules.keys_begin(r) : rules.keys_end(r);
+        int end = keys ? rules.keys_end(r) : rules.params_end(r);
+        for (int f = begin; f < end; f++)
+            if (rules.syms.name(rules.field_name[f]) == name)
+                return rules.field_value[f];
+        throw_error(string("no field ") + name + " in an offset rule");
+    }
+
+public:
+    static void verify(const RuleSet &rules, const PayloadLayout &layout) {
+        int enc = rules.syms.find("encode_mod_offset_tab");
+        int mod = rules.syms.find("mod_field_parameters_tab");
+        int sub = rules.syms.find("mod_field_parameters_subtract");
+        unordered_map<int, vector<Read> > reads; // by dqpn
+        for (int r = 0; r + 1 < rules.size(); r++) {
+            if (enc == -1 || rules.table[r] != enc || rules.table[r + 1] != mod)
+                continue;
+            Read rd;
+            rd.offset = field_value(rules, r, "offset", false);
+            if (rules.action[r + 1] == sub)
+                rd.offset = -rd.offset;
+            rd.len = field_value(rules, r + 1, "len", false);
+            reads[field_value(rules, r, "ib_bth_dqpn", true)].push_back(rd);
+        }
+
+        for (const PayloadField &pf: layout.fields) {
+            string where = "field " + to_string(pf.pos + pf.offset) + " read by " + to_string(pf.dqpn);
+            auto it = reads.find(pf.dqpn);
+            if (it == reads.end())
+                throw_error(where + ": no read issued");
+            for (const Read &rd: it->second) {
+                if (rd.len != 8 && rd.len != 16 && rd.len != 32)
+                    throw_error(where + ": payload of " + to_string(rd.len) + " bytes is not parsed");
+                for (int64_t object = PAGE - 2 * PAYLOAD_ALIGN * 8; object <= PAGE; object += PAYLOAD_ALIGN) {
+                    int64_t base = object + pf.pos;
+                    int64_t addr = base + rd.offset;
+                    if (addr / PAGE != (addr + rd.len - 1) / PAGE)
+                        throw_error(where + ": read crosses a page for an object at " + to_string(object));
+                    if (pf.at < 0 || pf.at + PAYLOAD_FIELD_SIZE > rd.len)
+                        throw_error(where + ": not inside the payload");
+                    for (int b = 0; b < PAYLOAD_FIELD_SIZE; b++)
+                        if (byte_at(addr + pf.at + b) != byte_at(base + pf.offset + b))
+                            throw_error(where + ": byte " + to_string(b) + " differs from a read of its own");
+                }
+            }
+        }
+    }
+};
+
+
+#endif // _PAYLOAD_H
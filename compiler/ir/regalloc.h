@@ -0,0 +1,97 @@
+#ifndef _REGALLOC_H
+#define _REGALLOC_H
+
+#include <string>
+
+#include "relocation.h"
+
+using namespace std;
+
+#ifndef throw_error
+#define throw_error(msg) throw std::runtime_error(string(__FILE__)+":"+std::to_string(__LINE__)+" --> "+msg);
+#endif
+
+/**
+ * Per-task resources a policy takes a contiguous run of:
+ *
+ *   RF_FAKE   fake states, md.qpn values below every QPN state and image
+ *   RF_STACK  slots of the address stack, process_addr_h/l
+ *   RF_REG    iter registers, max_entry
+ */
+enum RegFile {
+    RF_FAKE,
+    RF_STACK,
+    RF_REG,
+    RF_NUM
+};
+
+static const char *const REG_FILE_NAMES[RF_NUM] = {"fake states", "stack slots", "iter registers"};
+static const int TASK_STRIDE[RF_NUM] = {20, 15, 3}; // fixed partition of each task
+static const int REG_FILE_SIZE[RF_NUM] = {0, 450, 200}; // fake states depend on the QPNs, see RegisterAllocator()
+
+struct RegFileUse {
+    int capacity = 0;
+    int used = 0; // slots handed out
+    int end = 0;  // one past the highest slot handed out
+};
+
+/**
+ * Hands each policy, in install order, the bases of its fake states,
+ * address stack and iter registers.
+ *
+ * Every policy may run at any time, so the slots of two policies always
+ * interfere; within a policy the loops nest, so all its slots are live at
+ * once. The interference graph is complete and a coloring is a packing of
+ * the runs: packed, each run starts where the previous one ended and takes
+ * what the footprint of the policy says. Strided, task t starts at
+ * TASK_STRIDE * t as the generators did before, and a policy needing more
+ * than a stride is rejected instead of running into the next task.
+ * Either way a run past the end of its file is an error, unless
+ * unchecked.
+ */
+class RegisterAllocator {
+private:
+    bool packed;
+    bool checked;
+    RegFileUse files[RF_NUM];
+
+public:
+    // fake states stay below qpn_s and qpn_r, and below the end states of num policies
+    RegisterAllocator(int qpn_s, int qpn_r, int num, bool packed, bool checked = true) : packed(packed), checked(checked) {
+        for (int f = 0; f < RF_NUM; f++)
+            this->files[f].capacity = REG_FILE_SIZE[f];
+        this->files[RF_FAKE].capacity = fake_capacity(qpn_s, qpn_r, num);
+    }
+
+    static int fake_capacity(int qpn_s, int qpn_r, int num) {
+        return min(min(qpn_s, qpn_r), 999 - num);
+    }
+
+    // bases the policy installed next, as task, gets into b; they do not depend on what it needs
+    void peek(int task, LinkBases &b) const {
+        for (int f = 0; f < RF_NUM; f++) // RF_* in the order of REL_FAKE, REL_STACK, REL_REG
+            b.v[REL_FAKE + f] = this->packed ? this->files[f].end : TASK_STRIDE[f] * task;
+    }
+
+    // hand the policy installed next need[f] slots of each file, their bases into b
+    void alloc(int task, const int need[RF_NUM], LinkBases &b) {
+        this->peek(task, b);
+        for (int f = 0; f < RF_NUM; f++) {
+            RegFileUse &file = this->files[f];
+            int base = b.v[REL_FAKE + f];
+            if (this->checked && !this->packed && need[f] > TASK_STRIDE[f])
+                throw_error("policy " + to_string(task) + " needs " + to_string(need[f]) + " " + REG_FILE_NAMES[f] +
+                    ", a task has " + to_string(TASK_STRIDE[f]) + " without packing");
+            if (this->checked && base + need[f] > file.capacity)
+                throw_error("policy " + to_string(task) + " needs " + REG_FILE_NAMES[f] + " " + to_string(base) +
+                    " to " + to_string(base + need[f] - 1) + ", there are " + to_string(file.capacity));
+            file.used += need[f];
+            file.end = max(file.end, base + need[f]);
+        }
+    }
+
+    const RegFileUse& use(int f) const { return this->files[f]; }
+};
+
+
+#endif // _REGALLOC_H
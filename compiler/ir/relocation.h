@@ -0,0 +1,185 @@
+#ifndef _RELOCATION_H
+#define _RELOCATION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "payload.h"
+#include "rule_ir.h"
+#include "serializer.h"
+#include "../utils/rule_sink.h"
+
+using namespace std;
+
+/**
+ * A compiled policy in position independent form: its rules with every
+ * base at 0 and the relocations that put concrete bases back in. Linking
+ * copies the rules and patches the relocated fields, no parsing or codegen
+ * involved.
+ *
+ * The relocations are the fields the generators marked as they emitted
+ * the rules, see RuleSet::key_qpn() and RuleSet::rel(), so making an
+ * object takes no compile of its own.
+ *
+ * Object file (.rel), little endian:
+ *
+ *   "RDMIRELO" u32 version
+ *   i32 qpns, i32 fake_states, i32 stack, i32 regs
+ *   u32 nrelocs, nrelocs x (u32 field, u8 sym, i32 scale)
+ *   u32 reads, u32 nfields, nfields x (i32 dqpn, i32 pos, i32 offset, i32 at, i32 len)
+ *   rule image (BinarySerializer) up to the end
+ *
+ * The wide reads keep their dqpn from the first QPN state of the policy,
+ * so they move with REL_QPN like the rules do.
+ */
+class RelocatableRules {
+private:
+    static const uint32_t VERSION = 3;
+
+    // name of the table and field of field f, for errors
+    static string field_desc(const RuleSet &rules, int f) {
+        int r = upper_bound(rules.field_begin.begin(), rules.field_begin.end(), (uint32_t)f) -
+            rules.field_begin.begin() - 1;
+        return rules.syms.name(rules.table[r]) + " rule " + to_string(r) + " field " +
+            rules.syms.name(rules.field_name[f]);
+    }
+
+public:
+    RuleSet rules;         // values with every base at 0
+    vector<Reloc> relocs;  // ordered by field
+    int qpns = 0;          // footprint of the policy, the linker lays the QPN states out with it
+    int fake_states = 0;   // and the slots it takes of the other register files
+    int stack = 0;
+    int regs = 0;
+    PayloadLayout payload; // wide reads, dqpn from the first QPN state of the policy on
+
+    RelocatableRules(){};
+
+    /**
+     * Take the rules compiled at bases at, with the fields that move
+     * with the bases marked, and put every base back to 0.
+     */
+    void take(const RuleSet &at_rules, const LinkBases &at) {
+        this->rules = at_rules;
+        this->rules.relocs.clear();
+        this->relocs = at_rules.relocs;
+        stable_sort(this->relocs.begin(), this->relocs.end(), [](const Reloc &x, const Reloc &y) {
+            return x.field != y.field ? x.field < y.field : x.sym < y.sym;
+        });
+        for (const Reloc &r: this->relocs)
+            this->rules.field_value[r.field] -= r.scale * at.v[r.sym];
+    }
+
+    // rules at bases b; hex fields must still fit their digits
+    void link(const LinkBases &b, RuleSet &out) const {
+        out = this->rules;
+        for (const Reloc &r: this->relocs) {
+            int64_t &v = out.field_value[r.field];
+            v += r.scale * b.v[r.sym];
+            int w = out.field_width[r.field];
+            if (out.field_fmt[r.field] == FMT_HEX && w < 16 && (uint64_t)v >> (4 * w) != 0)
+                throw_error("relocated value overflows " + field_desc(out, r.field));
+        }
+    }
+
+    void write(RuleSink &out) const {
+        out.write("RDMIRELO", 8);
+        BinarySerializer::put<uint32_t>(out, VERSION);
+        BinarySerializer::put<int32_t>(out, this->qpns);
+        BinarySerializer::put<int32_t>(out, this->fake_states);
+        BinarySerializer::put<int32_t>(out, this->stack);
+        BinarySerializer::put<int32_t>(out, this->regs);
+        BinarySerializer::put<uint32_t>(out, this->relocs.size());
+        for (const Reloc &r: this->relocs) {
+            BinarySerializer::put<uint32_t>(out, r.field);
+            BinarySerializer::put<uint8_t>(out, r.sym);
+            BinarySerializer::put<int32_t>(out, r.scale);
+        }
+        BinarySerializer::put<uint32_t>(out, this->payload.reads);
+        BinarySerializer::put<uint32_t>(out, this->payload.fields.size());
+        for (const PayloadField &f: this->payload.fields) {
+            BinarySerializer::put<int32_t>(out, f.dqpn);
+            BinarySerializer::put<int32_t>(out, f.pos);
+            BinarySerializer::put<int32_t>(out, f.offset);
+            BinarySerializer::put<int32_t>(out, f.at);
+            BinarySerializer::put<int32_t>(out, f.len);
+        }
+        BinarySerializer().write(this->rules, out);
+    }
+
+    void read(const char *p, size_t n) {
+        const char *end = p + n;
+        if (n < 8 || memcmp(p, "RDMIRELO", 8) != 0)
+            throw_error("not a relocatable policy");
+        p += 8;
+        if (BinarySerializer::get<uint32_t>(p, end) != VERSION)
+            throw_error("unsupported relocatable policy version");
+        this->qpns = BinarySerializer::get<int32_t>(p, end);
+        this->fake_states = BinarySerializer::get<int32_t>(p, end);
+        this->stack = BinarySerializer::get<int32_t>(p, end);
+        this->regs = BinarySerializer::get<int32_t>(p, end);
+        uint32_t nrelocs = BinarySerializer::get<uint32_t>(p, end);
+        this->relocs.clear();
+        for (uint32_t i = 0; i < nrelocs; i++) {
+            Reloc r;
+            r.field = BinarySerializer::get<uint32_t>(p, end);
+            r.sym = BinarySerializer::get<uint8_t>(p, end);
+            r.scale = BinarySerializer::get<int32_t>(p, end);
+            this->relocs.push_back(r);
+        }
+        this->payload = PayloadLayout();
+        this->payload.reads = BinarySerializer::get<uint32_t>(p, end);
+        uint32_t nfields = BinarySerializer::get<uint32_t>(p, end);
+        for (uint32_t i = 0; i < nfields; i++) {
+            PayloadField f;
+            f.dqpn = BinarySerializer::get<int32_t>(p, end);
+            f.pos = BinarySerializer::get<int32_t>(p, end);
+            f.offset = BinarySerializer::get<int32_t>(p, end);
+            f.at = BinarySerializer::get<int32_t>(p, end);
+            f.len = BinarySerializer::get<int32_t>(p, end);
+            if (f.dqpn < 0 || f.dqpn >= this->qpns || f.len <= 0 || f.len > PAYLOAD_MAX || f.at < 0 || f.at >= f.len)
+                throw_error("corrupt wide read field " + to_string(i));
+            this->payload.fields.push_back(f);
+        }
+        if (this->payload.reads < 0 || this->payload.reads > (int)this->payload.fields.size())
+            throw_error("corrupt wide read count");
+        BinarySerializer::read(p, end - p, this->rules);
+        for (const Reloc &r: this->relocs)
+            if (r.field >= (uint32_t)this->rules.num_fields() || this->rules.field_fmt[r.field] == FMT_SYM ||
+                r.sym >= REL_NUM_SYMS)
+                throw_error("corrupt relocation");
+    }
+};
+
+/**
+ * Host the address relocations are patched for. The slide is relative to
+ * the kernel addresses the policies were written with; cr3 defaults to
+ * the page table root gen_add_offset_1_tab() emits.
+ */
+struct HostLayout {
+    int64_t slide = 0;
+    uint64_t cr3 = 0x1dacc0a000ull;
+};
+
+/**
+ * Recompute every address field of rules for host. Each field is rebuilt
+ * from its symbol and offset, so patching again for another host needs
+ * no undo. Hex fields grow when the new value needs more digits.
+ */
+inline void patch_addresses(RuleSet &rules, const HostLayout &host) {
+    for (const AddrReloc &r: rules.addr_relocs) {
+        uint64_t addr = (r.sym == ADDR_KERNEL ? (uint64_t)host.slide : host.cr3) + r.offset;
+        uint64_t mask = r.bits >= 64 ? ~0ull : (1ull << r.bits) - 1;
+        int64_t v = (int64_t)(addr >> r.shift & mask) + r.addend;
+        rules.field_value[r.field] = v;
+        if (rules.field_fmt[r.field] == FMT_HEX)
+            while (rules.field_width[r.field] < 16 && (uint64_t)v >> (4 * rules.field_width[r.field]) != 0)
+                rules.field_width[r.field]++;
+    }
+}
+
+
+#endif // _RELOCATION_H
@@ -0,0 +1,297 @@
+#ifndef _RULE_DIFF_H
+#define _RULE_DIFF_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "rule_ir.h"
+#include "serializer.h"
+#include "../utils/rule_sink.h"
+
+using namespace std;
+
+/**
+ * Switch commands that turn the installed rules into a new compile.
+ * Rules are the same entry when table, match keys and priority are the
+ * same; the entry changes when its action or params differ. A rule whose
+ * priority changed is another entry, added in step 2 before the old one
+ * is deleted in step 3.
+ *
+ * The commands run in three steps so that a state machine is never half
+ * wired:
+ *
+ *   1. add the rules of QPN states nothing installed matches yet, they
+ *      are unreachable until step 2
+ *   2. rewire the installed states: changed entries are modified in
+ *      place, so that no packet finds the entry missing, new entries of
+ *      installed states are added
+ *   3. delete the entries that are gone, nothing leads to them any more
+ */
+struct RuleDelta {
+    vector<int> add_unreached;        // rules of next
+    vector<pair<int, int> > rewire;   // (installed rule to modify or -1 to add, rule of next)
+    vector<int> remove;               // installed rules
+    int kept = 0;                     // entries left as they are
+
+    struct TableCount {
+        int adds = 0;
+        int modifies = 0;
+        int deletes = 0;
+        int kept = 0;
+    };
+    map<string, TableCount> tables;
+
+    int adds() const {
+        int n = this->add_unreached.size();
+        for (const pair<int, int> &p: this->rewire)
+            n += p.first < 0;
+        return n;
+    }
+    int modifies() const {
+        int n = 0;
+        for (const pair<int, int> &p: this->rewire)
+            n += p.first >= 0;
+        return n;
+    }
+    int deletes() const { return this->remove.size(); }
+};
+
+class RuleDiff {
+private:
+    // rule r of a rule set as seen by the diff
+    struct Entry {
+        uint64_t match;  // hash of table, keys and priority
+        uint64_t action; // hash of action and params
+        int rule;
+    };
+
+    static uint64_t mix(uint64_t h, uint64_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h * 0xff51afd7ed558ccdull;
+    }
+
+    static vector<uint64_t> hash_symbols(const RuleSet &rules) {
+        vector<uint64_t> h(rules.syms.size());
+        for (int i = 0; i < rules.syms.size(); i++) {
+            uint64_t x = 0xcbf29ce484222325ull; // FNV-1a
+            for (char c: rules.syms.name(i))
+                x = (x ^ (unsigned char)c) * 0x100000001b3ull;
+            h[i] = x;
+        }
+        return h;
+    }
+
+    // field values compare by number, symbols by name; the hex width does not matter to the switch
+    static uint64_t hash_fields(const RuleSet &rules, const vector<uint64_t> &sh, int begin, int end, uint64_t h) {
+        for (int f = begin; f < end; f++) {
+            h = mix(h, sh[rules.field_name[f]]);
+            h = mix(h, rules.field_fmt[f] == FMT_SYM ? sh[rules.field_value[f]] : (uint64_t)rules.field_value[f]);
+        }
+        return h;
+    }
+
+    // fields compare by name and value, next's symbol ids mapped to installed's by sym
+    static bool same_fields(const RuleSet &a, int fa, const RuleSet &b, int fb, int n, const vector<int> &sym) {
+        for (int i = 0; i < n; i++, fa++, fb++) {
+            if (a.field_name[fa] != sym[b.field_name[fb]])
+                return false;
+            if ((a.field_fmt[fa] == FMT_SYM) != (b.field_fmt[fb] == FMT_SYM))
+                return false;
+            if (a.field_fmt[fa] == FMT_SYM ? a.field_value[fa] != sym[b.field_value[fb]]
+                    : a.field_value[fa] != b.field_value[fb])
+                return false;
+        }
+        return true;
+    }
+
+    static bool same_match(const RuleSet &a, int ra, const RuleSet &b, int rb, const vector<int> &sym) {
+        return a.priority[ra] == b.priority[rb] && a.num_keys[ra] == b.num_keys[rb] &&
+            a.table[ra] == sym[b.table[rb]] &&
+            same_fields(a, a.keys_begin(ra), b, b.keys_begin(rb), a.num_keys[ra], sym);
+    }
+
+    static bool same_action(const RuleSet &a, int ra, const RuleSet &b, int rb, const vector<int> &sym) {
+        int na = a.params_end(ra) - a.keys_end(ra);
+        return na == b.params_end(rb) - b.keys_end(rb) && a.action[ra] == sym[b.action[rb]] &&
+            same_fields(a, a.keys_end(ra), b, b.keys_end(rb), na, sym);
+    }
+
+    // ids of the symbols of b in a, -1 (equal to nothing in a) for those a does not have
+    static vector<int> map_symbols(const RuleSet &a, const RuleSet &b) {
+        unordered_map<string, int> ids;
+        for (int i = 0; i < a.syms.size(); i++)
+            ids.emplace(a.syms.name(i), i);
+        vector<int> sym(b.syms.size(), -1);
+        for (int i = 0; i < b.syms.size(); i++) {
+            auto it = ids.find(b.syms.name(i));
+            if (it != ids.end())
+                sym[i] = it->second;
+        }
+        return sym;
+    }
+
+    static vector<Entry> entries(const RuleSet &rules) {
+        vector<uint64_t> sh = hash_symbols(rules);
+        vector<Entry> e(rules.size());
+        for (int r = 0; r < rules.size(); r++) {
+            uint64_t m = mix(sh[rules.table[r]], (uint64_t)(int64_t)rules.priority[r]);
+            e[r].match = hash_fields(rules, sh, rules.keys_begin(r), rules.keys_end(r), m);
+            e[r].action = hash_fields(rules, sh, rules.keys_end(r), rules.params_end(r), sh[rules.action[r]]);
+            e[r].rule = r;
+        }
+        sort(e.begin(), e.end(), [](const Entry &x, const Entry &y) {
+            return x.match != y.match ? x.match < y.match : x.rule < y.rule;
+        });
+        return e;
+    }
+
+    // [i, end) of the entries with the match hash of e[i]
+    static size_t run_end(const vector<Entry> &e, size_t i) {
+        size_t j = i + 1;
+        while (j < e.size() && e[j].match == e[i].match)
+            j++;
+        return j;
+    }
+
+    static void check_unique(const RuleSet &rules, const vector<Entry> &e, size_t i, size_t end) {
+        if (end - i < 2)
+            return;
+        vector<int> same(rules.syms.size());
+        for (int k = 0; k < (int)same.size(); k++)
+            same[k] = k;
+        for (size_t a = i; a < end; a++)
+            for (size_t b = a + 1; b < end; b++)
+                if (same_match(rules, e[a].rule, rules, e[b].rule, same))
+                    throw_error("rules " + to_string(e[a].rule) + " and " + to_string(e[b].rule) + " of " +
+                        rules.syms.name(rules.table[e[a].rule]) + " match the same packets");
+    }
+
+public:
+    // QPN state rule r belongs to, -1 if it matches on neither md_qpn nor ib_bth_dqpn
+    static int64_t state_of(const RuleSet &rules, int r) {
+        for (int f = rules.keys_begin(r); f < rules.keys_end(r); f++) {
+            const string &name = rules.syms.name(rules.field_name[f]);
+            if ((name == "md_qpn" || name == "ib_bth_dqpn") && rules.field_fmt[f] != FMT_SYM)
+                return rules.field_value[f];
+        }
+        return -1;
+    }
+
+    /**
+     * Sort both sides by match hash and walk them together, O(n log n)
+     * in the number of rules. Rules with the same hash are compared field
+     * by field, so hash collisions cost time but never a wrong delta.
+     */
+    static void diff(const RuleSet &installed, const RuleSet &next, RuleDelta &d) {
+        d = RuleDelta();
+        vector<Entry> a = entries(installed);
+        vector<Entry> b = entries(next);
+        vector<int> sym = map_symbols(installed, next);
+        vector<int> added;      // rules of next, unmatched
+        vector<char> matched_a(installed.size(), 0);
+        vector<RuleDelta::TableCount> next_count(next.syms.size()), installed_count(installed.syms.size());
+
+        size_t i = 0, j = 0;
+        while (i < a.size() || j < b.size()) {
+            if (j == b.size() || (i < a.size() && a[i].match < b[j].match)) {
+                size_t ie = run_end(a, i);
+                check_unique(installed, a, i, ie);
+                i = ie;
+                continue;
+            }
+            if (i == a.size() || b[j].match < a[i].match) {
+                size_t je = run_end(b, j);
+                check_unique(next, b, j, je);
+                for (; j < je; j++)
+                    added.push_back(b[j].rule);
+                continue;
+            }
+            size_t ie = run_end(a, i), je = run_end(b, j);
+            check_unique(installed, a, i, ie);
+            check_unique(next, b, j, je);
+            for (; j < je; j++) {
+                size_t k = i;
+                while (k < ie && (matched_a[a[k].rule] || !same_match(installed, a[k].rule, next, b[j].rule, sym)))
+                    k++;
+                if (k == ie) {
+                    added.push_back(b[j].rule);
+                    continue;
+                }
+                matched_a[a[k].rule] = 1;
+                RuleDelta::TableCount &count = next_count[next.table[b[j].rule]];
+                if (a[k].action == b[j].action && same_action(installed, a[k].rule, next, b[j].rule, sym)) {
+                    d.kept++;
+                    count.kept++;
+                } else {
+                    d.rewire.push_back(make_pair(a[k].rule, b[j].rule));
+                    count.modifies++;
+                }
+            }
+            i = ie;
+        }
+
+        unordered_set<int64_t> states;
+        for (int r = 0; r < installed.size(); r++)
+            states.insert(state_of(installed, r));
+        sort(added.begin(), added.end());
+        for (int r: added) {
+            next_count[next.table[r]].adds++;
+            int64_t s = state_of(next, r);
+            if (s != -1 && !states.count(s))
+                d.add_unreached.push_back(r);
+            else
+                d.rewire.push_back(make_pair(-1, r));
+        }
+        sort(d.rewire.begin(), d.rewire.end(), [](const pair<int, int> &x, const pair<int, int> &y) {
+            return x.second < y.second;
+        });
+        for (int r = 0; r < installed.size(); r++) {
+            if (matched_a[r])
+                continue;
+            d.remove.push_back(r);
+            installed_count[installed.table[r]].deletes++;
+        }
+
+        // per table, by name
+        for (int t = 0; t < (int)next_count.size(); t++) {
+            const RuleDelta::TableCount &c = next_count[t];
+            if (c.adds || c.modifies || c.kept) {
+                RuleDelta::TableCount &to = d.tables[next.syms.name(t)];
+                to.adds += c.adds;
+                to.modifies += c.modifies;
+                to.kept += c.kept;
+            }
+        }
+        for (int t = 0; t < (int)installed_count.size(); t++)
+            if (installed_count[t].deletes)
+                d.tables[installed.syms.name(t)].deletes += installed_count[t].deletes;
+    }
+
+    // bfshell script of the delta, steps separated by an empty line
+    static void write_script(const RuleSet &installed, const RuleSet &next, const RuleDelta &d, RuleSink &out) {
+        BfshellSerializer bfshell;
+        out << "pd-master\n";
+        for (int r: d.add_unreached)
+            bfshell.write_rule(next, r, out);
+        out << '\n';
+        for (const pair<int, int> &p: d.rewire) {
+            if (p.first >= 0)
+                bfshell.write_modify(next, p.second, out);
+            else
+                bfshell.write_rule(next, p.second, out);
+        }
+        out << '\n';
+        for (int r: d.remove)
+            bfshell.write_delete(installed, r, out);
+        out << "exit\n";
+    }
+};
+
+
+#endif // _RULE_DIFF_H
@@ -0,0 +1,504 @@
+#ifndef _RULE_IR_H
+#define _RULE_IR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+#ifndef throw_error
+#define throw_error(msg) throw std::runtime_error(string(__FILE__)+":"+std::to_string(__LINE__)+" --> "+msg);
+#endif
+
+/**
+ * Interned names of the rule IR: tables, actions, fields and symbolic
+ * values. Ids are dense and start from 0 in order of first use.
+ *
+ * Copies share the names until one of them interns a new one, and build
+ * their lookup maps on the first intern(): linked rule sets are copied
+ * far more often than extended.
+ */
+class SymbolTable {
+private:
+    shared_ptr<vector<string> > names = make_shared<vector<string> >();
+    unordered_map<string, int> ids;
+    unordered_map<const char*, int> literals; // string literals, looked up by address
+
+    void reindex() {
+        this->ids.clear();
+        for (int i = 0; i < (int)this->names->size(); i++)
+            this->ids.emplace((*this->names)[i], i);
+    }
+
+public:
+    SymbolTable(){};
+    SymbolTable(const SymbolTable &o) : names(o.names) {}
+    SymbolTable(SymbolTable &&o) {
+        *this = move(o);
+    }
+    SymbolTable& operator=(const SymbolTable &o) {
+        this->names = o.names;
+        this->ids.clear();
+        this->literals.clear();
+        return *this;
+    }
+    // leaves o empty
+    SymbolTable& operator=(SymbolTable &&o) {
+        this->names.swap(o.names);
+        this->ids.swap(o.ids);
+        this->literals.swap(o.literals);
+        o.names = make_shared<vector<string> >();
+        o.ids.clear();
+        o.literals.clear();
+        return *this;
+    }
+
+    int intern(const string &s) {
+        if (this->ids.size() != this->names->size())
+            this->reindex();
+        auto it = this->ids.find(s);
+        if (it != this->ids.end())
+            return it->second;
+        if (this->names.use_count() > 1)
+            this->names = make_shared<vector<string> >(*this->names);
+        int id = this->names->size();
+        this->names->push_back(s);
+        this->ids.emplace(s, id);
+        return id;
+    }
+    // s must outlive the table, meant for the string literals of the generators
+    int intern_literal(const char *s) {
+        auto it = this->literals.find(s);
+        if (it != this->literals.end())
+            return it->second;
+        int id = this->intern(s);
+        this->literals.emplace(s, id);
+        return id;
+    }
+    int find(const string &s) const {
+        if (this->ids.size() != this->names->size()) {
+            for (int i = 0; i < (int)this->names->size(); i++)
+                if ((*this->names)[i] == s)
+                    return i;
+            return -1;
+        }
+        auto it = this->ids.find(s);
+        return it == this->ids.end() ? -1 : it->second;
+    }
+    const string& name(int id) const { return (*this->names)[id]; }
+    int size() const { return this->names->size(); }
+};
+
+/**
+ * How a field value is rendered. Values keep the exact spelling of the
+ * generated rule, so the serializers can reproduce it byte for byte.
+ */
+enum ValueFmt : uint8_t {
+    FMT_DEC, // signed decimal
+    FMT_HEX, // 0x followed by `width` lower case hex digits
+    FMT_SYM  // anything else, value is a symbol id
+};
+
+/**
+ * Where a relocated address field comes from. The rule keeps the value
+ * of the compile, patch_addresses() recomputes it for another host.
+ */
+enum AddrSym : uint8_t {
+    ADDR_KERNEL, // kernel image VA, moves with the KASLR slide
+    ADDR_CR3     // page table root the walks start from
+};
+
+// field value = ((sym + offset) >> shift & (2^bits - 1)) + addend
+struct AddrReloc {
+    uint32_t field;
+    uint8_t sym;
+    uint8_t shift;
+    uint8_t bits;
+    int32_t addend;
+    uint64_t offset;
+};
+
+/**
+ * Bases a compiled policy depends on. Every value the generators emit is
+ * an addend plus a multiple of some of them:
+ *
+ *   REL_QPN   first QPN state of the policy (its avail_state)
+ *   REL_COEF  QPN_TRAN offset, qpn_r - qpn_s of the install
+ *   REL_TASK  install position: end states 998 - task and 999 - task, the
+ *             slot of the page walk registers
+ *   REL_BASE  first QPN state of the whole install
+ *   REL_FAKE  first fake state of the policy
+ *   REL_STACK first slot of its address stack in process_addr_h/l
+ *   REL_REG   first of its iter registers in max_entry
+ *
+ * The last three come from a RegisterAllocator. The generators mark the
+ * fields that depend on them as they emit the rules.
+ */
+enum RelocSym : uint8_t {
+    REL_QPN,
+    REL_COEF,
+    REL_TASK,
+    REL_BASE,
+    REL_FAKE,
+    REL_STACK,
+    REL_REG,
+    REL_NUM_SYMS
+};
+
+struct LinkBases {
+    int64_t v[REL_NUM_SYMS];
+
+    LinkBases(int64_t qpn = 0, int64_t coef = 0, int64_t task = 0, int64_t base = 0, int64_t fake = 0,
+              int64_t stack = 0, int64_t reg = 0) : v{qpn, coef, task, base, fake, stack, reg} {}
+};
+
+// field value += scale * base[sym]
+struct Reloc {
+    uint32_t field;
+    uint8_t sym;
+    int32_t scale;
+};
+
+/**
+ * States of the policy the rules are generated for, which tell the base a
+ * QPN field moves with: states in [first, end) with REL_QPN, the same plus
+ * coef (QPN_TRAN) with REL_COEF too, fake states in [fake_first, fake_end)
+ * with REL_FAKE, the end states 998 - task and 999 - task with REL_TASK.
+ * Fields are only marked while on.
+ */
+struct RelocSpace {
+    bool on = false;
+    int first = 0, end = 0;
+    int coef = 0;
+    int fake_first = 0, fake_end = 0;
+    int task = 0;
+};
+
+/**
+ * Typed switch rules of one compile, in struct-of-arrays form.
+ *
+ * Rule r is "add <action> to <table>", matching on the keys and passing
+ * the params of its fields [field_begin[r], field_begin[r + 1]): the
+ * first num_keys[r] are match keys, the rest are action params. Priority
+ * is -1 for exact match tables. Rules are grouped into named sections,
+ * one per codegen pass.
+ *
+ * Generators build rules with the chained builder:
+ *
+ *   rules.add("end_transfer_tab", "mod_qpn_dqpn")
+ *       .key("ib_aeth_valid", 1).key("md_qpn", qpn)
+ *       .param("qpn", p_qpn).param("dqpn", dqpn);
+ *
+ * and mark the fields of the last rule that hold host dependent
+ * addresses with kaslr() and cr3(), as symbol plus offset relocations.
+ * Fields that move with the install layout are marked as they are
+ * emitted: QPN states with key_qpn(), key_dqpn(), param_qpn() and
+ * param_dqpn() against reloc_space, register slots with rel().
+ */
+class RuleSet {
+public:
+    SymbolTable syms;
+
+    // per rule
+    vector<int> table;
+    vector<int> action;
+    vector<int> priority;
+    vector<uint16_t> num_keys;
+    vector<uint32_t> field_begin{0};
+
+    // per field
+    vector<int> field_name;
+    vector<uint8_t> field_fmt;
+    vector<uint8_t> field_width;
+    vector<int64_t> field_value;
+
+    // per section
+    vector<int> section_name;
+    vector<uint32_t> section_begin;
+
+    // address fields, in the order they were marked
+    vector<AddrReloc> addr_relocs;
+
+    // fields that move with the bases, in the order they were marked
+    vector<Reloc> relocs;
+
+    // what the marks are taken against, see Policy::set_relocatable()
+    RelocSpace reloc_space;
+
+private:
+    bool in_params = false;
+
+    void push_field(const char *name, ValueFmt fmt, int width, int64_t value) {
+        this->field_name.push_back(this->syms.intern_literal(name));
+        this->field_fmt.push_back(fmt);
+        this->field_width.push_back(width);
+        this->field_value.push_back(value);
+        this->field_begin.back()++;
+    }
+
+    static bool is_hex_digits(const string &s) {
+        if (s.empty() || s.size() > 16)
+            return false;
+        for (char c: s)
+            if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+                return false;
+        return true;
+    }
+
+    static bool is_dec(const string &s) {
+        size_t i = s.size() > 1 && s[0] == '-' ? 1 : 0;
+        if (s.size() == i || s.size() - i > 18 || (s[i] == '0' && s.size() - i > 1))
+            return false;
+        for (; i < s.size(); i++)
+            if (s[i] < '0' || s[i] > '9')
+                return false;
+        return true;
+    }
+
+    // field name of the last rule
+    int last_field(const char *name) {
+        for (int f = this->field_begin[this->size() - 1]; f < this->num_fields(); f++)
+            if (this->syms.name(this->field_name[f]) == name)
+                return f;
+        throw_error(string("no field ") + name + " in the last rule");
+    }
+
+    void mark_addr(const char *name, AddrSym sym, uint64_t offset, int shift, int bits, int addend) {
+        AddrReloc r;
+        r.field = this->last_field(name);
+        if (this->field_fmt[r.field] == FMT_SYM)
+            throw_error(string("address field ") + name + " is not a number");
+        r.sym = sym;
+        r.shift = shift;
+        r.bits = bits;
+        r.addend = addend;
+        r.offset = offset;
+        this->addr_relocs.push_back(r);
+    }
+
+    void mark_rel(int f, RelocSym sym, int scale) {
+        Reloc r;
+        r.field = f;
+        r.sym = sym;
+        r.scale = scale;
+        this->relocs.push_back(r);
+    }
+
+    /**
+     * The QPN state of the last field is one of reloc_space, mark the bases
+     * it moves with. A dqpn is never a fake state, 0 stands for none.
+     */
+    void mark_qpn(const char *name, bool dqpn) {
+        const RelocSpace &q = this->reloc_space;
+        if (!q.on)
+            return;
+        int f = this->num_fields() - 1;
+        int64_t v = this->field_value[f];
+        bool own = v >= q.first && v < q.end;
+        bool tran = v - q.coef >= q.first && v - q.coef < q.end;
+        bool fake = !dqpn && v >= q.fake_first && v < q.fake_end;
+        bool end = v == 998 - q.task || v == 999 - q.task;
+        if (dqpn && v == 0 && own + tran + end == 0)
+            return;
+        if (own + tran + fake + end != 1)
+            throw_error(string("QPN field ") + name + " " + to_string(v) +
+                (own + tran + fake + end ? " is more than one kind of state" : " is no state of the policy"));
+        if (own || tran)
+            this->mark_rel(f, REL_QPN, 1);
+        if (tran)
+            this->mark_rel(f, REL_COEF, 1);
+        if (fake)
+            this->mark_rel(f, REL_FAKE, 1);
+        if (end)
+            this->mark_rel(f, REL_TASK, -1);
+    }
+
+    void check_key(const char *name) {
+        if (this->in_params)
+            throw_error(string("match key ") + name + " after action params");
+    }
+
+    RuleSet& field(const char *name, const string &v) {
+        if (is_dec(v))
+            this->push_field(name, FMT_DEC, 0, stoll(v));
+        else
+            this->push_field(name, FMT_SYM, 0, this->syms.intern(v));
+        return *this;
+    }
+
+    RuleSet& field_hex(const char *name, const string &digits) {
+        if (is_hex_digits(digits))
+            this->push_field(name, FMT_HEX, digits.size(), (int64_t)stoull(digits, nullptr, 16));
+        else
+            this->push_field(name, FMT_SYM, 0, this->syms.intern("0x" + digits));
+        return *this;
+    }
+
+public:
+    RuleSet(){};
+
+    // start a new section, the following rules belong to it
+    void begin_section(const char *name) {
+        this->section_name.push_back(this->syms.intern_literal(name));
+        this->section_begin.push_back(this->size());
+    }
+
+    // start a new rule, followed by its keys, priority and params
+    RuleSet& add(const char *tab, const char *act) {
+        if (this->section_begin.empty())
+            this->begin_section("main");
+        this->table.push_back(this->syms.intern_literal(tab));
+        this->action.push_back(this->syms.intern_literal(act));
+        this->priority.push_back(-1);
+        this->num_keys.push_back(0);
+        this->field_begin.push_back(this->field_begin.back());
+        this->in_params = false;
+        return *this;
+    }
+
+    RuleSet& key(const char *name, int v) {
+        this->check_key(name);
+        this->push_field(name, FMT_DEC, 0, v);
+        this->num_keys.back()++;
+        return *this;
+    }
+    RuleSet& key(const char *name, const string &v) {
+        this->check_key(name);
+        this->field(name, v);
+        this->num_keys.back()++;
+        return *this;
+    }
+    // hex key given as its digits, without the 0x prefix
+    RuleSet& key_hex(const char *name, const string &digits) {
+        this->check_key(name);
+        this->field_hex(name, digits);
+        this->num_keys.back()++;
+        return *this;
+    }
+
+    // match key holding a state of the policy, as md.qpn
+    RuleSet& key_qpn(const char *name, int v) {
+        this->key(name, v);
+        this->mark_qpn(name, false);
+        return *this;
+    }
+    // match key holding a state of the policy a read goes to, as ib_bth.dqpn
+    RuleSet& key_dqpn(const char *name, int v) {
+        this->key(name, v);
+        this->mark_qpn(name, true);
+        return *this;
+    }
+
+    RuleSet& prio(int p) {
+        this->priority.back() = p;
+        return *this;
+    }
+
+    RuleSet& param(const char *name, int v) {
+        this->in_params = true;
+        this->push_field(name, FMT_DEC, 0, v);
+        return *this;
+    }
+    RuleSet& param(const char *name, const string &v) {
+        this->in_params = true;
+        return this->field(name, v);
+    }
+    RuleSet& param_hex(const char *name, const string &digits) {
+        this->in_params = true;
+        return this->field_hex(name, digits);
+    }
+    // action params holding a state of the policy, see key_qpn() and key_dqpn()
+    RuleSet& param_qpn(const char *name, int v) {
+        this->param(name, v);
+        this->mark_qpn(name, false);
+        return *this;
+    }
+    RuleSet& param_dqpn(const char *name, int v) {
+        this->param(name, v);
+        this->mark_qpn(name, true);
+        return *this;
+    }
+
+    // field name of the last rule moves by scale times base sym
+    RuleSet& rel(const char *name, RelocSym sym, int scale = 1) {
+        if (this->reloc_space.on)
+            this->mark_rel(this->last_field(name), sym, scale);
+        return *this;
+    }
+
+    /**
+     * Field name of the last rule holds bits [shift, shift + bits) of the
+     * kernel address addr, plus addend. Only addresses in the kernel image
+     * mapping move with KASLR, any other addr (NULL ends) is left as is.
+     */
+    RuleSet& kaslr(const char *name, uint64_t addr, int shift, int bits, int addend = 0) {
+        if (addr >= 0xffffffff80000000ull && addr < 0xffffffffc0000000ull)
+            this->mark_addr(name, ADDR_KERNEL, addr, shift, bits, addend);
+        return *this;
+    }
+    // field name of the last rule holds bits [shift, shift + bits) of the page table root
+    RuleSet& cr3(const char *name, int shift, int bits) {
+        this->mark_addr(name, ADDR_CR3, 0, shift, bits, 0);
+        return *this;
+    }
+
+    int size() const { return this->table.size(); }
+    int num_fields() const { return this->field_name.size(); }
+    int num_sections() const { return this->section_begin.size(); }
+
+    // rules of section s are [section_first(s), section_end(s))
+    int section_first(int s) const { return this->section_begin[s]; }
+    int section_end(int s) const {
+        return s + 1 < this->num_sections() ? this->section_begin[s + 1] : this->size();
+    }
+
+    // fields of rule r: keys in [keys_begin(r), keys_end(r)), params up to params_end(r)
+    int keys_begin(int r) const { return this->field_begin[r]; }
+    int keys_end(int r) const { return this->field_begin[r] + this->num_keys[r]; }
+    int params_end(int r) const { return this->field_begin[r + 1]; }
+
+    // append the rules and sections of o, relocations included
+    void append(const RuleSet &o) {
+        vector<int> sym(o.syms.size());
+        for (int i = 0; i < o.syms.size(); i++)
+            sym[i] = this->syms.intern(o.syms.name(i));
+        int first_rule = this->size();
+        int first_field = this->num_fields();
+        for (int s = 0; s < o.num_sections(); s++) {
+            this->section_name.push_back(sym[o.section_name[s]]);
+            this->section_begin.push_back(first_rule + o.section_begin[s]);
+        }
+        for (int r = 0; r < o.size(); r++) {
+            this->table.push_back(sym[o.table[r]]);
+            this->action.push_back(sym[o.action[r]]);
+            this->priority.push_back(o.priority[r]);
+            this->num_keys.push_back(o.num_keys[r]);
+            this->field_begin.push_back(first_field + o.field_begin[r + 1]);
+        }
+        for (int f = 0; f < o.num_fields(); f++) {
+            this->field_name.push_back(sym[o.field_name[f]]);
+            this->field_fmt.push_back(o.field_fmt[f]);
+            this->field_width.push_back(o.field_width[f]);
+            this->field_value.push_back(o.field_fmt[f] == FMT_SYM ? sym[o.field_value[f]] : o.field_value[f]);
+        }
+        for (AddrReloc r: o.addr_relocs) {
+            r.field += first_field;
+            this->addr_relocs.push_back(r);
+        }
+        for (Reloc r: o.relocs) {
+            r.field += first_field;
+            this->relocs.push_back(r);
+        }
+    }
+
+    void clear() {
+        *this = RuleSet();
+    }
+};
+
+
+#endif // _RULE_IR_H
@@ -0,0 +1,529 @@
+#ifndef _RULE_OPT_H
+#define _RULE_OPT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "rule_ir.h"
+
+using namespace std;
+
+// what RuleMinimizer::minimize() did to the rules of one or more compiles
+struct MinimizeStats {
+    struct TableCount {
+        int before = 0;
+        int after = 0;
+    };
+    map<string, TableCount> tables;
+    int duplicates = 0;        // identical entries dropped
+    int merged = 0;            // entries folded into a ternary or range neighbour
+    vector<string> conflicts;  // entries matching the same packets with different actions
+
+    void add(const MinimizeStats &o) {
+        for (const auto &t: o.tables) {
+            this->tables[t.first].before += t.second.before;
+            this->tables[t.first].after += t.second.after;
+        }
+        this->duplicates += o.duplicates;
+        this->merged += o.merged;
+        this->conflicts.insert(this->conflicts.end(), o.conflicts.begin(), o.conflicts.end());
+    }
+    int before() const {
+        int n = 0;
+        for (const auto &t: this->tables)
+            n += t.second.before;
+        return n;
+    }
+    int after() const {
+        int n = 0;
+        for (const auto &t: this->tables)
+            n += t.second.after;
+        return n;
+    }
+};
+
+/**
+ * Table entry minimization over the generated rules, in three steps:
+ *
+ *   1. drop entries identical to an earlier one (table, action, keys,
+ *      priority, params and address relocations)
+ *   2. report entries of a table that match the same packets with another
+ *      action or params; both are kept, the switch rejects the second
+ *   3. merge entries that only differ in one ternary or range key into a
+ *      single entry matching the union of both
+ *
+ * Key kinds come from the spelling bfshell needs: key X followed by
+ * X_mask is ternary, X_start followed by X_end is a range, anything else
+ * is exact and never merged. Two ternary entries merge when their values
+ * differ in one bit under the same mask, that bit becomes don't care; two
+ * range entries merge when their ranges overlap or touch. Keys holding
+ * relocated addresses are not merged, a patch may move them apart.
+ *
+ * Kept entries stay in generation order, in their section.
+ */
+class RuleMinimizer {
+private:
+    RuleSet &rules;
+    vector<int> reloc_of;  // per field, its address relocation or -1
+    vector<char> dropped;  // per rule
+    MinimizeStats &stats;
+
+    RuleMinimizer(RuleSet &rules, MinimizeStats &stats) : rules(rules), reloc_of(rules.num_fields(), -1),
+        dropped(rules.size(), 0), stats(stats) {
+        for (int i = 0; i < (int)rules.addr_relocs.size(); i++)
+            this->reloc_of[rules.addr_relocs[i].field] = i;
+    }
+
+    static uint64_t mix(uint64_t h, uint64_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h * 0xff51afd7ed558ccdull;
+    }
+
+    bool is_num(int f) const {
+        return this->rules.field_fmt[f] != FMT_SYM && this->reloc_of[f] < 0;
+    }
+
+    // fields f and g give the switch the same value, dec and hex alike
+    bool same_field(int f, int g) const {
+        const RuleSet &R = this->rules;
+        if (R.field_name[f] != R.field_name[g] || R.field_value[f] != R.field_value[g] ||
+                (R.field_fmt[f] == FMT_SYM) != (R.field_fmt[g] == FMT_SYM))
+            return false;
+        int a = this->reloc_of[f], b = this->reloc_of[g];
+        if (a < 0 || b < 0)
+            return a == b;
+        const AddrReloc &x = R.addr_relocs[a], &y = R.addr_relocs[b];
+        return x.sym == y.sym && x.shift == y.shift && x.bits == y.bits && x.addend == y.addend &&
+            x.offset == y.offset;
+    }
+
+    /**
+     * Rules r and s are the same but for the values of keys skip_a and
+     * skip_b (indices among the keys, -1 for none). With match_only, the
+     * action and params are not compared.
+     */
+    bool same_rule(int r, int s, int skip_a = -1, int skip_b = -1, bool match_only = false) const {
+        const RuleSet &R = this->rules;
+        if (R.table[r] != R.table[s] || R.priority[r] != R.priority[s] || R.num_keys[r] != R.num_keys[s])
+            return false;
+        int n = R.num_keys[r];
+        if (!match_only) {
+            if (R.action[r] != R.action[s] || R.params_end(r) - R.keys_begin(r) != R.params_end(s) - R.keys_begin(s))
+                return false;
+            n = R.params_end(r) - R.keys_begin(r);
+        }
+        for (int i = 0; i < n; i++) {
+            int f = R.keys_begin(r) + i, g = R.keys_begin(s) + i;
+            if (i == skip_a || i == skip_b) {
+                if (R.field_name[f] != R.field_name[g])
+                    return false;
+            } else if (!this->same_field(f, g)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t hash_rule(int r, int skip_a = -1, int skip_b = -1, bool match_only = false) const {
+        const RuleSet &R = this->rules;
+        uint64_t h = mix(mix(R.table[r], (uint64_t)(int64_t)R.priority[r]), R.num_keys[r]);
+        int end = match_only ? R.keys_end(r) : R.params_end(r);
+        if (!match_only)
+            h = mix(h, R.action[r]);
+        for (int f = R.keys_begin(r); f < end; f++) {
+            int i = f - R.keys_begin(r);
+            h = mix(h, R.field_name[f]);
+            if (i != skip_a && i != skip_b)
+                h = mix(h, R.field_fmt[f] == FMT_SYM ? ~(uint64_t)R.field_value[f] : (uint64_t)R.field_value[f]);
+        }
+        return h;
+    }
+
+    /**
+     * Live rules that pass has_key(r), split into groups of rules that are
+     * the same but for keys skip_a and skip_b: sort by hash, then split
+     * each run of equal hashes by comparing with its first rules.
+     */
+    template <class Fn>
+    vector<vector<int> > groups(Fn has_key, int skip_a, int skip_b, bool match_only) const {
+        vector<pair<uint64_t, int> > order;
+        for (int r = 0; r < this->rules.size(); r++)
+            if (!this->dropped[r] && has_key(r))
+                order.push_back(make_pair(this->hash_rule(r, skip_a, skip_b, match_only), r));
+        sort(order.begin(), order.end());
+        vector<vector<int> > out;
+        for (size_t i = 0; i < order.size(); ) {
+            size_t end = i + 1;
+            while (end < order.size() && order[end].first == order[i].first)
+                end++;
+            size_t first = out.size();
+            for (size_t j = i; j < end; j++) {
+                int r = order[j].second;
+                size_t g = first;
+                while (g < out.size() && !this->same_rule(out[g][0], r, skip_a, skip_b, match_only))
+                    g++;
+                if (g == out.size())
+                    out.push_back(vector<int>());
+                out[g].push_back(r);
+            }
+            i = end;
+        }
+        return out;
+    }
+
+    void drop_duplicates() {
+        for (const vector<int> &g: this->groups([](int) { return true; }, -1, -1, false)) {
+            for (size_t i = 1; i < g.size(); i++) {
+                this->dropped[g[i]] = 1;
+                this->stats.duplicates++;
+            }
+        }
+    }
+
+    void find_conflicts() {
+        for (const vector<int> &g: this->groups([](int) { return true; }, -1, -1, true)) {
+            for (size_t i = 1; i < g.size(); i++)
+                this->stats.conflicts.push_back(this->rules.syms.name(this->rules.table[g[0]]) + ": rules " +
+                    to_string(g[0]) + " and " + to_string(g[i]) + " match the same packets");
+        }
+    }
+
+    // key i of rule r is the start of a range, followed by its end
+    bool is_range(int r, int i) const {
+        const RuleSet &R = this->rules;
+        if (i + 1 >= R.num_keys[r])
+            return false;
+        int f = R.keys_begin(r) + i;
+        const string &start = R.syms.name(R.field_name[f]);
+        const string &end = R.syms.name(R.field_name[f + 1]);
+        return start.size() > 6 && start.compare(start.size() - 6, 6, "_start") == 0 &&
+            end.size() == start.size() - 2 && start.compare(0, start.size() - 6, end, 0, end.size() - 4) == 0 &&
+            end.compare(end.size() - 4, 4, "_end") == 0 && this->is_num(f) && this->is_num(f + 1);
+    }
+
+    // key i of rule r is a ternary value, followed by its mask
+    bool is_ternary(int r, int i) const {
+        const RuleSet &R = this->rules;
+        if (i + 1 >= R.num_keys[r])
+            return false;
+        int f = R.keys_begin(r) + i;
+        const string &value = R.syms.name(R.field_name[f]);
+        const string &mask = R.syms.name(R.field_name[f + 1]);
+        return mask.size() == value.size() + 5 && mask.compare(0, value.size(), value) == 0 &&
+            mask.compare(value.size(), 5, "_mask") == 0 && this->is_num(f) && this->is_num(f + 1);
+    }
+
+    // sweep each group by range start, folding ranges that overlap or touch the one before
+    bool merge_ranges(int i) {
+        bool changed = false;
+        const RuleSet &R = this->rules;
+        auto has_key = [&](int r) { return this->is_range(r, i); };
+        for (vector<int> &g: this->groups(has_key, i, i + 1, false)) {
+            if (g.size() < 2)
+                continue;
+            sort(g.begin(), g.end(), [&](int a, int b) {
+                int64_t x = R.field_value[R.keys_begin(a) + i], y = R.field_value[R.keys_begin(b) + i];
+                return x != y ? x < y : a < b;
+            });
+            int keep = g[0];
+            for (size_t j = 1; j < g.size(); j++) {
+                int r = g[j];
+                int kept_end = R.keys_begin(keep) + i + 1, end = R.keys_begin(r) + i + 1;
+                if (R.field_value[end - 1] > R.field_value[kept_end] + 1) {
+                    keep = r;
+                    continue;
+                }
+                if (R.field_value[end] > R.field_value[kept_end]) {
+                    this->rules.field_value[kept_end] = R.field_value[end];
+                    this->rules.field_fmt[kept_end] = R.field_fmt[end];
+                    this->rules.field_width[kept_end] = R.field_width[end];
+                }
+                this->dropped[r] = 1;
+                this->stats.merged++;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // fold pairs whose values differ in one bit under the same mask, that bit becomes don't care
+    bool merge_ternary(int i) {
+        bool changed = false;
+        const RuleSet &R = this->rules;
+        auto has_key = [&](int r) { return this->is_ternary(r, i); };
+        for (const vector<int> &g: this->groups(has_key, i, -1, false)) {
+            if (g.size() < 2)
+                continue;
+            unordered_map<int64_t, int> by_value;
+            for (int r: g) {
+                int f = R.keys_begin(r) + i;
+                if (!by_value.emplace(R.field_value[f] & R.field_value[f + 1], r).second) {
+                    this->dropped[r] = 1; // differs only in don't care bits
+                    this->stats.duplicates++;
+                    changed = true;
+                }
+            }
+            for (int r: g) {
+                if (this->dropped[r])
+                    continue;
+                int f = R.keys_begin(r) + i;
+                int64_t mask = R.field_value[f + 1], value = R.field_value[f] & mask;
+                for (int b = 0; b < 64; b++) {
+                    int64_t bit = (int64_t)1 << b;
+                    if (!(mask & bit))
+                        continue;
+                    auto it = by_value.find(value ^ bit);
+                    if (it == by_value.end() || it->second == r || this->dropped[it->second])
+                        continue;
+                    this->dropped[it->second] = 1;
+                    by_value.erase(it);
+                    by_value.erase(value);
+                    this->rules.field_value[f] = value & ~bit;
+                    this->rules.field_value[f + 1] = mask & ~bit;
+                    this->stats.merged++;
+                    changed = true;
+                    break; // r has a new mask now, it is in another group
+                }
+            }
+        }
+        return changed;
+    }
+
+    // rebuild rules without the dropped ones
+    void compact() {
+        const RuleSet &R = this->rules;
+        RuleSet out;
+        out.syms = R.syms;
+        vector<int> field_to(R.num_fields(), -1);
+        for (int s = 0; s < R.num_sections(); s++) {
+            out.section_name.push_back(R.section_name[s]);
+            out.section_begin.push_back(out.size());
+            for (int r = R.section_first(s); r < R.section_end(s); r++) {
+                if (this->dropped[r])
+                    continue;
+                out.table.push_back(R.table[r]);
+                out.action.push_back(R.action[r]);
+                out.priority.push_back(R.priority[r]);
+                out.num_keys.push_back(R.num_keys[r]);
+                for (int f = R.keys_begin(r); f < R.params_end(r); f++) {
+                    field_to[f] = out.num_fields();
+                    out.field_name.push_back(R.field_name[f]);
+                    out.field_fmt.push_back(R.field_fmt[f]);
+                    out.field_width.push_back(R.field_width[f]);
+                    out.field_value.push_back(R.field_value[f]);
+                }
+                out.field_begin.push_back(out.num_fields());
+            }
+        }
+        for (AddrReloc a: R.addr_relocs) {
+            if (field_to[a.field] < 0)
+                continue;
+            a.field = field_to[a.field];
+            out.addr_relocs.push_back(a);
+        }
+        this->rules = move(out);
+    }
+
+    void count(bool before) {
+        vector<int> n(this->rules.syms.size(), 0);
+        for (int r = 0; r < this->rules.size(); r++)
+            n[this->rules.table[r]]++;
+        for (int t = 0; t < (int)n.size(); t++) {
+            if (!n[t])
+                continue;
+            MinimizeStats::TableCount &c = this->stats.tables[this->rules.syms.name(t)];
+            (before ? c.before : c.after) += n[t];
+        }
+    }
+
+    void run() {
+        this->count(true);
+        this->drop_duplicates();
+        this->find_conflicts();
+        int max_keys = 0;
+        for (int r = 0; r < this->rules.size(); r++)
+            max_keys = max(max_keys, (int)this->rules.num_keys[r]);
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (int i = 0; i + 1 < max_keys; i++) {
+                changed |= this->merge_ranges(i);
+                changed |= this->merge_ternary(i);
+            }
+        }
+        this->compact();
+        this->count(false);
+    }
+
+public:
+    // minimize rules in place, adding what was done to stats
+    static void minimize(RuleSet &rules, MinimizeStats &stats) {
+        RuleMinimizer(rules, stats).run();
+    }
+};
+
+/**
+ * Lookup model of the switch tables, run on the rules before and after
+ * RuleMinimizer::minimize().
+ *
+ * Entries are bucketed by table, key names and exact key values. Within a
+ * bucket, each entry is probed on each of its ternary and range keys at
+ * the values where it starts or stops matching: a range at its bounds and
+ * one past them, a ternary key at its value and with each bit flipped, the
+ * other keys at the entry's own values. Every probe of an entry of either
+ * rule set must hit entries of the same best (lowest) priority with the
+ * same actions and params in both, or miss in both. Relocated keys are
+ * compared at their value as generated, the minimizer leaves them alone.
+ */
+class MatchModel {
+private:
+    enum KeyKind { KEY_EXACT, KEY_TERNARY, KEY_RANGE };
+
+    struct Entry {
+        int priority;
+        vector<int64_t> a, b; // per match key: value, value and mask, or start and end
+        int result;           // action and params, as an index into results
+    };
+
+    struct Bucket {
+        vector<char> kinds;
+        vector<Entry> entries[2]; // before, after
+    };
+
+    map<string, Bucket> buckets;
+    vector<string> results;
+    unordered_map<string, int> result_of;
+
+    static bool ends_with(const string &s, const char *suffix, size_t n) {
+        return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+    }
+
+    static string value_of(const RuleSet &R, int f) {
+        return R.field_fmt[f] == FMT_SYM ? R.syms.name(R.field_value[f]) : to_string(R.field_value[f]);
+    }
+
+    void add(const RuleSet &R, int side) {
+        vector<string> reloc_of(R.num_fields());
+        for (const AddrReloc &a: R.addr_relocs)
+            reloc_of[a.field] = "@" + to_string(a.sym) + "<<" + to_string(a.shift) + "+" + to_string(a.addend);
+        for (int r = 0; r < R.size(); r++) {
+            string id = R.syms.name(R.table[r]);
+            Entry e;
+            e.priority = R.priority[r];
+            vector<char> kinds;
+            for (int f = R.keys_begin(r); f < R.keys_end(r); f++) {
+                const string &name = R.syms.name(R.field_name[f]);
+                const string next = f + 1 < R.keys_end(r) ? R.syms.name(R.field_name[f + 1]) : "";
+                id += " " + name;
+                if (next == name + "_mask" || (ends_with(name, "_start", 6) && ends_with(next, "_end", 4) &&
+                        name.compare(0, name.size() - 6, next, 0, next.size() - 4) == 0)) {
+                    kinds.push_back(next == name + "_mask" ? KEY_TERNARY : KEY_RANGE);
+                    e.a.push_back(R.field_value[f]);
+                    e.b.push_back(R.field_value[f + 1]);
+                    f++;
+                    continue;
+                }
+                id += "=" + value_of(R, f) + reloc_of[f];
+            }
+            string result = R.syms.name(R.action[r]);
+            for (int f = R.keys_end(r); f < R.params_end(r); f++)
+                result += " " + R.syms.name(R.field_name[f]) + "=" + value_of(R, f) + reloc_of[f];
+            auto it = this->result_of.emplace(result, (int)this->results.size()).first;
+            if (it->second == (int)this->results.size())
+                this->results.push_back(result);
+            e.result = it->second;
+            Bucket &b = this->buckets[id];
+            b.kinds = kinds;
+            b.entries[side].push_back(e);
+        }
+    }
+
+    static bool matches(const Bucket &b, const Entry &e, const vector<int64_t> &probe) {
+        for (size_t k = 0; k < probe.size(); k++) {
+            if (b.kinds[k] == KEY_TERNARY ? ((probe[k] ^ e.a[k]) & e.b[k]) != 0 :
+                    probe[k] < e.a[k] || probe[k] > e.b[k])
+                return false;
+        }
+        return true;
+    }
+
+    // best priority hit by probe, then the actions and params hit at it, sorted; empty on a miss
+    static vector<int> lookup(const Bucket &b, const vector<Entry> &entries, const vector<int64_t> &probe) {
+        vector<int> hit;
+        for (const Entry &e: entries) {
+            if (!matches(b, e, probe))
+                continue;
+            if (!hit.empty() && e.priority < hit[0])
+                hit.clear();
+            if (hit.empty())
+                hit.push_back(e.priority);
+            if (e.priority == hit[0])
+                hit.push_back(e.result);
+        }
+        if (!hit.empty()) {
+            sort(hit.begin() + 1, hit.end());
+            hit.erase(unique(hit.begin() + 1, hit.end()), hit.end());
+        }
+        return hit;
+    }
+
+    string describe(const vector<int> &hit) const {
+        if (hit.empty())
+            return "miss";
+        string s = "priority " + to_string(hit[0]);
+        for (size_t i = 1; i < hit.size(); i++)
+            s += ", " + this->results[hit[i]];
+        return s;
+    }
+
+    // values of key k where e starts or stops matching
+    static vector<int64_t> corners(const Bucket &b, const Entry &e, size_t k) {
+        if (b.kinds[k] == KEY_RANGE)
+            return {e.a[k] - 1, e.a[k], e.b[k], e.b[k] + 1};
+        vector<int64_t> out(1, e.a[k] & e.b[k]);
+        for (int bit = 0; bit < 64; bit++)
+            out.push_back((e.a[k] & e.b[k]) ^ ((int64_t)1 << bit));
+        return out;
+    }
+
+    void check(const string &id, const Bucket &b) const {
+        for (int side = 0; side < 2; side++) {
+            for (const Entry &e: b.entries[side]) {
+                for (size_t k = 0; k < b.kinds.size(); k++) {
+                    vector<int64_t> probe(b.kinds.size());
+                    for (size_t o = 0; o < probe.size(); o++)
+                        probe[o] = b.kinds[o] == KEY_TERNARY ? e.a[o] & e.b[o] : e.a[o];
+                    for (int64_t v: corners(b, e, k)) {
+                        probe[k] = v;
+                        vector<int> before = lookup(b, b.entries[0], probe), after = lookup(b, b.entries[1], probe);
+                        if (before == after)
+                            continue;
+                        string at;
+                        for (int64_t p: probe)
+                            at += " " + to_string(p);
+                        throw runtime_error("minimized entries of " + id + " differ at" + at + ": " +
+                            this->describe(before) + " before, " + this->describe(after) + " after");
+                    }
+                }
+            }
+        }
+    }
+
+public:
+    // throws unless after matches every probed packet as before does
+    static void verify(const RuleSet &before, const RuleSet &after) {
+        MatchModel m;
+        m.add(before, 0);
+        m.add(after, 1);
+        for (const auto &b: m.buckets)
+            m.check(b.first, b.second);
+    }
+};
+
+
+#endif // _RULE_OPT_H
@@ -0,0 +1,368 @@
+#ifndef _RULE_SERIALIZER_H
+#define _RULE_SERIALIZER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "rule_ir.h"
+#include "../utils/rule_sink.h"
+
+using namespace std;
+
+/**
+ * Writes a RuleSet in one install format. The installers pick the
+ * serializer, the generators only ever build the IR.
+ */
+class RuleSerializer {
+public:
+    virtual ~RuleSerializer(){};
+    virtual const char* extension() = 0;
+    virtual void write(const RuleSet &rules, RuleSink &out) = 0;
+
+    // the value of field f spelled as in the bfshell rule
+    static void write_value(const RuleSet &rules, int f, RuleSink &out) {
+        int64_t v = rules.field_value[f];
+        switch (rules.field_fmt[f]) {
+            case FMT_DEC:
+                if (v >= INT32_MIN && v <= INT32_MAX) {
+                    out << (int)v;
+                } else {
+                    out << to_string(v);
+                }
+                break;
+            case FMT_HEX: {
+                static const char digits[] = "0123456789abcdef";
+                char buf[18];
+                int w = rules.field_width[f];
+                buf[0] = '0';
+                buf[1] = 'x';
+                for (int i = w - 1; i >= 0; i--) {
+                    buf[2 + i] = digits[v & 0xf];
+                    v = (int64_t)((uint64_t)v >> 4);
+                }
+                out.write(buf, 2 + w);
+                break;
+            }
+            case FMT_SYM:
+                out << rules.syms.name(v);
+                break;
+        }
+    }
+};
+
+/**
+ * bfshell command file, fed to the switch CLI:
+ *
+ *   pd-master
+ *   pd <table> add_entry <action> <key> <value> ... [priority <p>] action_<param> <value> ...
+ *   exit
+ *
+ * Delta installs also delete entries by their match:
+ *
+ *   pd <table> delete_entry <key> <value> ... [priority <p>]
+ *
+ * Sections are separated by an empty line.
+ */
+class BfshellSerializer : public RuleSerializer {
+public:
+    const char* extension() { return ".cmd"; }
+
+    void write_rule(const RuleSet &rules, int r, RuleSink &out) {
+        this->write_entry(rules, r, "add_entry", out);
+    }
+
+    // the entry with the match of rule r takes its action and params
+    void write_modify(const RuleSet &rules, int r, RuleSink &out) {
+        this->write_entry(rules, r, "modify_entry", out);
+    }
+
+    void write_entry(const RuleSet &rules, int r, const char *command, RuleSink &out) {
+        out << "pd " << rules.syms.name(rules.table[r]) << ' ' << command << ' ' << rules.syms.name(rules.action[r]);
+        for (int f = rules.keys_begin(r); f < rules.keys_end(r); f++) {
+            out << ' ' << rules.syms.name(rules.field_name[f]) << ' ';
+            write_value(rules, f, out);
+        }
+        if (rules.priority[r] >= 0)
+            out << " priority " << rules.priority[r];
+        for (int f = rules.keys_end(r); f < rules.params_end(r); f++) {
+            out << " action_" << rules.syms.name(rules.field_name[f]) << ' ';
+            write_value(rules, f, out);
+        }
+        out << '\n';
+    }
+
+    void write_delete(const RuleSet &rules, int r, RuleSink &out) {
+        out << "pd " << rules.syms.name(rules.table[r]) << " delete_entry";
+        for (int f = rules.keys_begin(r); f < rules.keys_end(r); f++) {
+            out << ' ' << rules.syms.name(rules.field_name[f]) << ' ';
+            write_value(rules, f, out);
+        }
+        if (rules.priority[r] >= 0)
+            out << " priority " << rules.priority[r];
+        out << '\n';
+    }
+
+    void write(const RuleSet &rules, RuleSink &out) {
+        out << "pd-master\n";
+        for (int s = 0; s < rules.num_sections(); s++) {
+            if (s > 0)
+                out << '\n';
+            for (int r = rules.section_first(s); r < rules.section_end(s); r++)
+                this->write_rule(rules, r, out);
+        }
+        out << "exit\n";
+    }
+};
+
+/**
+ * One JSON batch per compile:
+ *
+ *   {"sections": [{"name": "pc_tran", "rules": [
+ *     {"table": "...", "action": "...", "match": {"md_qpn": 301, "md_aeth_addr_h": "0xffff0000"},
+ *      "priority": 10, "params": {"dqpn": 302}}]}]}
+ *
+ * Decimal values are numbers, everything else is a string.
+ */
+class JsonSerializer : public RuleSerializer {
+private:
+    static void write_string(const string &s, RuleSink &out) {
+        out << '"';
+        size_t run = 0; // start of the pending run of plain characters
+        for (size_t i = 0; i < s.size(); i++) {
+            char c = s[i];
+            if (c != '"' && c != '\\' && (unsigned char)c >= 0x20)
+                continue;
+            out.write(s.data() + run, i - run);
+            run = i + 1;
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out << buf;
+            }
+        }
+        out.write(s.data() + run, s.size() - run);
+        out << '"';
+    }
+
+    static void write_fields(const RuleSet &rules, int begin, int end, RuleSink &out) {
+        out << '{';
+        for (int f = begin; f < end; f++) {
+            if (f > begin)
+                out << ", ";
+            write_string(rules.syms.name(rules.field_name[f]), out);
+            out << ": ";
+            if (rules.field_fmt[f] == FMT_DEC) {
+                write_value(rules, f, out);
+            } else if (rules.field_fmt[f] == FMT_SYM) {
+                write_string(rules.syms.name(rules.field_value[f]), out);
+            } else {
+                out << '"';
+                write_value(rules, f, out);
+                out << '"';
+            }
+        }
+        out << '}';
+    }
+
+public:
+    const char* extension() { return ".json"; }
+
+    void write(const RuleSet &rules, RuleSink &out) {
+        out << "{\"sections\": [";
+        for (int s = 0; s < rules.num_sections(); s++) {
+            out << (s ? ",\n" : "\n") << "{\"name\": ";
+            write_string(rules.syms.name(rules.section_name[s]), out);
+            out << ", \"rules\": [";
+            for (int r = rules.section_first(s); r < rules.section_end(s); r++) {
+                out << (r > rules.section_first(s) ? ",\n" : "\n") << "  {\"table\": ";
+                write_string(rules.syms.name(rules.table[r]), out);
+                out << ", \"action\": ";
+                write_string(rules.syms.name(rules.action[r]), out);
+                out << ", \"match\": ";
+                write_fields(rules, rules.keys_begin(r), rules.keys_end(r), out);
+                if (rules.priority[r] >= 0)
+                    out << ", \"priority\": " << rules.priority[r];
+                out << ", \"params\": ";
+                write_fields(rules, rules.keys_end(r), rules.params_end(r), out);
+                out << '}';
+            }
+            out << "]}";
+        }
+        out << "\n]}\n";
+    }
+};
+
+/**
+ * Compact little endian binary image, loaded by the installer without
+ * any text parsing:
+ *
+ *   "RDMIRULE" u32 version
+ *   u32 nsyms,     nsyms x (u32 len, bytes)
+ *   u32 nsections, nsections x (u32 name, u32 first rule)
+ *   u32 nrules,    nrules x (u32 record len, record)
+ *
+ *   u32 naddrs,    naddrs x (u32 field, u8 sym, u8 shift, u8 bits, i32 addend, u64 offset)
+ *
+ *   record := u32 table, u32 action, i32 priority, u16 nkeys, u16 nparams,
+ *             (nkeys + nparams) x (u32 name, u8 fmt, u8 width, i64 value)
+ *
+ * Version 1 images end after the rules and have no address relocations.
+ */
+class BinarySerializer : public RuleSerializer {
+private:
+    static const uint32_t VERSION = 2;
+    static const size_t FIELD_BYTES = 4 + 1 + 1 + 8;
+
+public:
+    // little endian scalars, shared with the images that embed a rule image
+    template <class T>
+    static void put(RuleSink &out, T v) {
+        out.write((const char *)&v, sizeof(v));
+    }
+
+    template <class T>
+    static T get(const char *&p, const char *end) {
+        if ((size_t)(end - p) < sizeof(T))
+            throw_error("truncated rule image");
+        T v;
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+
+    const char* extension() { return ".bin"; }
+
+    void write(const RuleSet &rules, RuleSink &out) {
+        out.write("RDMIRULE", 8);
+        put<uint32_t>(out, VERSION);
+        put<uint32_t>(out, rules.syms.size());
+        for (int i = 0; i < rules.syms.size(); i++) {
+            const string &s = rules.syms.name(i);
+            put<uint32_t>(out, s.size());
+            out << s;
+        }
+        put<uint32_t>(out, rules.num_sections());
+        for (int s = 0; s < rules.num_sections(); s++) {
+            put<uint32_t>(out, rules.section_name[s]);
+            put<uint32_t>(out, rules.section_begin[s]);
+        }
+        put<uint32_t>(out, rules.size());
+        for (int r = 0; r < rules.size(); r++) {
+            int nfields = rules.params_end(r) - rules.keys_begin(r);
+            put<uint32_t>(out, 4 + 4 + 4 + 2 + 2 + nfields * FIELD_BYTES);
+            put<uint32_t>(out, rules.table[r]);
+            put<uint32_t>(out, rules.action[r]);
+            put<int32_t>(out, rules.priority[r]);
+            put<uint16_t>(out, rules.num_keys[r]);
+            put<uint16_t>(out, nfields - rules.num_keys[r]);
+            for (int f = rules.keys_begin(r); f < rules.params_end(r); f++) {
+                put<uint32_t>(out, rules.field_name[f]);
+                put<uint8_t>(out, rules.field_fmt[f]);
+                put<uint8_t>(out, rules.field_width[f]);
+                put<int64_t>(out, rules.field_value[f]);
+            }
+        }
+        put<uint32_t>(out, rules.addr_relocs.size());
+        for (const AddrReloc &r: rules.addr_relocs) {
+            put<uint32_t>(out, r.field);
+            put<uint8_t>(out, r.sym);
+            put<uint8_t>(out, r.shift);
+            put<uint8_t>(out, r.bits);
+            put<int32_t>(out, r.addend);
+            put<uint64_t>(out, r.offset);
+        }
+    }
+
+    static void corrupt(const string &what) {
+        throw_error("corrupt rule image: " + what);
+    }
+
+    // rebuild the IR from an image produced by write(), every id and offset checked against what was read
+    static void read(const char *p, size_t n, RuleSet &rules) {
+        const char *end = p + n;
+        if (n < 8 || memcmp(p, "RDMIRULE", 8) != 0)
+            throw_error("not a rule image");
+        p += 8;
+        uint32_t version = get<uint32_t>(p, end);
+        if (version != 1 && version != VERSION)
+            throw_error("unsupported rule image version");
+        rules.clear();
+        uint32_t nsyms = get<uint32_t>(p, end);
+        for (uint32_t i = 0; i < nsyms; i++) {
+            uint32_t len = get<uint32_t>(p, end);
+            if ((size_t)(end - p) < len)
+                throw_error("truncated rule image");
+            if (rules.syms.intern(string(p, len)) != (int)i) // ids of the rules would shift
+                corrupt("symbol " + to_string(i) + " repeats an earlier one");
+            p += len;
+        }
+        uint32_t nsections = get<uint32_t>(p, end);
+        for (uint32_t s = 0; s < nsections; s++) {
+            uint32_t name = get<uint32_t>(p, end);
+            uint32_t begin = get<uint32_t>(p, end);
+            if (name >= nsyms)
+                corrupt("section " + to_string(s) + " names symbol " + to_string(name));
+            if (s > 0 && begin < rules.section_begin.back())
+                corrupt("section " + to_string(s) + " begins before the one ahead of it");
+            rules.section_name.push_back(name);
+            rules.section_begin.push_back(begin);
+        }
+        uint32_t nrules = get<uint32_t>(p, end);
+        if (nsections > 0 && rules.section_begin.back() > nrules)
+            corrupt("section begins past rule " + to_string(nrules));
+        for (uint32_t r = 0; r < nrules; r++) {
+            uint32_t len = get<uint32_t>(p, end);
+            if ((size_t)(end - p) < len)
+                throw_error("truncated rule image");
+            const char *rec_end = p + len; // the fields of the record are read within it
+            uint32_t table = get<uint32_t>(p, rec_end);
+            uint32_t action = get<uint32_t>(p, rec_end);
+            if (table >= nsyms || action >= nsyms)
+                corrupt("rule " + to_string(r) + " names a symbol past " + to_string(nsyms));
+            rules.table.push_back(table);
+            rules.action.push_back(action);
+            rules.priority.push_back(get<int32_t>(p, rec_end));
+            uint16_t nkeys = get<uint16_t>(p, rec_end);
+            uint16_t nparams = get<uint16_t>(p, rec_end);
+            rules.num_keys.push_back(nkeys);
+            for (int f = 0; f < nkeys + nparams; f++) {
+                uint32_t name = get<uint32_t>(p, rec_end);
+                uint8_t fmt = get<uint8_t>(p, rec_end);
+                uint8_t width = get<uint8_t>(p, rec_end);
+                int64_t value = get<int64_t>(p, rec_end);
+                if (name >= nsyms || fmt > FMT_SYM || width > 16 || (fmt == FMT_SYM && (value < 0 || value >= nsyms)))
+                    corrupt("field " + to_string(f) + " of rule " + to_string(r));
+                rules.field_name.push_back(name);
+                rules.field_fmt.push_back(fmt);
+                rules.field_width.push_back(width);
+                rules.field_value.push_back(value);
+            }
+            rules.field_begin.push_back(rules.field_name.size());
+            if (p != rec_end)
+                corrupt("length of rule " + to_string(r));
+        }
+        if (version == 1)
+            return;
+        uint32_t naddrs = get<uint32_t>(p, end);
+        for (uint32_t i = 0; i < naddrs; i++) {
+            AddrReloc r;
+            r.field = get<uint32_t>(p, end);
+            r.sym = get<uint8_t>(p, end);
+            r.shift = get<uint8_t>(p, end);
+            r.bits = get<uint8_t>(p, end);
+            r.addend = get<int32_t>(p, end);
+            r.offset = get<uint64_t>(p, end);
+            if (r.field >= (uint32_t)rules.num_fields() || rules.field_fmt[r.field] == FMT_SYM || r.sym > ADDR_CR3 ||
+                r.shift + r.bits > 64)
+                corrupt("address relocation " + to_string(i));
+            rules.addr_relocs.push_back(r);
+        }
+    }
+};
+
+
+#endif // _RULE_SERIALIZER_H
@@ -1,74 +1,521 @@
 #include <sys/time.h>
 #include <chrono>
+#include <cstdlib>
+#include <new>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <fstream>
-#include "policy.h"
+#include <sstream>
+#include <thread>
+#include "rdmi.h"
+#include "./ir/serializer.h"
+#include "./ir/rule_diff.h"
+#include "./parser/fusion.h"
+#include "./parser/symbolic.h"
 
 using namespace std;
 
+// count the heap allocations of each thread for the phases of the -t report
+void* operator new(size_t n) {
+    heap_allocs++;
+    void *p = malloc(n ? n : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+string read_file(string path) {
+    ifstream infile(path, ios::binary);
+    if (!infile.is_open())
+        throw runtime_error("cannot open " + path);
+    stringstream text;
+    text << infile.rdbuf();
+    return text.str();
+}
+
+// install format named opt, nullptr if opt names none
+RuleSerializer* install_format(const string &opt) {
+    static BfshellSerializer bfshell;
+    static JsonSerializer json;
+    static BinarySerializer binary;
+    if (opt == "cmd")
+        return &bfshell;
+    if (opt == "json")
+        return &json;
+    if (opt == "bin")
+        return &binary;
+    return nullptr;
+}
+
+/**
+ * Diff the rules of every policy against the installed manifest and write
+ * gencode/delta.cmd with the commands that get the switch there, and
+ * gencode/manifest.bin with what is installed once the delta ran. No
+ * manifest yet means an empty switch.
+ */
+void write_delta(const CompileOutput &out, const string &manifest) {
+    auto start = chrono::steady_clock::now();
+    RuleSet installed;
+    ifstream in(manifest, ios::binary);
+    if (in.is_open()) {
+        string image = read_file(manifest);
+        try {
+            BinarySerializer::read(image.data(), image.size(), installed);
+        } catch (const exception &e) {
+            cout << manifest << ": " << e.what() << endl;
+            exit(1);
+        }
+    }
+    RuleSet next;
+    for (const PolicyOutput &po: out.policies)
+        next.append(po.rules);
+    RuleDelta delta;
+    RuleDiff::diff(installed, next, delta);
+    {
+        FileSink script("./gencode/delta.cmd");
+        RuleDiff::write_script(installed, next, delta, script);
+        script.close();
+        FileSink image("./gencode/manifest.bin");
+        BinarySerializer().write(next, image);
+        image.close();
+    }
+    auto end = chrono::steady_clock::now();
+    for (const auto &t: delta.tables)
+        if (t.second.adds || t.second.modifies || t.second.deletes)
+            cout << "  " << t.first << ": +" << t.second.adds << " ~" << t.second.modifies << " -" << t.second.deletes
+                 << " (" << t.second.kept << " kept)" << endl;
+    cout << "delta against " << manifest << ": " << delta.adds() << " adds, " << delta.modifies() << " modifies, "
+         << delta.deletes() << " deletes, " << delta.kept << " entries kept, "
+         << chrono::duration_cast<chrono::microseconds>(end - start).count() << " microseconds" << endl;
+}
 
+// per table entry counts of the minimization pass, and the entries it could not resolve
+void print_minimized(const MinimizeStats &m) {
+    for (const string &c: m.conflicts)
+        cout << red << "conflict: " << c << reset << endl;
+    for (const auto &t: m.tables)
+        if (t.second.before != t.second.after)
+            cout << "  " << t.first << ": " << t.second.before << " -> " << t.second.after << endl;
+    cout << "minimized: " << m.before() << " -> " << m.after() << " entries, " << m.duplicates
+         << " duplicates dropped, " << m.merged << " merged, " << m.conflicts.size() << " conflicts" << endl;
+}
 
-int policy1(string path, int qpn_s, int qpn_r, int i, int base) {
-//	string path("./policies/policy1.c");
-	Policy *d = new Policy(path, qpn_s, qpn_r, i, base);
-	d->parse();
-    d->mark_iter();
-    d->mark_assert();
-	d->frontend_compile();
-    d->gen_pgt_walk_aim();
-    string trans_rule = "pd-master\n";
-    trans_rule += d->backend_compile();
-    trans_rule += '\n';
-    trans_rule += d->gen_pc_tran();
-    trans_rule += '\n';
-    trans_rule += d->gen_base_operation();
-    trans_rule += '\n';
-    trans_rule += d->gen_psn_mapping();
-    trans_rule += '\n';
-    trans_rule += d->gen_offset_encoding();
-    trans_rule += '\n';
-    trans_rule += d->gen_load_max();
-    trans_rule += '\n';
-    trans_rule += d->gen_readmove_pgt_walk_code();
-    trans_rule += '\n';
-    trans_rule += d->gen_pgt_aims_code();
-    trans_rule += "exit";
-    ofstream file;
-    string pp = "./gencode/code_gen" + to_string(i) + ".cmd";
-    file.open(pp);
-    file << trans_rule << endl;
-    file.close();
-    return d->avail_state;
+// what the AIM peephole pass saved on policy i
+void print_aim_opt(int i, const AimOptStats &o) {
+    cout << "policy " << i << " peephole: " << o.moves_dropped << " moves dropped, " << o.moves_folded
+         << " folded, " << o.loads_threaded << " loads threaded, " << o.qpns_saved << " QPN states saved, round trips saved: "
+         << o.trips_per_run << " per run, " << o.trips_per_iter << " per traverse iteration" << endl;
+}
+
+/**
+ * Where the fields of the wide reads of policy i sit in the response
+ * payloads, for the collector: gencode/code_gen<i>.fields.
+ */
+void write_fields(int i, const PayloadLayout &p) {
+    ofstream fil("./gencode/code_gen" + to_string(i) + ".fields");
+    for (const PayloadField &f: p.fields)
+        fil << "dqpn " << f.dqpn << " len " << f.len << " field " << f.pos + f.offset << " at " << f.at << endl;
+    cout << "policy " << i << " wide reads: " << p.fields.size() << " fields in " << p.reads
+         << " reads, " << p.saved() << " round trips saved each time they run" << endl;
+}
+
+// policies fused into policy i and the round trips their shared walk saves
+void print_fusion(int i, const FusionGroup &g, bool peephole) {
+    if (g.members.size() < 2)
+        return;
+    cout << "policy " << i << " fuses policies";
+    for (int m: g.members)
+        cout << " " << m;
+    cout << ", round trips saved per trigger: " << g.per_element << " per list element + "
+         << (peephole ? 0 : g.exits) << " loop exits, " << g.members.size() - 1 << " triggers less" << endl;
+}
+
+/**
+ * Cardinalities of -e, comma separated name=value pairs out of list (list
+ * elements), fds (entries of an .iter with a length read at run time),
+ * vmalloc (share of Move() targets that take a page walk) and rtt (us).
+ */
+CostParams parse_cost(const string &arg) {
+    CostParams p;
+    size_t at = 0;
+    while (at < arg.size()) {
+        size_t end = arg.find(',', at);
+        string pair = arg.substr(at, end == string::npos ? string::npos : end - at);
+        at = end == string::npos ? arg.size() : end + 1;
+        size_t eq = pair.find('=');
+        string name = pair.substr(0, eq);
+        double value = eq == string::npos ? -1 : stod(pair.substr(eq + 1));
+        if (value < 0 || (name != "list" && name != "fds" && name != "vmalloc" && name != "rtt") ||
+            (name == "vmalloc" && value > 1))
+            throw runtime_error("bad cardinality " + pair + ", expected list=N, fds=N, vmalloc=0..1 or rtt=us");
+        (name == "list" ? p.list : name == "fds" ? p.fds : name == "vmalloc" ? p.vmalloc : p.rtt_us) = value;
+    }
+    return p;
+}
+
+/**
+ * With -t, what compiling policy i took, for a controller to read:
+ * gencode/report<i>.json with the wall time, heap allocations and Op/Aim
+ * nodes of each pass, the AIMs by kind, the entries by table and the QPN
+ * states. A policy from the cache ran no pass, its phases are zero and
+ * its AIMs are not known.
+ */
+void write_report(int i, const PolicyOutput &po) {
+    ofstream fil("./gencode/report" + to_string(i) + ".json");
+    fil << "{\n  \"policy\": " << i << ",\n  \"cached\": " << (po.cached ? "true" : "false")
+        << ",\n  \"qpn_s\": " << po.qpn_s << ",\n  \"qpn_r\": " << po.qpn_r
+        << ",\n  \"qpn_states\": " << po.footprint.qpns << ",\n  \"compile_us\": " << po.compile_us
+        << ",\n  \"phases\": {";
+    for (int p = 0; p < PH_NUM; p++) {
+        const PhaseStats &ph = po.profile.phases[p];
+        fil << (p ? "," : "") << "\n    \"" << PHASE_NAMES[p] << "\": {\"ns\": " << ph.ns << ", \"heap_allocs\": "
+            << ph.heap_allocs << ", \"arena_nodes\": " << ph.arena_nodes << "}";
+    }
+    fil << "\n  },\n  \"aims\": {";
+    const char *sep = "";
+    for (const auto &a: po.profile.aims) {
+        fil << sep << "\n    \"" << a.first << "\": " << a.second;
+        sep = ",";
+    }
+    map<string, int> tables;
+    for (int r = 0; r < po.rules.size(); r++)
+        tables[po.rules.syms.name(po.rules.table[r])]++;
+    fil << (po.profile.aims.empty() ? "" : "\n  ") << "},\n  \"rules\": " << po.rules.size() << ",\n  \"tables\": {";
+    sep = "";
+    for (const auto &t: tables) {
+        fil << sep << "\n    \"" << t.first << "\": " << t.second;
+        sep = ",";
+    }
+    fil << (tables.empty() ? "" : "\n  ") << "}\n}\n";
+}
+
+// fake states, stack slots and iter registers the policies were given, with -p
+void print_registers(const RegFileUse files[RF_NUM]) {
+    cout << "registers packed:";
+    for (int f = 0; f < RF_NUM; f++)
+        cout << (f ? "," : "") << " " << REG_FILE_NAMES[f] << " " << files[f].used << " of " << files[f].capacity;
+    cout << endl;
+}
+
+/**
+ * With -q the psn register slots no longer follow the QPN states, write
+ * which slot holds the PSN of which QP for the connection setup
+ * (connection/parse.py): gencode/psn_slots, "slot S qpn Q" per line.
+ */
+void write_psn_slots(const CompileOutput &out) {
+    ofstream fil("./gencode/psn_slots");
+    for (const PolicyOutput &po: out.policies) {
+        const RuleSet &rules = po.rules;
+        int tab = rules.syms.find("read_update_psn_tab");
+        for (int r = 0; r < rules.size(); r++) {
+            if (tab == -1 || rules.table[r] != tab)
+                continue;
+            int64_t qpn = -1, slot = -1;
+            for (int f = rules.keys_begin(r); f < rules.params_end(r); f++) {
+                if (rules.syms.name(rules.field_name[f]) == "ib_bth_dqpn")
+                    qpn = rules.field_value[f];
+                if (rules.syms.name(rules.field_name[f]) == "state")
+                    slot = rules.field_value[f];
+            }
+            fil << "slot " << slot << " qpn " << qpn << endl;
+        }
+    }
+    cout << "dense psn slots: " << out.budget.registers.at("psn").slots << " slots, " << out.psn_saved
+         << " saved" << endl;
+}
+
+// ./RDMI link QPN_l QPN_r obj.rel ... [cmd|json|bin]: relocatable policies in install order
+int link_main(int argc, char *argv[]) {
+    if (argc < 5) {
+        cout << "usage: link QPN_l QPN_r policy.rel ... [cmd|json|bin] [-m] [-p]" << endl;
+        exit(0);
+    }
+    RuleSerializer *ser = install_format("cmd");
+    vector<RelocatableRules> objects;
+    bool minimize = false;
+    bool pack = false;
+    for (int a = 4; a < argc; a++) {
+        if (RuleSerializer *f = install_format(argv[a])) {
+            ser = f;
+            continue;
+        }
+        if (string(argv[a]) == "-m") {
+            minimize = true;
+            continue;
+        }
+        if (string(argv[a]) == "-p") {
+            pack = true;
+            continue;
+        }
+        string image = read_file(argv[a]);
+        objects.emplace_back();
+        try {
+            objects.back().read(image.data(), image.size());
+        } catch (const exception &e) {
+            cout << argv[a] << ": " << e.what() << endl;
+            return 1;
+        }
+    }
+    auto start = chrono::steady_clock::now();
+    Compiler compiler(stoi(argv[2]), stoi(argv[3]));
+    compiler.set_minimize(minimize);
+    compiler.set_pack(pack);
+    CompileOutput out = compiler.link(objects);
+    auto end = chrono::steady_clock::now();
+
+    for (int i = 0; i < (int)objects.size(); i++) {
+        PolicyOutput &po = out.policies[i];
+        cout << bold << blue << i << "th policy's state is " << po.qpn_s << " and " << po.qpn_r << reset << endl;
+        FileSink file("./gencode/code_gen" + to_string(i) + ser->extension());
+        ser->write(po.rules, file);
+        file.close();
+        cout << "policy " << i << ": " << objects[i].relocs.size() << " relocations" << endl;
+        if (!out.payload.fields.empty()) // objects compiled with -w
+            write_fields(i, po.payload);
+    }
+    if (minimize)
+        print_minimized(out.minimized);
+    if (pack)
+        print_registers(out.registers);
+    cout << "Link time: " << chrono::duration_cast<chrono::microseconds>(end - start).count()
+         << " microseconds" << endl;
+
+    ofstream fil("./gencode/summary");
+    fil << out.summary << endl;
+    ofstream util("./gencode/utilization");
+    util << out.budget.report();
+    return 0;
+}
+
+// ./RDMI patch SLIDE CR3 file.bin|file.rel ...: addresses of compiled policies for another host, in place
+int patch_main(int argc, char *argv[]) {
+    if (argc < 5) {
+        cout << "usage: patch KASLR_SLIDE CR3 policy.bin|policy.rel ..." << endl;
+        exit(0);
+    }
+    HostLayout host;
+    host.slide = stoll(argv[2], nullptr, 0);
+    host.cr3 = stoull(argv[3], nullptr, 0);
+    for (int a = 4; a < argc; a++) {
+        string image = read_file(argv[a]);
+        auto start = chrono::steady_clock::now();
+        BufferSink out(image.size());
+        size_t fields;
+        try {
+            if (image.compare(0, 8, "RDMIRELO") == 0) {
+                RelocatableRules obj;
+                obj.read(image.data(), image.size());
+                patch_addresses(obj.rules, host);
+                obj.write(out);
+                fields = obj.rules.addr_relocs.size();
+            } else {
+                RuleSet rules;
+                BinarySerializer::read(image.data(), image.size(), rules);
+                patch_addresses(rules, host);
+                BinarySerializer().write(rules, out);
+                fields = rules.addr_relocs.size();
+            }
+        } catch (const exception &e) {
+            cout << argv[a] << ": " << e.what() << endl;
+            return 1;
+        }
+        auto end = chrono::steady_clock::now();
+        // the image is replaced only once the patched one is entirely on disk
+        string tmp = string(argv[a]) + ".tmp";
+        try {
+            FileSink file(tmp);
+            file << out.str();
+            file.close();
+        } catch (const exception &e) {
+            remove(tmp.c_str());
+            cout << argv[a] << ": " << e.what() << ", left unchanged" << endl;
+            return 1;
+        }
+        if (rename(tmp.c_str(), argv[a]) != 0)
+            throw runtime_error("cannot replace " + string(argv[a]));
+        cout << argv[a] << ": " << fields << " address fields patched in "
+             << chrono::duration_cast<chrono::microseconds>(end - start).count() << " microseconds" << endl;
+    }
+    return 0;
 }
 
 int main (int argc, char *argv[]) {
+    if (argc > 1 && string(argv[1]) == "link")
+        return link_main(argc, argv);
+    if (argc > 1 && string(argv[1]) == "patch")
+        return patch_main(argc, argv);
     printf("begin compiling: ./RDMI 3000 300 10");
-    if(argc != 4){
-        cout << "the num of param is 4!! dqpn, qpn, policy_num" << endl;
+    if(argc < 4){
+        cout << "the num of param is 4!! dqpn, qpn, policy_num [cmd|json|bin] [-j threads] [-c cache_dir] [-r] [-d manifest] [-m] [-O] [-w] [-f] [-p] [-q] [-e list=N,fds=N,vmalloc=P,rtt=us] [-l layout.json] [-t] [-v]\n"
+             << "   or: link QPN_l QPN_r policy.rel ... [cmd|json|bin] [-m] [-p]\n"
+             << "   or: patch KASLR_SLIDE CR3 policy.bin|policy.rel ..." << endl;
         exit(0);
     }
+    // install format of the generated rules, bfshell commands by default
+    RuleSerializer *ser = install_format("cmd");
+    int threads = 1;
+    string cache_dir;
+    bool relocatable = false;
+    string manifest;
+    bool minimize = false;
+    bool peephole = false;
+    bool coalesce = false;
+    bool fuse = false;
+    bool pack = false;
+    bool dense_psn = false;
+    bool cost = false;
+    CostParams cost_params;
+    bool report = false;
+    string layout_path = "./datastruct.json";
+    for (int a = 4; a < argc; a++) {
+        string opt = argv[a];
+        if (install_format(opt))
+            ser = install_format(opt);
+        else if (opt == "-j" && a + 1 < argc)
+            threads = stoi(argv[++a]);
+        else if (opt.compare(0, 2, "-j") == 0 && opt.size() > 2)
+            threads = stoi(opt.substr(2));
+        else if (opt == "-c" && a + 1 < argc)
+            cache_dir = argv[++a];
+        else if (opt == "-r")
+            relocatable = true;
+        else if (opt == "-d" && a + 1 < argc)
+            manifest = argv[++a];
+        else if (opt == "-m")
+            minimize = true;
+        else if (opt == "-O")
+            peephole = true;
+        else if (opt == "-w")
+            coalesce = true;
+        else if (opt == "-f")
+            fuse = true;
+        else if (opt == "-p")
+            pack = true;
+        else if (opt == "-q")
+            dense_psn = true;
+        else if (opt == "-e") {
+            cost = true;
+            try {
+                if (a + 1 < argc && string(argv[a + 1]).find('=') != string::npos)
+                    cost_params = parse_cost(argv[++a]);
+            } catch (const exception &e) {
+                cout << e.what() << endl;
+                exit(0);
+            }
+        }
+        else if (opt == "-l" && a + 1 < argc)
+            layout_path = argv[++a];
+        else if (opt == "-t")
+            report = true;
+        else if (opt == "-v")
+            set_log_level(LOG_TRACE);
+        else {
+            cout << "unknown option " << opt << ", expected cmd, json, bin, -j threads, -c cache_dir, -r, -d manifest, -m, -O, -w, -f, -p, -q, -e, -l layout.json, -t or -v" << endl;
+            exit(0);
+        }
+    }
+    if (threads < 1)
+        threads = thread::hardware_concurrency();
     int num = (stoi)(argv[3]);
     auto start = chrono::steady_clock::now();
-    string path = "./policies/policy";
-    // calculate qpn_tran_coef
-    int qpn_tran_coef = (stoi)(argv[2]) - stoi(argv[1]);
-//    path = "./policies/policy0.c";
-    path = "./exe/policy0.c";
-    int new_avail_state = policy1(path, stoi(argv[1]), (stoi)(argv[2]), 0, stoi(argv[1])); // 0th policy;
     cout << "the 2 coeffs are " << (int)(*argv[1]) << "   " << (int)(*argv[2]) << endl;
 
-    string control_rule;
-    control_rule += "0 th policy's state is " + to_string(stoi(argv[1])) + " and " + to_string(stoi(argv[2])) + '\n';
-
-    for (int i = 1; i < num; i++){
+    vector<string> sources;
+    KernelLayout layout;
+    bool layout_loaded = false;
+    for (int i = 0; i < num; i++){
 //        path = "./policies/policy" + to_string(i) + ".c";
-        path = "./exe/policy" + to_string(i) + ".c";
-        cout << bold << blue << i << "th policy's state is " << new_avail_state << " and " <<
-                 new_avail_state + qpn_tran_coef  << reset << endl;
-        control_rule += to_string(i) + " th policy's state is " + to_string(new_avail_state) + " and "+ to_string(new_avail_state + qpn_tran_coef) + '\n';
-        new_avail_state = policy1(path, new_avail_state, new_avail_state + 
-            qpn_tran_coef, i, stoi(argv[1])); // ith policy
+        string text = read_file("./exe/policy" + to_string(i) + ".c");
+        if (!SymbolicDsl::is_symbolic(text)) {
+            sources.push_back(text);
+            continue;
+        }
+        // field names resolved against the layout, loaded on the first symbolic policy; each kgraph is a policy
+        try {
+            if (!layout_loaded) {
+                layout = KernelLayout::load(layout_path);
+                layout_loaded = true;
+            }
+            for (const string &policy: SymbolicDsl::translate(text, layout))
+                sources.push_back(policy);
+        } catch (const exception &e) {
+            cout << "policy" << i << ".c: " << e.what() << endl;
+            exit(0);
+        }
+    }
+    num = sources.size();
+    vector<FusionGroup> groups;
+    if (fuse) { // policies walking the same list become one, numbered in install order
+        int max_fake = pack ? RegisterAllocator::fake_capacity(stoi(argv[1]), stoi(argv[2]), sources.size()) :
+            TASK_STRIDE[RF_FAKE];
+        sources = PolicyFusion::fuse(sources, groups, max_fake);
+        num = sources.size();
+    }
+    Compiler compiler(stoi(argv[1]), stoi(argv[2]), threads);
+    if (!cache_dir.empty())
+        compiler.use_cache(cache_dir);
+    compiler.set_relocatable(relocatable);
+    compiler.set_minimize(minimize);
+    compiler.set_peephole(peephole);
+    compiler.set_coalesce(coalesce);
+    compiler.set_pack(pack);
+    compiler.set_dense_psn(dense_psn);
+    if (cost)
+        compiler.set_cost(cost_params);
+    CompileOutput out = compiler.compile(sources);
+
+    for (int i = 0; i < num; i++){
+        PolicyOutput &po = out.policies[i];
+        cout << bold << blue << i << "th policy's state is " << po.qpn_s << " and " << po.qpn_r << reset << endl;
+        FileSink file("./gencode/code_gen" + to_string(i) + ser->extension());
+        ser->write(po.rules, file);
+        file.close();
+        if (relocatable) {
+            FileSink obj("./gencode/code_gen" + to_string(i) + ".rel");
+            po.object.write(obj);
+            obj.close();
+        }
+        cout << "policy " << i << ": " << po.nodes << " nodes, " << po.arena_bytes
+             << " bytes, arena peak " << po.arena_peak << " bytes"
+             << (po.cached ? ", cached" : "") << endl;
+        if (peephole && !po.cached)
+            print_aim_opt(i, po.aim_opt);
+        if (fuse)
+            print_fusion(i, groups[i], peephole);
+        if (coalesce)
+            write_fields(i, po.payload);
+        if (report)
+            write_report(i, po);
+        if (cost)
+            cout << "policy " << i << " per trigger: " << po.cost.report(cost_params) << endl;
+    }
+    if (cost) {
+        PolicyCost all;
+        for (const PolicyOutput &po: out.policies)
+            all.add(po.cost);
+        cout << "all policies per trigger: " << all.report(cost_params) << endl;
+    }
+
+    if (minimize)
+        print_minimized(out.minimized);
+    if (pack)
+        print_registers(out.registers);
+    if (dense_psn)
+        write_psn_slots(out);
+
+    if (!manifest.empty())
+        write_delta(out, manifest);
+
+    if (!cache_dir.empty()) {
+        char line[160];
+        snprintf(line, sizeof(line), "cache: %d hits, %d misses, hit rate %.1f%%, saved %.3f ms, lookups %.3f ms\n",
+            out.cache_hits, out.cache_misses, num ? 100.0 * out.cache_hits / num : 0.0,
+            out.cache_saved_ms, out.cache_lookup_ms);
+        cout << line;
+        out.summary += line;
     }
 
 	auto end = chrono::steady_clock::now();
@@ -79,7 +526,10 @@ int main (int argc, char *argv[]) {
     ofstream fil;    
     string pat = "./gencode/summary";
     fil.open(pat);
-    fil << control_rule << endl;
+    fil << out.summary << endl;
+    fil.close();
+    fil.open("./gencode/utilization"); // what the policies take of the registers and tables of the switch
+    fil << out.budget.report();
     fil.close();
 	return 0;
 }
@@ -19,7 +19,7 @@ private:
 	friend class Policy;
 
 public:
-	Asser(){};
+	Asser() : Op(OP_ASSERT){};
 
 	void set_high(string offset) { this->addr_h = offset; }
 	void set_low(string low) { this->addr_l = low; }
@@ -17,7 +17,7 @@ private:
 	friend class Policy;
 
 public:
-	End(){};
+	End() : Op(OP_END){};
 
 	string to_string() {
 		string ans;
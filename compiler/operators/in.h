@@ -21,7 +21,7 @@ private:
 	friend class Policy;
 
 public:
-	In(){};
+	In() : Op(OP_IN){};
 
 	void set_offset(string offset) { this->offset = offset;	}
     void set_type(string type) { this->type = type;}
@@ -22,7 +22,7 @@ private:
 	friend class Policy;
 
 public:
-	Iter(){};
+	Iter() : Op(OP_ITER){};
 
     void set_seq(int seq) {this->seq = seq;}
     void set_dynamic(int dyn) {
@@ -55,11 +55,9 @@ public:
 		ans += "\n";
 
         ans += "dynamic: ";
-        cout << "dynamic is " << this->dynamic << endl;
         ans += "\n";
 
         ans += "seq: " ;
-        cout << "seq is " << this->seq << endl;
 
         ans += '\n';
 
@@ -67,7 +65,9 @@ public:
 	}
 	void print() {
 		cout << bold << yellow << "Iter:" << reset << endl;
-		cout << yellow << this->to_string() <<reset << endl;
+		cout << yellow << "dynamic is " << this->dynamic << endl;
+		cout << "seq is " << this->seq << endl;
+		cout << this->to_string() <<reset << endl;
 	}
 	string get_op_name() { return "Iter"; }
 	string gen_statemachine(){return "state_machine";};
@@ -19,7 +19,7 @@ private:
 	friend class Policy;
 
 public:
-	KernelGraph(){};
+	KernelGraph() : Op(OP_KERNELGRAPH){};
 
 	void set_root(string root) { this->root = root;	}
 	string get_root() {return this->root;}
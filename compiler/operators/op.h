@@ -11,12 +11,28 @@
 
 using namespace std;
 
+// kind tag used for dispatching on operators without string comparison
+enum OpKind {
+	OP_KERNELGRAPH,
+	OP_TRAVERSE,
+	OP_IN,
+	OP_ITER,
+	OP_VALUES,
+	OP_ASSERT,
+	OP_END,
+	OP_REBASE
+};
+
 class Op {
 private:
 	friend class Policy;
+	const OpKind kind;
 
 public:
-	Op(){};
+	Op(OpKind kind) : kind(kind){};
+	virtual ~Op(){};
+
+	OpKind get_kind() { return this->kind; }
 
 	virtual string to_string()= 0;
 	virtual void print() = 0;
@@ -0,0 +1,40 @@
+#ifndef _REBASE_H
+#define _REBASE_H
+
+#include <string>
+#include <vector>
+#include <cassert>
+#include <iostream>
+#include <regex>
+
+#include "op.h"
+#include "../utils/colors.h"
+
+using namespace std;
+
+// .rebase(): the statements after it start again from the element of the
+// enclosing traverse, one more body for the same walk
+class Rebase : public Op {
+private:
+	friend class Policy;
+
+public:
+	Rebase() : Op(OP_REBASE){};
+
+	string to_string() {
+		string ans;
+		ans += "rebase on the traverse element";
+		ans += "\n";
+
+		return ans;
+	}
+	void print() {
+		cout << bold << yellow << "Rebase:" << reset << endl;
+		cout << yellow << this->to_string() <<reset << endl;
+	}
+	string get_op_name() { return "Rebase"; }
+	string gen_statemachine(){return "state_machine";};
+};
+
+
+#endif
@@ -17,14 +17,17 @@ private:
 	string offset;  // 1st arg: the offset to the "next"
 	string end;     // 2nd arg: the end address
 	string type;    // 3rd arg: the link list data structure
+	int rebases = 0; // .rebase() statements splitting its body
 	friend class Policy;
 
 public:
-	Traverse(){};
+	Traverse() : Op(OP_TRAVERSE){};
 
 	void set_offset(string offset) { this->offset = offset; }
 	void set_end(string end) { this->end = end; }
 	void set_type(string type) { this->type = type; }
+	void set_rebases(int n) { this->rebases = n; }
+	int get_rebases() { return this->rebases; }
 
 
     string get_high(){ return this->end.substr(2, 8);}
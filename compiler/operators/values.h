@@ -23,7 +23,7 @@ private:
 	string addr_l = "0";     // Low address bound used for assert
 
 public:
-	Values(){};
+	Values() : Op(OP_VALUES){};
 
     void set_name(string name) {this->name = name;}
     void set_regnr(int i) { this->reg_nr = i;} // set register to store max_fd
@@ -68,7 +68,6 @@ public:
         ans += "\n";
 
         ans += "the " + this->name + "is stored at" ;
-        cout << " the seq is " << this->reg_nr << endl;
         ans += '\n';
 		
         return ans;
@@ -76,7 +75,8 @@ public:
 
 	void print() {
 		cout << bold << yellow << "Values:" << reset << endl;
-		cout << yellow << this->to_string() <<reset << endl;
+		cout << yellow << " the seq is " << this->reg_nr << endl;
+		cout << this->to_string() <<reset << endl;
 	}
 	string get_op_name() { return "Values"; }
 	string gen_statemachine(){return "state_machine";};
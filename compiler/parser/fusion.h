@@ -0,0 +1,151 @@
+#ifndef _FUSION_H
+#define _FUSION_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "lexer.h"
+
+using namespace std;
+
+// policies compiled as one, and what walking their list once saves
+struct FusionGroup {
+    vector<int> members; // input policies, in the order their bodies run
+    int per_element = 0; // Move(next) reads saved per element of the list
+    int exits = 0;       // loop exit loads saved per trigger, threaded away by -O anyway
+};
+
+/**
+ * Traversal fusion over policy sources.
+ *
+ * Policies that start with the same KernelGraph(root).traverse(...) walk
+ * the same list. They are fused into one policy that walks it once, their
+ * bodies split by .rebase() so that each element runs every body in turn:
+ *
+ *   KernelGraph(init_task)            KernelGraph(init_task)
+ *   .traverse(1960, 0x..., 1960)      .traverse(1960, 0x..., 1960)
+ *   .values(2216, 2640)        +      .values(2216, 2640)
+ *   End                               .rebase()
+ *                                     .values(2216)
+ *   KernelGraph(init_task)            .in(2632)
+ *   .traverse(1960, 0x..., 1960)      .values(4, 12)
+ *   .values(2216)                     End
+ *   .in(2632)
+ *   .values(4, 12)
+ *   End
+ *
+ * A body that opens a loop of its own has to run last, a group takes one
+ * such policy and as many others as max_fake, the fake states one policy
+ * may take, allow: those of a task, or with packing all there are. The
+ * fused policy takes the place of its first member, the other policies
+ * keep their order. Works on the text, so that the fused policies compile,
+ * cache and link like any other.
+ */
+class PolicyFusion {
+private:
+    struct Source {
+        vector<string> stmts; // canonical text of each statement
+        bool fusable = false;
+        int loops = 0;        // inner loops of the body
+    };
+
+    static Source split(const string &text) {
+        Source s;
+        Lexer lexer(text);
+        vector<Token> toks = lexer.tokenize();
+        int depth = 0;
+        for (const Token &t: toks) {
+            if (t.kind == TOK_EOF)
+                break;
+            if (depth == 0 && (t.kind == TOK_DOT || (t.kind == TOK_WORD && (t.text == "KernelGraph" || t.text == "End"))))
+                s.stmts.push_back("");
+            if (s.stmts.empty())
+                return s;
+            s.stmts.back() += t.kind == TOK_COMMA ? ", " : t.text;
+            depth += t.kind == TOK_LPAREN ? 1 : t.kind == TOK_RPAREN ? -1 : 0;
+        }
+        int n = s.stmts.size();
+        if (n < 4 || s.stmts[0].compare(0, 12, "KernelGraph(") != 0 || s.stmts[1].compare(0, 10, ".traverse(") != 0 ||
+            s.stmts[n - 1] != "End")
+            return s;
+        auto starts = [](const string &stmt, const char *prefix) { return stmt.compare(0, strlen(prefix), prefix) == 0; };
+        if (!starts(s.stmts[2], ".values(") && !starts(s.stmts[2], ".in("))
+            return s;
+        if (!starts(s.stmts[n - 2], ".values(") && !starts(s.stmts[n - 2], ".assert("))
+            return s;
+        for (int i = 2; i < n - 1; i++) {
+            if (s.stmts[i] == "End" || starts(s.stmts[i], ".rebase(") || starts(s.stmts[i], "KernelGraph("))
+                return s;
+            if (starts(s.stmts[i], ".traverse(") || starts(s.stmts[i], ".iter("))
+                s.loops++;
+        }
+        s.fusable = true;
+        return s;
+    }
+
+public:
+    // fused sources in install order, groups[k] lists the policies fused into source k
+    static vector<string> fuse(const vector<string> &sources, vector<FusionGroup> &groups, int max_fake) {
+        vector<Source> split_sources;
+        for (const string &text: sources)
+            split_sources.push_back(split(text));
+
+        groups.clear();
+        vector<int> loops; // of the body that runs last in each group
+        unordered_map<string, int> open; // group still taking policies, by prefix
+        for (int i = 0; i < (int)sources.size(); i++) {
+            const Source &s = split_sources[i];
+            string prefix = s.fusable ? s.stmts[0] + s.stmts[1] : "";
+            auto it = open.find(prefix);
+            if (s.fusable && it != open.end()) {
+                FusionGroup &g = groups[it->second];
+                bool last_loops = loops[it->second] > 0;
+                // Policy::footprint() of the fused text: the traverse, a .rebase() per member but the first, the loops
+                int fake = 1 + (int)g.members.size() + max(loops[it->second], s.loops);
+                if (!(last_loops && s.loops > 0) && fake <= max_fake) {
+                    if (s.loops > 0 || !last_loops)
+                        g.members.push_back(i);
+                    else // ahead of the body that opens loops
+                        g.members.insert(g.members.end() - 1, i);
+                    loops[it->second] = max(loops[it->second], s.loops);
+                    g.per_element++;
+                    g.exits++;
+                    continue;
+                }
+            }
+            groups.emplace_back();
+            groups.back().members.push_back(i);
+            loops.push_back(s.loops);
+            if (s.fusable)
+                open[prefix] = groups.size() - 1;
+        }
+
+        vector<string> fused;
+        for (const FusionGroup &g: groups) {
+            if (g.members.size() == 1) {
+                fused.push_back(sources[g.members[0]]);
+                continue;
+            }
+            const vector<string> &head = split_sources[g.members[0]].stmts;
+            string text = "/* fused: policies";
+            for (int m: g.members)
+                text += " " + to_string(m);
+            text += " */\n" + head[0] + "\n" + head[1] + "\n";
+            for (int k = 0; k < (int)g.members.size(); k++) {
+                const vector<string> &stmts = split_sources[g.members[k]].stmts;
+                if (k > 0)
+                    text += ".rebase()\n";
+                for (int j = 2; j < (int)stmts.size() - 1; j++)
+                    text += stmts[j] + "\n";
+            }
+            text += "End\n";
+            fused.push_back(text);
+        }
+        return fused;
+    }
+};
+
+
+#endif // _FUSION_H
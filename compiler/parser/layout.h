@@ -0,0 +1,215 @@
+#ifndef _LAYOUT_H
+#define _LAYOUT_H
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+using namespace std;
+
+#ifndef throw_error
+#define throw_error(msg) throw std::runtime_error(string(__FILE__)+":"+std::to_string(__LINE__)+" --> "+msg);
+#endif
+
+// one member of a kernel struct
+struct LayoutField {
+    string type;     // struct, or int, string, ptr ...
+    int offset = 0;
+    int size = 0;
+    int pointer = 0; // dereferences to reach an object of type
+};
+
+/**
+ * Kernel data structure layout of one host, as in datastruct.json:
+ *
+ *   entry_point       kgraph root -> struct
+ *   data_structure    struct -> field -> {type, offset, size, pointer},
+ *                     a number "size" of the struct itself next to the fields
+ *   runtime_variable  name -> address
+ *
+ * Loaded once into flat hash tables, the fields keyed by (struct, field),
+ * so resolving a path costs a lookup per component.
+ */
+class KernelLayout {
+private:
+    struct PairHash {
+        size_t operator()(const pair<string, string> &k) const {
+            return hash<string>()(k.first) * 31 + hash<string>()(k.second);
+        }
+    };
+
+    unordered_map<pair<string, string>, LayoutField, PairHash> fields;
+    unordered_map<string, int> sizes;     // of the structs that give one
+    unordered_map<string, string> roots;  // entry_point
+    unordered_map<string, string> vars;   // runtime_variable
+
+    // just enough JSON for the layout: objects, strings and integers
+    class Reader {
+    private:
+        const string &src;
+        size_t pos = 0;
+        int line = 1;
+
+        void blank() {
+            while (pos < src.size() && (src[pos] == ' ' || src[pos] == '\t' || src[pos] == '\r' || src[pos] == '\n')) {
+                if (src[pos] == '\n')
+                    line++;
+                pos++;
+            }
+        }
+
+    public:
+        Reader(const string &src) : src(src) {}
+
+        void error(const string &msg) { throw_error("layout line " + to_string(line) + ": " + msg); }
+
+        char peek() {
+            blank();
+            return pos < src.size() ? src[pos] : '\0';
+        }
+
+        void expect(char c) {
+            if (peek() != c)
+                error(string("expected '") + c + "'");
+            pos++;
+        }
+
+        string str() {
+            expect('"');
+            size_t start = pos;
+            while (pos < src.size() && src[pos] != '"') {
+                if (src[pos] == '\\' || src[pos] == '\n')
+                    error("escapes and line breaks are not supported in strings");
+                pos++;
+            }
+            if (pos >= src.size())
+                error("unterminated string");
+            return src.substr(start, pos++ - start);
+        }
+
+        int num() {
+            blank();
+            char *end;
+            long v = strtol(src.c_str() + pos, &end, 10);
+            if (end == src.c_str() + pos)
+                error("expected a number");
+            pos = end - src.c_str();
+            return v;
+        }
+
+        // calls member(key) for each member of an object, which reads its value
+        template <class Fn>
+        void object(Fn member) {
+            expect('{');
+            if (peek() == '}') {
+                pos++;
+                return;
+            }
+            while (true) {
+                string key = this->str();
+                expect(':');
+                member(key);
+                if (peek() == ',') {
+                    pos++;
+                    if (peek() == '}') { // trailing comma, as datastruct.json has
+                        pos++;
+                        return;
+                    }
+                    continue;
+                }
+                expect('}');
+                return;
+            }
+        }
+
+        void end() {
+            if (peek() != '\0')
+                error("trailing characters");
+        }
+    };
+
+    void read_struct(Reader &in, const string &name) {
+        in.object([&](const string &key) {
+            if (in.peek() != '{') { // the size of the struct
+                if (key != "size")
+                    in.error("struct " + name + ": " + key + " is neither a field nor the size");
+                this->sizes[name] = in.num();
+                return;
+            }
+            LayoutField f;
+            in.object([&](const string &attr) {
+                if (attr == "type")
+                    f.type = in.str();
+                else if (attr == "offset")
+                    f.offset = in.num();
+                else if (attr == "size")
+                    f.size = in.num();
+                else if (attr == "pointer")
+                    f.pointer = in.num();
+                else
+                    in.error("field " + name + "." + key + ": unknown attribute " + attr);
+            });
+            if (f.type.empty())
+                in.error("field " + name + "." + key + " has no type");
+            this->fields[make_pair(name, key)] = f;
+        });
+    }
+
+public:
+    static KernelLayout parse(const string &text) {
+        KernelLayout layout;
+        Reader in(text);
+        in.object([&](const string &section) {
+            if (section == "entry_point")
+                in.object([&](const string &root) { layout.roots[root] = in.str(); });
+            else if (section == "runtime_variable")
+                in.object([&](const string &var) { layout.vars[var] = in.str(); });
+            else if (section == "data_structure")
+                in.object([&](const string &name) { layout.read_struct(in, name); });
+            else
+                in.error("unknown section " + section);
+        });
+        in.end();
+        return layout;
+    }
+
+    static KernelLayout load(const string &path) {
+        ifstream file(path);
+        if (!file.is_open())
+            throw_error("cannot open layout " + path);
+        stringstream text;
+        text << file.rdbuf();
+        return parse(text.str());
+    }
+
+    // nullptr if the struct has no such field
+    const LayoutField* find(const string &type, const string &field) const {
+        auto it = this->fields.find(make_pair(type, field));
+        return it == this->fields.end() ? nullptr : &it->second;
+    }
+
+    // -1 if the struct gives no size
+    int size_of(const string &type) const {
+        auto it = this->sizes.find(type);
+        return it == this->sizes.end() ? -1 : it->second;
+    }
+
+    // empty if not an entry point or runtime variable
+    string root(const string &name) const {
+        auto it = this->roots.find(name);
+        return it == this->roots.end() ? "" : it->second;
+    }
+    string variable(const string &name) const {
+        auto it = this->vars.find(name);
+        return it == this->vars.end() ? "" : it->second;
+    }
+
+    size_t num_fields() const { return this->fields.size(); }
+};
+
+
+#endif // _LAYOUT_H
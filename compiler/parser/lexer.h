@@ -0,0 +1,140 @@
+#ifndef _LEXER_H
+#define _LEXER_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+
+#ifndef throw_error
+#define throw_error(msg) throw std::runtime_error(string(__FILE__)+":"+std::to_string(__LINE__)+" --> "+msg);
+#endif
+
+enum TokenKind {
+    TOK_WORD,    // [A-Za-z0-9_]+, covers names, decimal and hex numbers
+    TOK_DOT,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_COMMA,
+    TOK_AT,
+    TOK_LT,      // only between the bounds of a symbolic .assert(a<field<b)
+    TOK_EOF
+};
+
+struct Token {
+    TokenKind kind;
+    string text;
+    int line;
+    int col;
+    bool numeric; // word made of decimal digits only
+};
+
+/**
+ * Single pass tokenizer for the policy DSL.
+ * Line and block comments and white space are skipped, every token keeps
+ * its line and column for error reporting.
+ */
+class Lexer {
+private:
+    const string &src;
+    size_t pos = 0;
+    int line = 1;
+    int col = 1;
+
+    void advance() {
+        if (src[pos] == '\n') {
+            line++;
+            col = 1;
+        } else {
+            col++;
+        }
+        pos++;
+    }
+
+    static bool is_word_char(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+               (c >= '0' && c <= '9') || c == '_';
+    }
+
+    void skip_blank() {
+        while (pos < src.size()) {
+            char c = src[pos];
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v') {
+                advance();
+            } else if (c == '/' && pos + 1 < src.size() && src[pos + 1] == '/') {
+                while (pos < src.size() && src[pos] != '\n')
+                    advance();
+            } else if (c == '/' && pos + 1 < src.size() && src[pos + 1] == '*') {
+                int l = line, cl = col;
+                advance();
+                advance();
+                while (pos + 1 < src.size() && !(src[pos] == '*' && src[pos + 1] == '/'))
+                    advance();
+                if (pos + 1 >= src.size())
+                    error(l, cl, "unterminated comment");
+                advance();
+                advance();
+            } else {
+                break;
+            }
+        }
+    }
+
+public:
+    Lexer(const string &src) : src(src) {}
+
+    static void error(int line, int col, const string &msg) {
+        throw_error(std::to_string(line) + ":" + std::to_string(col) + ": " + msg);
+    }
+
+    Token next() {
+        skip_blank();
+        Token tok;
+        tok.line = line;
+        tok.col = col;
+        tok.numeric = false;
+        if (pos >= src.size()) {
+            tok.kind = TOK_EOF;
+            return tok;
+        }
+        char c = src[pos];
+        if (is_word_char(c)) {
+            size_t start = pos;
+            bool digits = true;
+            while (pos < src.size() && is_word_char(src[pos])) {
+                if (src[pos] < '0' || src[pos] > '9')
+                    digits = false;
+                advance();
+            }
+            tok.kind = TOK_WORD;
+            tok.text.assign(src, start, pos - start);
+            tok.numeric = digits;
+            return tok;
+        }
+        switch (c) {
+            case '.': tok.kind = TOK_DOT; break;
+            case '(': tok.kind = TOK_LPAREN; break;
+            case ')': tok.kind = TOK_RPAREN; break;
+            case ',': tok.kind = TOK_COMMA; break;
+            case '@': tok.kind = TOK_AT; break;
+            case '<': tok.kind = TOK_LT; break;
+            default:
+                error(line, col, string("unexpected character '") + c + "'");
+        }
+        tok.text.assign(1, c);
+        advance();
+        return tok;
+    }
+
+    vector<Token> tokenize() {
+        vector<Token> toks;
+        toks.reserve(src.size() / 4 + 1);
+        do {
+            toks.push_back(next());
+        } while (toks.back().kind != TOK_EOF);
+        return toks;
+    }
+};
+
+#endif // _LEXER_H
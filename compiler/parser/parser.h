@@ -0,0 +1,226 @@
+#ifndef _DSL_PARSER_H
+#define _DSL_PARSER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "lexer.h"
+#include "../utils/arena.h"
+#include "../utils/log.h"
+#include "../operators/op.h"
+#include "../operators/kernel.h"
+#include "../operators/traverse.h"
+#include "../operators/in.h"
+#include "../operators/iter.h"
+#include "../operators/values.h"
+#include "../operators/end.h"
+#include "../operators/asser.h"
+#include "../operators/rebase.h"
+#include "../utils/colors.h"
+
+using namespace std;
+
+/**
+ * Recursive descent parser for the policy DSL:
+ *
+ *   policy    := stmt*
+ *   stmt      := "KernelGraph" "(" word ")"
+ *              | "End"
+ *              | "." primitive "(" args ")"
+ *   primitive := traverse | in | iter | values | assert | rebase
+ *
+ * Ops are built in a single pass over the token stream and live in the
+ * given arena.
+ */
+class Parser {
+private:
+    vector<Token> toks;
+    size_t cur = 0;
+    Arena &arena; // owns the ops built by the parser
+    bool verbose;
+
+    const Token& peek() { return toks[cur]; }
+
+    void error(const Token &tok, const string &msg) {
+        string got = tok.kind == TOK_EOF ? string("end of input") : "'" + tok.text + "'";
+        Lexer::error(tok.line, tok.col, msg + ", got " + got);
+    }
+
+    const Token& expect(TokenKind kind, const char *what) {
+        const Token &tok = toks[cur];
+        if (tok.kind != kind)
+            error(tok, string("expected ") + what);
+        cur++;
+        return tok;
+    }
+
+    const string& word(const char *what) {
+        return expect(TOK_WORD, what).text;
+    }
+
+    const string& number(const char *what) {
+        const Token &tok = toks[cur];
+        if (tok.kind != TOK_WORD || !tok.numeric)
+            error(tok, string("expected ") + what);
+        cur++;
+        return tok.text;
+    }
+
+    bool accept(TokenKind kind) {
+        if (toks[cur].kind != kind)
+            return false;
+        cur++;
+        return true;
+    }
+
+    void trace(const char *what, const Token &tok) {
+        if (verbose) {
+            LOG(LOG_DEBUG) << "> Processing " << what << " primitive at line " << blue << tok.line << reset << endl;
+        }
+    }
+
+public:
+    Parser(const string &src, Arena &arena, bool verbose = true) : arena(arena), verbose(verbose) {
+        Lexer lexer(src);
+        this->toks = lexer.tokenize();
+    }
+
+    vector<Op*> parse() {
+        vector<Op*> ops;
+        while (peek().kind != TOK_EOF)
+            ops.push_back(parse_statement());
+        return ops;
+    }
+
+    Op* parse_statement() {
+        const Token &tok = peek();
+        Op *op = nullptr;
+        if (tok.kind == TOK_WORD && tok.text == "KernelGraph") {
+            trace("a KernelGraph", tok);
+            cur++;
+            op = parse_kernelgraph();
+        } else if (tok.kind == TOK_WORD && tok.text == "End") {
+            trace("the last", tok);
+            cur++;
+            op = arena.make<End>();
+        } else if (tok.kind == TOK_DOT) {
+            cur++;
+            const Token &name = expect(TOK_WORD, "primitive name after '.'");
+            if (name.text == "traverse") {
+                trace("a traverse", name);
+                op = parse_traverse();
+            } else if (name.text == "in") {
+                trace("an in", name);
+                op = parse_in();
+            } else if (name.text == "iter") {
+                trace("an iter", name);
+                op = parse_iter();
+            } else if (name.text == "values") {
+                trace("a values", name);
+                op = parse_values();
+            } else if (name.text == "assert") {
+                trace("an Assert", name);
+                op = parse_asser();
+            } else if (name.text == "rebase") {
+                trace("a rebase", name);
+                expect(TOK_LPAREN, "'(' after rebase");
+                expect(TOK_RPAREN, "')' after rebase");
+                op = arena.make<Rebase>();
+            } else {
+                cur--;
+                error(name, "unknown primitive");
+            }
+        } else {
+            error(tok, "expected a statement");
+        }
+        if (verbose) {
+            LOG_IF(LOG_TRACE) op->print();
+        }
+        return op;
+    }
+
+    // KernelGraph(root)
+    KernelGraph* parse_kernelgraph() {
+        expect(TOK_LPAREN, "'(' after KernelGraph");
+        KernelGraph *kg = arena.make<KernelGraph>();
+        kg->set_root(word("kernel graph root"));
+        expect(TOK_RPAREN, "')' after kernel graph root");
+        return kg;
+    }
+
+    // .traverse(next_offset, end_addr, type_offset)
+    Traverse* parse_traverse() {
+        expect(TOK_LPAREN, "'(' after traverse");
+        Traverse *traverse = arena.make<Traverse>();
+        traverse->set_offset(number("next offset"));
+        expect(TOK_COMMA, "',' after next offset");
+        traverse->set_end(word("end address"));
+        expect(TOK_COMMA, "',' after end address");
+        traverse->set_type(number("type offset"));
+        expect(TOK_RPAREN, "')' after traverse arguments");
+        return traverse;
+    }
+
+    // .in(offset) or .in(offset, @type, var)
+    In* parse_in() {
+        expect(TOK_LPAREN, "'(' after in");
+        In *in = arena.make<In>();
+        in->set_offset(word("in offset"));
+        if (accept(TOK_COMMA)) {
+            expect(TOK_AT, "'@' before in type");
+            in->set_dec(true);
+            in->set_type(word("in type"));
+            expect(TOK_COMMA, "',' after in type");
+            in->set_var(word("in variable"));
+        }
+        expect(TOK_RPAREN, "')' after in arguments");
+        return in;
+    }
+
+    // .iter(offset, steps, size), steps is either a constant or a name
+    // bound by a previous .values(@name, offset)
+    Iter* parse_iter() {
+        expect(TOK_LPAREN, "'(' after iter");
+        Iter *iter = arena.make<Iter>();
+        iter->set_offset(word("iter offset"));
+        expect(TOK_COMMA, "',' after iter offset");
+        const Token &steps = expect(TOK_WORD, "iter steps");
+        iter->set_sstep(steps.text);
+        iter->set_dynamic(steps.numeric ? 0 : 1);
+        expect(TOK_COMMA, "',' after iter steps");
+        iter->set_size(word("iter entry size"));
+        expect(TOK_RPAREN, "')' after iter arguments");
+        return iter;
+    }
+
+    // .values(f1, f2, ...) or .values(@name, offset)
+    Values* parse_values() {
+        expect(TOK_LPAREN, "'(' after values");
+        Values *vs = arena.make<Values>();
+        if (accept(TOK_AT)) {
+            vs->set_name(word("values name"));
+            expect(TOK_COMMA, "',' after values name");
+            vs->add_field(word("values field"));
+        } else {
+            vs->add_field(word("values field"));
+            while (accept(TOK_COMMA))
+                vs->add_field(word("values field"));
+        }
+        expect(TOK_RPAREN, "')' after values fields");
+        return vs;
+    }
+
+    // .assert(high, low)
+    Asser* parse_asser() {
+        expect(TOK_LPAREN, "'(' after assert");
+        Asser *asser = arena.make<Asser>();
+        asser->set_high(word("assert high bound"));
+        expect(TOK_COMMA, "',' after assert high bound");
+        asser->set_low(word("assert low bound"));
+        expect(TOK_RPAREN, "')' after assert bounds");
+        return asser;
+    }
+};
+
+#endif // _DSL_PARSER_H
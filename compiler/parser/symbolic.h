@@ -0,0 +1,336 @@
+#ifndef _SYMBOLIC_H
+#define _SYMBOLIC_H
+
+#include <string>
+#include <vector>
+
+#include "lexer.h"
+#include "layout.h"
+
+using namespace std;
+
+/**
+ * Symbolic policy DSL, as in raw_policy/policy_pool.dsl, resolved against
+ * a KernelLayout into the DSL with concrete offsets the Parser reads:
+ *
+ *   kgraph(init_task)                                KernelGraph(init_task)
+ *   .traverse(tasks.next, init_task.tasks, task_struct)  .traverse(1960, 0xffff..., 1960)
+ *   .values(pid)                                     .values(2216)
+ *   .in(files)                                       .in(2704)
+ *   .in(fdt)                                         .in(32)
+ *   .values(max_fds)                                 .values(@max_fds, 0)
+ *   .in(fd)                                          .in(8)
+ *   .iterate(this, max_fds, ptr)                     .iter(0, max_fds, 8)
+ *   ...                                              ...
+ *                                                    End
+ *
+ * Field paths are resolved from the struct the policy is at: the root of
+ * kgraph(), the target of the last .in() or .iterate(), or the struct
+ * named by .in(field, @struct type, @member). .in(this) dereferences the
+ * pointer the policy is at once more. The .values() right before a
+ * .iterate() over a field read at run time binds its name, as
+ * front_parser.py did. Every kgraph() starts a policy of its own. Works on
+ * the text, so that the output compiles, caches, fuses and links like any
+ * other policy.
+ */
+class SymbolicDsl {
+private:
+    typedef vector<Token> Arg;
+
+    struct Line {
+        string text;                   // the numeric statement, but for .values
+        bool values = false;
+        vector<pair<string, int> > fields; // name (last path component) and offset of each .values field
+        string bound;                  // name a dynamic .iterate bound the .values to
+        string steps;                  // of a dynamic .iterate
+        const Token *at = nullptr;
+    };
+
+    const KernelLayout &layout;
+    vector<Token> toks;
+    size_t cur = 0;
+    string type; // struct the policy is at
+    int pointer = 0; // dereferences left to reach it
+    vector<Line> lines;
+    vector<string> out;
+
+    static void error(const Token &tok, const string &msg) {
+        Lexer::error(tok.line, tok.col, msg);
+    }
+
+    const Token& expect(TokenKind kind, const char *what) {
+        const Token &tok = this->toks[this->cur];
+        if (tok.kind != kind)
+            error(tok, string("expected ") + what);
+        this->cur++;
+        return tok;
+    }
+
+    // arguments of a primitive, split at the commas
+    vector<Arg> args(const Token &name) {
+        expect(TOK_LPAREN, "'(' after the primitive name");
+        vector<Arg> list(1);
+        while (this->toks[this->cur].kind != TOK_RPAREN) {
+            const Token &tok = this->toks[this->cur++];
+            if (tok.kind == TOK_EOF || tok.kind == TOK_LPAREN)
+                error(tok, "expected ')' to close ." + name.text + "(");
+            if (tok.kind == TOK_COMMA)
+                list.emplace_back();
+            else
+                list.back().push_back(tok);
+        }
+        this->cur++;
+        for (const Arg &a: list)
+            if (a.empty())
+                error(name, "empty argument of ." + name.text + "()");
+        return list;
+    }
+
+    // word.word... as its words
+    static vector<string> path(const Arg &a) {
+        vector<string> words;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i].kind != (i % 2 ? TOK_DOT : TOK_WORD))
+                error(a[i], "expected a field path");
+            if (a[i].kind == TOK_WORD)
+                words.push_back(a[i].text);
+        }
+        if (a.back().kind != TOK_WORD)
+            error(a.back(), "expected a field path");
+        return words;
+    }
+
+    static string joined(const Arg &a) {
+        string s;
+        for (const string &w: path(a))
+            s += (s.empty() ? "" : ".") + w;
+        return s;
+    }
+
+    static bool is_this(const Arg &a) { return a.size() == 1 && a[0].text == "this"; }
+
+    // offset of the path from the current struct, the field it ends in into last
+    int resolve(const Arg &a, LayoutField &last) {
+        int offset = 0;
+        string at = this->type;
+        for (const string &w: path(a)) {
+            const LayoutField *f = this->layout.find(at, w);
+            if (!f)
+                error(a[0], "struct " + at + " has no field " + w);
+            offset += f->offset;
+            last = *f;
+            at = f->type;
+        }
+        return offset;
+    }
+
+    int size_of(const Token &at, const string &type) {
+        int size = this->layout.size_of(type);
+        if (size < 0)
+            error(at, "struct " + type + " has no size in the layout");
+        return size;
+    }
+
+    void arity(const Token &name, const vector<Arg> &list, size_t n) {
+        if (list.size() != n)
+            error(name, "." + name.text + "() takes " + to_string(n) + " arguments");
+    }
+
+    void kgraph(const Token &kw) {
+        this->finish();
+        expect(TOK_LPAREN, "'(' after kgraph");
+        const Token &root = expect(TOK_WORD, "kgraph root");
+        expect(TOK_RPAREN, "')' after kgraph root");
+        this->type = this->layout.root(root.text);
+        if (this->type.empty())
+            error(root, root.text + " is no entry point of the layout");
+        this->pointer = 0;
+        this->line("KernelGraph(" + root.text + ")", kw);
+    }
+
+    void traverse(const Token &name, const vector<Arg> &list) {
+        arity(name, list, 3);
+        LayoutField next;
+        int offset = this->resolve(list[0], next);
+        string end = this->layout.variable(joined(list[1]));
+        if (end.empty())
+            error(list[1][0], joined(list[1]) + " is no runtime variable of the layout");
+        // the list head sits inside the element unless next points at the element itself
+        int head = next.type != joined(list[2]) ? offset : 0;
+        this->line(".traverse(" + to_string(offset) + ", " + end + ", " + to_string(head) + ")", name);
+    }
+
+    void iterate(const Token &name, const vector<Arg> &list) {
+        arity(name, list, 3);
+        const Token &steps = list[1][0];
+        if (list[1].size() != 1 || steps.kind != TOK_WORD)
+            error(steps, "expected an entry count or the name of a .values");
+        int size = this->size_of(list[2][0], joined(list[2]));
+        int offset = 0;
+        if (!is_this(list[0])) { // an array inside the struct
+            LayoutField last;
+            offset = this->resolve(list[0], last);
+            this->type = last.type;
+            this->pointer = last.pointer;
+        }
+        this->line(".iter(" + to_string(offset) + ", " + steps.text + ", " + to_string(size) + ")", name);
+        if (!steps.numeric)
+            this->lines.back().steps = steps.text;
+    }
+
+    void values(const Token &name, const vector<Arg> &list) {
+        Line l;
+        l.values = true;
+        l.at = &name;
+        for (const Arg &a: list) {
+            if (is_this(a)) {
+                l.fields.push_back(make_pair(string("this"), 0));
+                continue;
+            }
+            LayoutField last;
+            int offset = this->resolve(a, last);
+            l.fields.push_back(make_pair(path(a).back(), offset));
+        }
+        this->lines.push_back(l);
+    }
+
+    void in(const Token &name, const vector<Arg> &list) {
+        if (list.size() != 1 && list.size() != 3)
+            error(name, ".in() takes a field, or a field, @struct type and @member");
+        if (is_this(list[0])) {
+            if (list.size() != 1 || this->pointer <= 0)
+                error(name, ".in(this) needs the policy at a pointer to dereference");
+            this->pointer--;
+            this->line(".in(0)", name);
+            return;
+        }
+        LayoutField last;
+        int offset = this->resolve(list[0], last);
+        if (list.size() == 1) {
+            if (last.pointer < 1)
+                error(list[0][0], joined(list[0]) + " is not a pointer");
+            this->type = last.type;
+            this->pointer = last.pointer - 1;
+            this->line(".in(" + to_string(offset) + ")", name);
+            return;
+        }
+        // .in(field, @struct type, @member): the pointer leads to member inside a type
+        const Arg &st = list[1], &member = list[2];
+        if (st.size() != 3 || st[0].kind != TOK_AT || st[1].text != "struct" || st[2].kind != TOK_WORD)
+            error(st[0], "expected @struct type");
+        if (member.size() != 2 || member[0].kind != TOK_AT || member[1].kind != TOK_WORD)
+            error(member[0], "expected @member");
+        const LayoutField *m = this->layout.find(st[2].text, member[1].text);
+        if (!m)
+            error(member[1], "struct " + st[2].text + " has no field " + member[1].text);
+        this->type = st[2].text;
+        this->pointer = 0;
+        this->line(".in(" + to_string(offset) + ", @0, " + to_string(m->offset) + ")", name);
+    }
+
+    // kernel addresses of the bounds keep their low 32 bits, as the switch compares them
+    static string bound(const Token &b) {
+        if (b.kind != TOK_WORD || b.text.compare(0, 2, "0x") != 0)
+            error(b, "expected a hex address bound");
+        return b.text.size() == 18 ? "0x" + b.text.substr(10) : b.text;
+    }
+
+    void assertion(const Token &name, const vector<Arg> &list) {
+        arity(name, list, 1);
+        const Arg &a = list[0];
+        if (a.size() != 5 || a[1].kind != TOK_LT || a[3].kind != TOK_LT || a[2].kind != TOK_WORD)
+            error(a[0], "expected .assert(bound<field<bound)");
+        this->line(".assert(" + bound(a[0]) + ", " + bound(a[4]) + ")", name);
+    }
+
+    void line(const string &text, const Token &at) {
+        Line l;
+        l.text = text;
+        l.at = &at;
+        this->lines.push_back(l);
+    }
+
+    // bind the .values read before each dynamic .iterate, then close the policy with End
+    void finish() {
+        if (this->lines.empty())
+            return;
+        for (size_t i = 0; i < this->lines.size(); i++) {
+            if (this->lines[i].steps.empty())
+                continue;
+            Line *v = i >= 1 && this->lines[i-1].values ? &this->lines[i-1] :
+                      i >= 2 && this->lines[i-2].values ? &this->lines[i-2] : nullptr;
+            if (!v || v->fields[0].first != this->lines[i].steps)
+                error(*this->lines[i].at, "no .values(" + this->lines[i].steps + ") right before the .iterate");
+            v->bound = this->lines[i].steps;
+        }
+        string text;
+        for (const Line &l: this->lines) {
+            if (!l.values) {
+                text += l.text + "\n";
+                continue;
+            }
+            if (!l.bound.empty()) {
+                text += ".values(@" + l.bound + ", " + to_string(l.fields[0].second) + ")\n";
+                continue;
+            }
+            text += ".values(";
+            for (size_t f = 0; f < l.fields.size(); f++)
+                text += (f ? ", " : "") + to_string(l.fields[f].second);
+            text += ")\n";
+        }
+        this->out.push_back(text + "End\n");
+        this->lines.clear();
+    }
+
+    SymbolicDsl(const string &text, const KernelLayout &layout) : layout(layout) {
+        Lexer lexer(text);
+        this->toks = lexer.tokenize();
+    }
+
+    vector<string> run() {
+        while (this->toks[this->cur].kind != TOK_EOF) {
+            const Token &tok = this->toks[this->cur++];
+            if (tok.kind == TOK_WORD && tok.text == "kgraph") {
+                this->kgraph(tok);
+                continue;
+            }
+            if (tok.kind != TOK_DOT)
+                error(tok, "expected kgraph or a primitive");
+            if (this->lines.empty())
+                error(tok, "a policy starts with kgraph");
+            const Token &name = expect(TOK_WORD, "primitive name after '.'");
+            vector<Arg> list = this->args(name);
+            if (name.text == "traverse")
+                this->traverse(name, list);
+            else if (name.text == "iterate")
+                this->iterate(name, list);
+            else if (name.text == "values")
+                this->values(name, list);
+            else if (name.text == "in")
+                this->in(name, list);
+            else if (name.text == "assert")
+                this->assertion(name, list);
+            else
+                error(name, "unknown symbolic primitive");
+        }
+        this->finish();
+        return this->out;
+    }
+
+public:
+    // whether text is symbolic, starts with kgraph() rather than KernelGraph()
+    static bool is_symbolic(const string &text) {
+        Lexer lexer(text);
+        Token first = lexer.next();
+        return first.kind == TOK_WORD && first.text == "kgraph";
+    }
+
+    // the policies of text with concrete offsets, one per kgraph()
+    static vector<string> translate(const string &text, const KernelLayout &layout) {
+        SymbolicDsl dsl(text, layout);
+        return dsl.run();
+    }
+};
+
+
+#endif // _SYMBOLIC_H
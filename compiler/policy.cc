@@ -1,21 +1,39 @@
 #include "policy.h"
+#include <sstream>
+#include <algorithm>
+#include <functional>
 #include "utils/utils.h"
 #include "utils/colors.h"
 
+thread_local uint64_t heap_allocs = 0;
+
 Policy::Policy(string input_file, int qpn_s, int qpn_r, int num, int base) {
     ifstream infile(input_file.c_str());
     assert(infile.is_open());
-    cout << "reading from file " + input_file <<endl;
+    LOG(LOG_DEBUG) << "reading from file " + input_file <<endl;
     // read file
+    stringstream text;
+    text << infile.rdbuf();
+    this->load(text.str(), qpn_s, qpn_r, num, base);
+}
+
+// take the policy from its DSL text, the constructor reads it from a file
+void Policy::load(const string &text, int qpn_s, int qpn_r, int num, int base) {
+    stringstream infile(text);
     string l;
-    regex r ("//.*|/\\*.*\\*/");
     while (getline(infile, l)) {
-        if (l.empty()) //empty line
+        this->source += l;
+        this->source += '\n';
+        string t = l;
+        trim(t);
+        if (t.empty()) //empty line
             continue;
-        if (regex_match(l,r)) //comment line
+        if (t.compare(0, 2, "//") == 0) //comment line
+            continue;
+        if (t.compare(0, 2, "/*") == 0 && t.size() >= 4 && t.compare(t.size() - 2, 2, "*/") == 0)
             continue;
         this->lines.push_back(l);
-        cout<<l<<endl;
+        LOG(LOG_TRACE) << l << endl;
     }
 
     //parse policy type
@@ -27,285 +45,148 @@ Policy::Policy(string input_file, int qpn_s, int qpn_r, int num, int base) {
     //this->base_state = qpn_s + 1; // basic QPN used for checking idx
     this->base_state = base + 1;
     this->qpn_tran_coef = qpn_r - qpn_s;
-    cout << "coeff is "  << this->qpn_tran_coef << (qpn_r - qpn_s)  <<endl;
-    this->fake_state = 0 + 20 * num;   // handle multi-task
-                                     // used for specifying QPN key for re-entering loop
+    LOG(LOG_DEBUG) << "coeff is "  << this->qpn_tran_coef << (qpn_r - qpn_s)  <<endl;
+    this->set_reg_bases(TASK_STRIDE[RF_FAKE] * num, TASK_STRIDE[RF_STACK] * num, TASK_STRIDE[RF_REG] * num); // handle multi-task
     this->end_state.set_qpn(998 - num); // end state doesn not need QPN_TRAN
     this->end_state.set_dqpn(999 - num);
+    this->drop_state = this->end_state; // exit of the outermost loop
     this->task_nr = num; //  multi-task
     // last state will use md.qpn(after QPN_TRAN)
 }
 
 /**
- * Extract supported operators from lines after the first line
+ * Tokenize the whole policy once and build the operators with the
+ * recursive descent parser. Errors carry the line and column.
  */
 void Policy::parse() {
-    string delim(30,'=');
-    for (int i = 0; i < lines.size(); i ++) {
-        string cur_line = trim(lines[i]);
-        if (0 == cur_line.rfind(".traverse")) {
-            cout << "> Processing a traverse primitive: " << blue << cur_line << reset << endl;
-            Traverse *t = parse_traverse(cur_line);
-            this->ops.push_back(t);
-        } else if (0 == cur_line.rfind(".in")) {
-            cout << "> Processing an in primitive: " << blue << cur_line << reset << endl;
-            In *in = parse_in(cur_line);
-            this->ops.push_back(in);
-        } else if (0 == cur_line.rfind(".iter")) {
-            cout << "> Processing an iter primitive: " << blue << cur_line << reset << endl;
-            Iter *i = parse_iter(cur_line);
-            this->ops.push_back(i);
-        } else if (0 == cur_line.rfind(".values")) {
-            cout << "> Processing a values primitive: " << blue << cur_line << reset << endl;
-            Values *vs = parse_values(cur_line);
-            this->ops.push_back(vs);
-        } else if (0 == cur_line.rfind("KernelGraph")) {
-            cout << "> Processing a KernelGraph primitive: " << blue << cur_line << reset << endl;
-            KernelGraph *kg = parse_kernelgraph(cur_line);
-            this->ops.push_back(kg);
-        } else if (0 == cur_line.rfind(".assert")){
-            cout << "> Processing an Assert primitive: " << blue << cur_line << reset << endl;
-            Asser* asser = parse_asser(cur_line);
-            this->ops.push_back(asser);
-        } else if (0 == cur_line.rfind("End")) {
-            cout << "> Processing the last primitive inside the above policy: " << blue << cur_line << reset << endl;
-            End *ed = parse_end(cur_line);
-            this->ops.push_back(ed);
-        }
-          else {
-            cout << "> Current line: " << red << cur_line << reset <<endl;
-            throw_error("Cannot recognize line the operator!");
-        }
-    }
-}
-
-KernelGraph* Policy::parse_kernelgraph(string line)
-{
-    regex reg_kg("KernelGraph\\s*\\((\\w+)\\)");
-    if (!std::regex_match(line.begin(), line.end(), reg_kg)) {
-        throw_error("Invalid kernelgraph statement");
-    }
-
-    smatch match;
-    KernelGraph* kg = new KernelGraph();
-    // extract the root
-    if (regex_search(line, match, reg_kg)) {
-        kg->set_root(match.str(1));
-        // TODO: There are more things to do---Need to build the kernel graph.
-    } else {
-        throw_error("Invalid kernelgraph statement: Could not find the root");
-    }
-
-    kg->print();
-    return kg;
-}
-
-End* Policy::parse_end(string line)
-{
-    regex reg_kg("End");
-    if (!std::regex_match(line.begin(), line.end(), reg_kg)) {
-        throw_error("Invalid kernelgraph statement");
-    }
-    End *ed = new End();
-    ed->print();
-    return ed;
-}
-
-Traverse* Policy::parse_traverse(string line) {
-//    regex reg_t("\\.traverse\\s*\\((\\w+,\\s*&\\w+\\.\\w+,\\s*\\w+\\.\\w+)\\)");
-    regex reg_t("\\.traverse\\s*\\((\\d+,\\s*\\w+,\\s*\\d+)\\)");
-    if (!std::regex_match(line.begin(), line.end(), reg_t)) {
-        throw_error("Invalid traverse statement");
-    }
-
-    smatch match;
-    regex sreg_t("\\.traverse\\s*\\((\\w+),\\s*(\\w+),\\s*(\\w+)\\)");
-    Traverse *traverse = new Traverse();
-    if (regex_search(line, match, sreg_t)) {
-        traverse->set_offset(match.str(1));
-        traverse->set_end(match.str(2));
-        traverse->set_type(match.str(3));
-    } else {
-        throw_error("Invalid traverse statement");
-    }
-
-    traverse->print();
-    return traverse;
-}
-
-In* Policy::parse_in(string line)
-{
-    regex reg_in(".in\\s*\\((\\w+)\\)");
-    regex reg_dec(".in\\s*\\((\\w+),\\s*@(\\w+),\\s*(\\w+)\\)");// offset,type,var
-    if (!std::regex_match(line.begin(), line.end(), reg_in)
-            &&!std::regex_match(line.begin(), line.end(), reg_dec)) {
-        throw_error("Invalid in statement");
-    }
-    smatch match;
-    In* in = new In();
-    // extract the field
-    if (regex_search(line, match, reg_in)) {
-        in->set_offset(match.str(1));
-        // TODO: There are more things to do---Need to build the kernel graph.
-    }
-    else if (regex_search(line, match, reg_dec)) {
-        printf("hello!\n");
-        in->set_offset(match.str(1));
-        in->set_dec(true);
-        in->set_type(match.str(2));
-        in->set_var(match.str(3));
-    } 
-    else {
-        throw_error("Invalid in statement: Could not find the field");
-    }
-
-    in->print();
-    return in;
+    PhaseScope scope(this->profile, PH_PARSE, this->arena);
+    Parser parser(this->source, this->arena);
+    this->ops = parser.parse();
 }
 
-Iter* Policy::parse_iter(string line) {
-    regex reg_fixed("\\.iter\\s*\\(\\w+,\\s*\\d+,\\s*\\w+\\)");
-    regex reg_dynamic("\\.iter\\s*\\(\\w+,\\s*\\w+,\\s*\\w+\\)");
-    if (!std::regex_match(line.begin(), line.end(), reg_dynamic)
-            && !std::regex_match(line.begin(), line.end(), reg_fixed)) {
-        throw_error("Invalid iter statement");
-    }
-
-    smatch match;
-    regex sreg_dynamic("\\.iter\\s*\\((\\w+),\\s*(\\w+),\\s*(\\w+)\\)");
-    regex sreg_fixed("\\.iter\\s*\\((\\w+),\\s*(\\d+),\\s*(\\w+)\\)");
-    Iter *iter = new Iter();
-    if (regex_search(line, match, sreg_fixed)){
-        iter->set_offset(match.str(1));
-        iter->set_sstep(match.str(2));
-        iter->set_size(match.str(3));
-        iter->set_dynamic(0);
-    }
-    else if (regex_search(line, match, sreg_dynamic)) {
-        iter->set_offset(match.str(1));
-        iter->set_sstep(match.str(2));
-        iter->set_size(match.str(3));
-        iter->set_dynamic(1);
-    } 
-    else {
-        throw_error("Invalid iter statement");
+/**
+ * QPN states, fake states and registers the policy takes, counted from
+ * the ops the way frontend_compile() and gen_pgt_walk_aim() hand them
+ * out. Needs mark_iter() and mark_assert() to have run.
+ */
+Footprint Policy::footprint(){
+    Footprint fp;
+    int enclosing = -1; // kind of the loop the next loop is nested in, -1 for none
+    for (int i = 0; i < this->ops.size(); i++){
+        Op* op = this->ops[i];
+        switch (op->get_kind()){
+            case OP_KERNELGRAPH:
+            case OP_IN:
+                fp.qpns++;
+                break;
+            case OP_TRAVERSE:
+            case OP_ITER:
+                if (op->get_kind() == OP_TRAVERSE)
+                    fp.qpns += 2; // Move(next) and the recirculation load
+                else {
+                    fp.qpns++; // recirculation load
+                    fp.regs++;
+                }
+                fp.fake_states++;
+                fp.stack++; // pushes the base of the loop
+                // optimize_aims() threads the exit into the drop state or an enclosing traverse,
+                // but for an iter right after a traverse, whose exit is in the state of the traverse
+                if (this->peephole && (enclosing == -1 || enclosing == OP_TRAVERSE) &&
+                        !(op->get_kind() == OP_ITER && i > 0 && this->ops[i-1]->get_kind() == OP_TRAVERSE))
+                    fp.qpns--;
+                enclosing = op->get_kind();
+                break;
+            case OP_VALUES:
+                if (((Values *)op)->get_regnr() != -1)
+                    fp.qpns++; // one load into the iter register
+                else
+                    fp.qpns += this->value_windows((Values *)op).size(); // one load per field or window
+                break;
+            case OP_REBASE:
+                fp.fake_states++; // the previous body ends in it
+                break;
+            default:
+                break;
+        }
     }
-
-    iter->print();
-    return iter;
+    fp.qpns += 4; // page table walk
+    fp.stack++; // the base of the object outside any loop
+    return fp;
 }
 
-Values* Policy::parse_values(string line) {
-    // regex reg_check("\\.values\\s*\\(\\w+(,\\s*\\w+)*@\\s*(\\w+)\\)");
-    regex reg_clone("\\.values\\s*\\(\\w+(,\\s*\\w+)*\\)");
-    regex reg_fd("\\.values\\s*\\(@\\w+,\\s*\\w+\\)");
-//    regex reg_vs("\\.values\\s*\\(\\w+(,\\s*\\w+)*@\\s*\\w+\\)");
-// !std::regex_match(line.begin(), line.end(), reg_check) // we no longer use reg_check
-    if (!std::regex_match(line.begin(), line.end(), reg_clone)
-            && !std::regex_match(line.begin(), line.end(), reg_fd)) {
-        throw_error("Invalid values statement");
-    }
-
-    smatch match;
-    // regex sreg_check("\\.values\\s*\\((\\w+(,\\s*\\w+)*)@\\s*(\\w+)\\)");
-    regex sreg_clone("\\.values\\s*\\((\\w+(,\\s*\\w+)*)\\)");
-    regex sreg_fd("\\.values\\s*\\(@(\\w+),\\s*(\\w+)\\)");
-    Values *vs = new Values();
-    // if (regex_search(line, match, sreg_check)) {
-    //     vs->set_smtbit(match.str(3));
-    //     vector<string> s_fields = split(match.str(1), ",");
-    //     for (string field: s_fields)
-    //         vs->add_field(field);
-    // }
-    if(regex_search(line, match, sreg_clone)){
-        //vs->set_smtbit(to_string(0);
-        vector<string> s_fields = split(match.str(1), ",");
-        for (string field: s_fields)
-            vs->add_field(field);
-    } else if(regex_search(line, match, sreg_fd)){
-        vs->set_name(match.str(1));
-        vs->add_field(match.str(2));
-    } else {
-        throw_error("Invalid values statement");
-    }
-
-    vs->print();
-    return vs;
+void Policy::set_qpn_base(int qpn_s){
+    this->avail_state = qpn_s;
+    this->first_state = qpn_s;
 }
 
-Asser* Policy::parse_asser(string line) {
-//    regex reg_t("\\.traverse\\s*\\((\\w+,\\s*&\\w+\\.\\w+,\\s*\\w+\\.\\w+)\\)");
-    regex reg_t("\\.assert\\s*\\((\\s*\\w+,\\s*\\w+)\\)");
-    if (!std::regex_match(line.begin(), line.end(), reg_t)) {
-        throw_error("Invalid traverse statement");
-    }
-
-    smatch match;
-    regex sreg_t("\\.assert\\s*\\(\\s*(\\w+),\\s*(\\w+)\\)");
-    Asser *asser = new Asser();
-    if (regex_search(line, match, sreg_t)) {
-        asser->set_high(match.str(1));
-        asser->set_low(match.str(2));
-    } else {
-        throw_error("Invalid assert statement");
+// iter registers mark_iter() handed out already move along with reg
+void Policy::set_reg_bases(int fake, int stack, int reg){
+    for (Op* op: this->ops){
+        if (op->get_kind() == OP_ITER && ((Iter *)op)->get_seq() != -1)
+            ((Iter *)op)->set_seq(((Iter *)op)->get_seq() - this->reg_base + reg);
+        if (op->get_kind() == OP_VALUES && ((Values *)op)->get_regnr() != -1)
+            ((Values *)op)->set_regnr(((Values *)op)->get_regnr() - this->reg_base + reg);
     }
-
-    asser->print();
-    return asser;
+    this->fake_base = fake;
+    this->fake_state = fake; // used for specifying QPN key for re-entering loop
+    this->stack_base = stack;
+    this->reg_base = reg;
 }
 
 void Policy::gen_pgt_walk_aim(){
-    cout << "Generating page table walk AIM" << endl;
+    PhaseScope scope(this->profile, PH_PGT_WALK_AIM, this->arena);
+    LOG(LOG_DEBUG) << "Generating page table walk AIM" << endl;
     // 4 level page table walk
     int i = 0;
     for (i = 0; i< 4; i++){
-        ReadLoad * rload = new ReadLoad(0);
+        ReadLoad * rload = this->arena.make<ReadLoad>(0);
         rload->set_post_qpn(this->avail_state);
         this->avail_state++;
         pgt_aims.push_back(rload);
-        rload->print();
+        LOG_IF(LOG_TRACE) rload->print();
     }
 }
 
 // Iter through OPs for collecting dynamic iter informations
 void Policy::mark_iter(){
-    cout << "Modifying iter, total " << this->ops.size() << " Checking iter" << endl;
-    int seq = 0 + 3 * this->task_nr;  // isolate registers 
+    PhaseScope scope(this->profile, PH_MARK_ITER, this->arena);
+    LOG(LOG_DEBUG) << "Modifying iter, total " << this->ops.size() << " Checking iter" << endl;
+    int seq = this->reg_base;  // isolate registers 
     for (int i = 0; i < this->ops.size(); i++){
-        if (this->ops.at(i)->get_op_name() == "Iter" ){
+        if (this->ops.at(i)->get_kind() == OP_ITER ){
             Iter* itr = (Iter *)(this->ops.at(i));
             //printf("i is %d, dynamic is %d, name is \n", i, itr->get_dynamic());
             if (!itr->get_dynamic()){
-                cout << "checking const iter" << endl;
+                LOG(LOG_DEBUG) << "checking const iter" << endl;
                 itr->set_seq(seq);
-                cout << "const iter is modified" << endl;
-                itr->print();
+                LOG(LOG_DEBUG) << "const iter is modified" << endl;
+                LOG_IF(LOG_TRACE) itr->print();
                 seq++;
                 continue; // const entry number in iter
             }
             // check the dynamically allocated iter
-            if  (this->ops.at(i-1)->get_op_name()=="Values"){
+            if  (this->ops.at(i-1)->get_kind() == OP_VALUES){
                 Values* val = (Values *)(this->ops.at(i-1));
                 if (val->get_name() == itr->get_sstep()){
                     val->set_regnr(seq);
                     itr->set_seq(seq);
-                    cout << "dynamic iter is modified" << endl;
-                    val->print();
-                    itr->print();
+                    LOG(LOG_DEBUG) << "dynamic iter is modified" << endl;
+                    LOG_IF(LOG_TRACE) val->print();
+                    LOG_IF(LOG_TRACE) itr->print();
                     seq++;
                     continue;
                 }
             }
-            else if (this->ops.at(i-2)->get_op_name()=="Values"){
+            else if (this->ops.at(i-2)->get_kind() == OP_VALUES){
                 //cout << " enters here " << endl;
                 Values* val = (Values *)(this->ops.at(i-2));
                 if (val->get_name() == itr->get_sstep()){
                     //cout << " enters there " << endl;
                     val->set_regnr(seq);
                     itr->set_seq(seq);
-                    cout << "dynamic iter is modified" << endl;
-                    val->print();
-                    itr->print();
+                    LOG(LOG_DEBUG) << "dynamic iter is modified" << endl;
+                    LOG_IF(LOG_TRACE) val->print();
+                    LOG_IF(LOG_TRACE) itr->print();
                     seq++;
                     continue;
                 }
@@ -318,14 +199,15 @@ void Policy::mark_iter(){
 }
 
 void Policy::mark_assert(){
-    cout << "Checking out assert logic" << endl;
+    PhaseScope scope(this->profile, PH_MARK_ASSERT, this->arena);
+    LOG(LOG_DEBUG) << "Checking out assert logic" << endl;
     for (int i = 0; i < this->ops.size(); i++){
-        if (this->ops.at(i)->get_op_name() == "Asser" ){
+        if (this->ops.at(i)->get_kind() == OP_ASSERT ){
             Asser* asser = (Asser *)(this->ops.at(i));
             if (i == 0){
                 throw_error("Error: empty assert object!");
             }
-            if (this->ops.at(i-1)->get_op_name() != "Values"){
+            if (this->ops.at(i-1)->get_kind() != OP_VALUES){
                 throw_error("Error: wrong assert logic!")
             }
             // marking assert logic
@@ -339,41 +221,298 @@ void Policy::mark_assert(){
 
 // begin AIM gen
 void Policy::frontend_compile(){
-    cout << "Start compiling" << endl;
+    PhaseScope scope(this->profile, PH_FRONTEND, this->arena);
+    LOG(LOG_DEBUG) << "Start compiling" << endl;
+    this->mark_rebase();
     for (int i = 0; i < this->ops.size(); i++){
-        if (this->ops[i]->get_op_name() == "Traverse"){
-            this->gen_traverse_aim((Traverse *)(this->ops[i]));
-            cout<< green << "Traverse aim gen finished" << reset <<endl;
+        Op* op = this->ops[i];
+        switch (op->get_kind()){
+            case OP_TRAVERSE:
+                this->gen_traverse_aim((Traverse *)op);
+                LOG(LOG_DEBUG) << green << "Traverse aim gen finished" << reset <<endl;
+                break;
+            case OP_KERNELGRAPH:
+                this->gen_kgraph_aim((KernelGraph *)op);
+                LOG(LOG_DEBUG) << green << "Kernelgraph aim gen finished" << reset <<endl;
+                break;
+            case OP_IN:
+                this->gen_in_aim((In *)op);
+                LOG(LOG_DEBUG) << green << "In aim gen finished" << reset <<endl;
+                break;
+            case OP_VALUES:
+                this->gen_values_aim((Values *)op);
+                LOG(LOG_DEBUG) << green << "Values aim gen finished" << reset <<endl;
+                break;
+            case OP_ITER:
+                this->gen_iter_aim((Iter *)op);
+                LOG(LOG_DEBUG) << green << "Iter aim gen finished" << reset <<endl;
+                break;
+            case OP_END:
+                this->gen_end_aim((End *)op);
+                LOG(LOG_DEBUG) << green << "End aim gen finished" << reset <<endl;
+                break;
+            case OP_ASSERT: // folded into the previous Values by mark_assert
+                break;
+            case OP_REBASE:
+                this->gen_rebase_aim((Rebase *)op);
+                LOG(LOG_DEBUG) << green << "Rebase aim gen finished" << reset <<endl;
+                break;
         }
-        if (this->ops[i]->get_op_name() == "KernelGraph"){
-            this->gen_kgraph_aim((KernelGraph *)(this->ops[i]));
-            cout<< green << "Kernelgraph aim gen finished" << reset <<endl;
+    }
+    // merging aims together, print out aim infos
+    this->merge_aims();
+    if (this->peephole)
+        this->optimize_aims();
+}
+
+/**
+ * Peephole pass over the merged AIMs, before any rule is generated.
+ *
+ * Move($0) outside of an iter step or a load only adds 0 to the base and
+ * is dropped. A loop exit that goes through a recirculation Load(0) is
+ * threaded to where that load leads: the drop state, or the Move(next)
+ * of the enclosing traverse, whose base is read back from the stack by
+ * the jump itself. The load and its QPN state go away. Exits into an
+ * enclosing iter keep their load, the DecJump of the iter updates its
+ * counter on the fake state only end_transfer_tab sets.
+ *
+ * The Move($x) at the head of an iter is folded into the reads of the
+ * loop base, see fold_iter_move().
+ */
+void Policy::optimize_aims(){
+    LOG(LOG_DEBUG) << "Start optimizing AIMs" << endl;
+    vector<Aim*> kept;
+    for (int i = 0; i < this->all_aims.size(); i++){
+        Aim* it = this->all_aims[i];
+        if (it->get_kind() == AIM_CONSTMOVE && ((ConstMove *)it)->get_offset() == 0 && i > 0 &&
+            this->all_aims[i-1]->get_kind() != AIM_POP && this->all_aims[i-1]->get_kind() != AIM_READLOAD){
+            this->aim_opt.moves_dropped++;
+            continue;
         }
-        if (this->ops[i]->get_op_name() == "In"){
-            this->gen_in_aim((In *)(this->ops[i]));
-            cout<< green << "In aim gen finished" << reset <<endl;
+        kept.push_back(it);
+    }
+    this->all_aims.swap(kept);
+
+    vector<int> freed;
+    for (int i = 0; i + 1 < this->all_aims.size(); i++){
+        Aim* it = this->all_aims[i];
+        if (it->get_kind() != AIM_NEGJUMP && it->get_kind() != AIM_DECJUMP)
+            continue;
+        bool neg = it->get_kind() == AIM_NEGJUMP;
+        int state = neg ? ((NegJump *)it)->get_post_qpn() : ((DecJump *)it)->get_post_qpn();
+        int exit_qpn = neg ? ((NegJump *)it)->get_false_post_qpn() : ((DecJump *)it)->get_false_post_qpn();
+        if (this->all_aims[i+1]->get_kind() != AIM_READLOAD)
+            continue;
+        ReadLoad* rload = (ReadLoad *)(this->all_aims[i+1]);
+        if (rload->get_post_qpn() != exit_qpn || rload->get_offset() != 0 || rload->get_reg_index() != -1 ||
+            rload->get_range_check() == 1 || rload->get_tran_qpn() == -1 || this->issued_by_other(exit_qpn, rload))
+            continue;
+
+        int target = -1;
+        if (rload->get_tran_qpn() == this->drop_state.get_qpn() && rload->get_tran_dqpn() == this->drop_state.get_dqpn()){
+            target = this->drop_state.get_dqpn();
+            this->aim_opt.trips_per_run++;
         }
-        if (this->ops[i]->get_op_name() == "Values"){
-            this->gen_values_aim((Values *)(this->ops[i]));
-            cout<< green << "Values aim gen finished" << reset <<endl;
+        else if (rload->get_tran_dqpn() == 0){
+            // Move(next) the fake state of the enclosing traverse leads to
+            for (int j = i + 2; j < this->all_aims.size() && target == -1; j++){
+                if (this->all_aims[j]->get_kind() != AIM_NEGJUMP ||
+                    ((NegJump *)(this->all_aims[j]))->get_fake_qpn() != rload->get_tran_qpn())
+                    continue;
+                int move_qpn = this->qpn_rtran(((NegJump *)(this->all_aims[j]))->get_post_qpn());
+                for (int k = i + 2; k < j; k++){
+                    Aim* a = this->all_aims[k];
+                    if (a->get_kind() == AIM_READMOVE && ((ReadMove *)a)->get_qpn_null() == -1 &&
+                        ((ReadMove *)a)->get_post_qpn() == move_qpn){
+                        ((ReadMove *)a)->add_prev_qpn(state);
+                        target = move_qpn;
+                        this->aim_opt.trips_per_iter++;
+                        break;
+                    }
+                }
+            }
         }
-        if (this->ops[i]->get_op_name() == "Iter"){
-            this->gen_iter_aim((Iter *)(this->ops[i]));
-            cout<< green << "Iter aim gen finished" << reset <<endl;
+        if (target == -1)
+            continue;
+
+        if (neg){
+            ((NegJump *)it)->set_false_post_qpn(target);
+            ((NegJump *)it)->set_direct_exit(true);
         }
-        if (this->ops[i]->get_op_name() == "End"){
-            this->gen_end_aim((End *)(this->ops[i]));
-            cout<< green << "End aim gen finished" << reset <<endl;
+        else {
+            ((DecJump *)it)->set_false_post_qpn(target);
+            ((DecJump *)it)->set_direct_exit(true);
         }
+        freed.push_back(rload->get_post_qpn());
+        this->all_aims.erase(this->all_aims.begin() + i + 1);
+        this->aim_opt.loads_threaded++;
     }
-    // merging aims together, print out aim infos
-    this->merge_aims();
+
+    for (int i = 1; i + 1 < this->all_aims.size(); i++){
+        if (this->all_aims[i]->get_kind() == AIM_CONSTMOVE && this->fold_iter_move(i))
+            this->all_aims.erase(this->all_aims.begin() + i);
+    }
+
+    sort(freed.begin(), freed.end(), greater<int>());
+    for (int q: freed)
+        this->renumber_qpns(q);
+    this->aim_opt.qpns_saved += freed.size();
+    this->cfg.build(this->all_aims, this->qpn_tran_coef);
+}
+
+/**
+ * Fold the Move($x) at all_aims[i] into the offsets of the reads that use
+ * the base it moves, so that the mod_field_parameters_pre rules of the
+ * move go away. Only the head of an iter qualifies: ConstLoad Move($x)
+ * Push. Its base is pushed, then stepped by the Move(size) after the Pop
+ * on every iteration, so it differs from the unmoved base by x wherever
+ * it is read, also on the loop back edge into the first read. The
+ * single move (one prev QPN) has to be the only way into the body other
+ * than that edge, and the body has to read the base only in a run of
+ * loads up to the first Move() or the Pop of the iter; a nested loop or
+ * a threaded exit in there keeps the move. The recirculation load of the
+ * exit, if it is still there, reads the base as well.
+ */
+bool Policy::fold_iter_move(int i){
+    ConstMove* cmove = (ConstMove *)(this->all_aims[i]);
+    if (cmove->get_offset() == 0 || cmove->get_prev_qpns_size() != 1 ||
+        this->all_aims[i-1]->get_kind() != AIM_CONSTLOAD || this->all_aims[i+1]->get_kind() != AIM_PUSH)
+        return false;
+    int prev = cmove->get_prev_qpn().at(0);
+
+    // the DecJump that closes the iter jumps back to its body
+    int jump = -1;
+    for (int j = i + 2; j < this->all_aims.size() && jump == -1; j++){
+        if (this->all_aims[j]->get_kind() == AIM_DECJUMP &&
+            ((DecJump *)(this->all_aims[j]))->get_true_post_qpn() == cmove->get_post_qpn())
+            jump = j;
+    }
+    if (jump == -1 || this->all_aims[jump-1]->get_kind() != AIM_CONSTMOVE)
+        return false;
+    const qpn_list &tail = ((ConstMove *)(this->all_aims[jump-1]))->get_prev_qpn();
+    vector<int> back(tail.begin(), tail.end());
+    back.push_back(prev);
+
+    vector<Aim*> reads;
+    for (int j = i + 2; j < jump; j++){
+        Aim* a = this->all_aims[j];
+        if (a->get_kind() == AIM_POP)
+            break;
+        if (a->get_kind() != AIM_READLOAD && a->get_kind() != AIM_READMOVE)
+            return false;
+        reads.push_back(a);
+        if (a->get_kind() == AIM_READMOVE)
+            break;
+    }
+    if (reads.empty())
+        return false;
+    Aim* first = reads[0];
+    vector<int> in = first->get_kind() == AIM_READLOAD ?
+        vector<int>(((ReadLoad *)first)->get_prev_qpn().begin(), ((ReadLoad *)first)->get_prev_qpn().end()) :
+        vector<int>(((ReadMove *)first)->get_prev_qpn().begin(), ((ReadMove *)first)->get_prev_qpn().end());
+    sort(in.begin(), in.end());
+    sort(back.begin(), back.end());
+    if (in != back)
+        return false;
+    for (int k = 1; k < reads.size(); k++){
+        if (((ReadLoad *)reads[k])->get_prev_qpn_size() != 1)
+            return false;
+    }
+
+    if (jump + 1 < this->all_aims.size() && this->all_aims[jump+1]->get_kind() == AIM_READLOAD){
+        ReadLoad* rload = (ReadLoad *)(this->all_aims[jump+1]);
+        if (rload->get_post_qpn() == ((DecJump *)(this->all_aims[jump]))->get_false_post_qpn())
+            reads.push_back(rload);
+    }
+    for (Aim* a: reads){
+        if (a->get_kind() == AIM_READLOAD)
+            ((ReadLoad *)a)->set_offset(((ReadLoad *)a)->get_offset() + cmove->get_offset());
+        else
+            ((ReadMove *)a)->set_offset(((ReadMove *)a)->get_offset() + cmove->get_offset());
+    }
+    this->aim_opt.moves_folded++;
+    return true;
+}
+
+// move every QPN state above freed one down, in the issued and in the QPN_TRAN form
+// the exit of an iter opening a traverse body is in the state of the traverse, renumbering would fold the next state onto it
+bool Policy::issued_by_other(int q, const Aim* but){
+    for (Aim* it: this->all_aims){
+        int post = -1;
+        switch (it->get_kind()){
+        case AIM_CONSTLOAD: post = ((ConstLoad *)it)->get_post_qpn(); break;
+        case AIM_CONSTMOVE: post = ((ConstMove *)it)->get_post_qpn(); break;
+        case AIM_READLOAD: post = ((ReadLoad *)it)->get_post_qpn(); break;
+        case AIM_READMOVE: post = ((ReadMove *)it)->get_post_qpn(); break;
+        case AIM_PUSH: post = ((Push *)it)->get_post_qpn(); break;
+        case AIM_POP: post = ((Pop *)it)->get_post_qpn(); break;
+        default: break;
+        }
+        if (it != but && post == q)
+            return true;
+    }
+    return false;
+}
+
+void Policy::renumber_qpns(int freed){
+    auto issued = [&](int &q){
+        if (q > freed && q < this->avail_state)
+            q--;
+    };
+    auto tran = [&](int &q){
+        if (q >= this->fake_base && q < this->fake_state) // fake state
+            return;
+        int r = this->qpn_rtran(q);
+        if (r > freed && r < this->avail_state)
+            q--;
+    };
+    for (Aim* it: this->all_aims){
+        switch (it->get_kind()){
+        case AIM_INIT:
+            tran(((Init *)it)->init_qpn);
+            break;
+        case AIM_CONSTLOAD:
+            for (int &q: ((ConstLoad *)it)->prev_qpns) tran(q);
+            issued(((ConstLoad *)it)->post_qpn);
+            break;
+        case AIM_CONSTMOVE:
+            for (int &q: ((ConstMove *)it)->prev_qpns) tran(q);
+            issued(((ConstMove *)it)->post_qpn);
+            break;
+        case AIM_READLOAD:
+            for (int &q: ((ReadLoad *)it)->prev_qpns) tran(q);
+            issued(((ReadLoad *)it)->post_qpn);
+            break;
+        case AIM_READMOVE:
+            for (int &q: ((ReadMove *)it)->prev_qpns) tran(q);
+            issued(((ReadMove *)it)->post_qpn);
+            break;
+        case AIM_PUSH:
+            for (int &q: ((Push *)it)->prev_qpns) tran(q);
+            issued(((Push *)it)->post_qpn);
+            break;
+        case AIM_POP:
+            for (int &q: ((Pop *)it)->prev_qpns) tran(q);
+            issued(((Pop *)it)->post_qpn);
+            break;
+        case AIM_NEGJUMP:
+            tran(((NegJump *)it)->post_qpn);
+            issued(((NegJump *)it)->true_post_qpn);
+            issued(((NegJump *)it)->false_post_qpn);
+            break;
+        case AIM_DECJUMP: // invoked on its fake state
+            issued(((DecJump *)it)->true_post_qpn);
+            issued(((DecJump *)it)->false_post_qpn);
+            break;
+        }
+    }
+    this->avail_state--;
 }
 
 // Adding mapping for dQPN and sQPN: md.qpn will use md.qpn.
 void Policy::gen_kgraph_aim(KernelGraph *kg){
     this->cur_pos = 0; // current offset is at 0
-    Init* in = new Init();
+    Init* in = this->arena.make<Init>();
     //this->cur_end = in; // current exiting point is drop
     this->head_aims.push_back(in); // the first object is for dropping
     
@@ -406,25 +545,25 @@ void Policy::gen_traverse_aim(Traverse *tra){
     new_qpn = this->avail_state; // qpn for push, avail state remains 
 
     // generate const move
-    ConstMove* cmove = new ConstMove(stoi(tra->get_type()) - this->cur_pos); // move base to next
+    ConstMove* cmove = this->arena.make<ConstMove>(stoi(tra->get_type()) - this->cur_pos); // move base to next
 
     // set new cur_pos to the real point  // debug
     this->cur_pos = stoi(tra->get_type()); // where the next is pointing to
 
     // generate rmove for reading next ptr
     // no need to set QPN tran here given JMP
-    ReadMove* rmove = new ReadMove(stoi(tra->get_offset()) - this->cur_pos); // debug
+    ReadMove* rmove = this->arena.make<ReadMove>(stoi(tra->get_offset()) - this->cur_pos); // debug
     rmove->set_post_qpn(next_qpn); // set avail state as QPN of rmove
     rmove->add_prev_qpn(fake_state); // use fake state as previous QPN
     // this->avail_state++;
 
     // generate pop state
-    Pop* pop = new Pop();
+    Pop* pop = this->arena.make<Pop>();
     pop->add_prev_qpn(fake_state); // use fake state as previous QPN
     pop->set_post_qpn(next_qpn); // use the Move() qpn as the next QPN
 
     // generate additional load for recirculation
-    ReadLoad* rload = new ReadLoad(0); // const load used for recirculation
+    ReadLoad* rload = this->arena.make<ReadLoad>(0); // const load used for recirculation
                                           // no offset
     rload->set_post_qpn(load_rec_qpn);
     rload->add_prev_qpn(this->qpn_tran(next_qpn)); // jmp from Move(next) // QPN_TRAN
@@ -432,7 +571,7 @@ void Policy::gen_traverse_aim(Traverse *tra){
     rload->set_tran_dqpn(this->end_state.get_dqpn()); // same for setting next state
 
     // generate push 
-    Push* push = new Push();
+    Push* push = this->arena.make<Push>();
 
     // put QPN from previous state to move($) and push
     int last_state_count, last_state, last_state_num;
@@ -450,7 +589,7 @@ void Policy::gen_traverse_aim(Traverse *tra){
     this->last_state.push_back(this->qpn_tran(next_qpn)); // QPN_TRAN
 
     // generate negjmp
-    NegJump* njump = new NegJump(tra->get_high(), tra->get_low()); // set ending offset
+    NegJump* njump = this->arena.make<NegJump>(tra->get_high(), tra->get_low()); // set ending offset
     njump->set_post_qpn(this->qpn_tran(next_qpn)); // prev aim is Move(next), make it post_qpn for invoking
                                                     // QPN_TRAN
     njump->set_true_post_qpn(new_qpn); // jump to push
@@ -466,6 +605,13 @@ void Policy::gen_traverse_aim(Traverse *tra){
     this->end_state.set_qpn(fake_state);
     this->end_state.set_dqpn(0);
 
+    // a body split by .rebase() ends in the next one, the last in Move(next)
+    this->element_pos = this->cur_pos;
+    this->element_exit = this->end_state;
+    this->rebases_left = tra->get_rebases();
+    if (this->rebases_left > 0)
+        this->next_body();
+
     // put all aim into aim set
     this->head_aims.push_back(cmove);
     this->head_aims.push_back(push);
@@ -476,6 +622,62 @@ void Policy::gen_traverse_aim(Traverse *tra){
 
     // end of tra aim gen
 }
+
+/**
+ * .rebase() splits the body of a traverse: every element runs each body
+ * in turn and takes Move(next) after the last one. A body ends in a fake
+ * state of its own, the next body reads the element back from the stack
+ * slot the traverse pushed it to, as Move(next) does. Bodies before a
+ * .rebase() may not open loops, that slot would not be on top any more.
+ */
+void Policy::mark_rebase(){
+    Traverse* tra = nullptr;
+    for (int i = 0; i < this->ops.size(); i++){
+        OpKind kind = this->ops[i]->get_kind();
+        if (kind == OP_ITER)
+            tra = nullptr;
+        else if (kind == OP_TRAVERSE){
+            tra = (Traverse *)(this->ops[i]);
+            tra->set_rebases(0);
+        }
+        else if (kind == OP_REBASE){
+            if (tra == nullptr)
+                throw_error(".rebase() has to be in the body of a traverse, outside of its inner loops");
+            OpKind prev = this->ops[i-1]->get_kind();
+            if (prev != OP_VALUES && prev != OP_ASSERT)
+                throw_error("a body before .rebase() has to end with .values");
+            if (i + 1 >= this->ops.size() || (this->ops[i+1]->get_kind() != OP_VALUES && this->ops[i+1]->get_kind() != OP_IN))
+                throw_error("a body after .rebase() has to start with .values or .in");
+            tra->set_rebases(tra->get_rebases() + 1);
+        }
+    }
+}
+
+void Policy::next_body(){
+    this->end_state.set_qpn(this->fake_state);
+    this->end_state.set_dqpn(0);
+    this->fake_state++;
+}
+
+void Policy::gen_rebase_aim(Rebase *rb){
+    Aim* last = head_aims.back();
+    if (last->get_kind() != AIM_READLOAD){
+        throw_error("body before .rebase() didn't terminate properly");
+    }
+    ((ReadLoad*)last)->set_tran_qpn(this->end_state.get_qpn());
+    ((ReadLoad*)last)->set_tran_dqpn(this->end_state.get_dqpn());
+    this->rebase_states.push_back(this->end_state.get_qpn());
+
+    // the next body starts from the element
+    this->last_state.clear();
+    this->last_state.push_back(this->end_state.get_qpn());
+    this->cur_pos = this->element_pos;
+    this->rebases_left--;
+    if (this->rebases_left > 0)
+        this->next_body();
+    else
+        this->end_state = this->element_exit;
+}
  
 void Policy::gen_iter_aim(Iter *itr){
     int dynamic = itr->get_dynamic(); // const iter or dynamic iter
@@ -491,7 +693,7 @@ void Policy::gen_iter_aim(Iter *itr){
     this->avail_state++;
     new_qpn = this->avail_state; // qpn for push, move and load, avail state remains
 
-    ConstLoad* cload = new ConstLoad(itr->get_seq());
+    ConstLoad* cload = this->arena.make<ConstLoad>(itr->get_seq());
     if (dynamic == 0){
         cload->set_post_qpn(new_qpn);
         cload->set_value(stoi(itr->get_sstep()));
@@ -500,24 +702,24 @@ void Policy::gen_iter_aim(Iter *itr){
     }
 
     // generate pop state
-    Pop* pop = new Pop();
+    Pop* pop = this->arena.make<Pop>();
     pop->add_prev_qpn(fake_state); // use fake state as previous QPN
     pop->set_post_qpn(new_qpn); // only one pop QPN?
     // cout << "debug point 2" << endl;
 
 
     // generate move($)
-    ConstMove* cmove_array = new ConstMove(stoi(itr->get_size())); // move to next array entry
+    ConstMove* cmove_array = this->arena.make<ConstMove>(stoi(itr->get_size())); // move to next array entry
     // debug 
     cmove_array->add_prev_qpn(fake_state);
     // cmove_array->print();
     cmove_array->set_post_qpn(new_qpn);
 
     // generate const move to array header
-    ConstMove* cmove = new ConstMove(stoi(itr->get_offset()) - this->cur_pos); // move base to next
+    ConstMove* cmove = this->arena.make<ConstMove>(stoi(itr->get_offset()) - this->cur_pos); // move base to next
 
     // generate push
-    Push* push = new Push();
+    Push* push = this->arena.make<Push>();
 
     // cout << "debug point 3" << endl;
 
@@ -541,7 +743,7 @@ void Policy::gen_iter_aim(Iter *itr){
     this->last_state.push_back(fake_state);
 
     // generate additional load for recirculation
-    ReadLoad* rload = new ReadLoad(0); // const load used for recirculation
+    ReadLoad* rload = this->arena.make<ReadLoad>(0); // const load used for recirculation
                                           // no offset
     rload->set_post_qpn(load_rec_qpn);
     rload->add_prev_qpn(fake_state); // jmp from Move(next)
@@ -549,7 +751,7 @@ void Policy::gen_iter_aim(Iter *itr){
     rload->set_tran_dqpn(this->end_state.get_dqpn()); // same for setting next state
 
     // generate decjmp
-    DecJump* djump = new DecJump(itr->get_seq()); // set ending offset
+    DecJump* djump = this->arena.make<DecJump>(itr->get_seq()); // set ending offset
     djump->set_post_qpn(fake_state); // prev qpn set is the fake_state
     djump->set_true_post_qpn(new_qpn); // jump to push
     djump->set_false_post_qpn(load_rec_qpn); // jump to load recirc
@@ -577,7 +779,7 @@ void Policy::gen_in_aim(In *in){
     this->avail_state++;
 
     // generate move
-    ReadMove* rmove = new ReadMove(stoi(in->get_offset())-this->cur_pos);
+    ReadMove* rmove = this->arena.make<ReadMove>(stoi(in->get_offset())-this->cur_pos);
     // set qpn to transit to
     // rmove->set_qpn_next();
     
@@ -612,7 +814,6 @@ void Policy::gen_in_aim(In *in){
 }
 
 void Policy::gen_values_aim(Values *val){
-    int val_num = val->get_num();
     int iter_store = val->get_regnr() == (-1)? 0: 1; // check whether this value should be stored 
                                                     // in register or not
     int range_check = stoi(val->get_smtbit()) == (2)? 1: 0; // check whether the value needs to be 
@@ -622,7 +823,7 @@ void Policy::gen_values_aim(Values *val){
     this->avail_state++;
     // generate read load
     if (iter_store == 1){ // store the address into register
-        ReadLoad* rload = new ReadLoad(stoi(val->fields.at(0))-this->cur_pos);
+        ReadLoad* rload = this->arena.make<ReadLoad>(stoi(val->fields.at(0))-this->cur_pos);
         rload->set_post_qpn(rd_qpn);
         int last_state_count, last_state, last_state_num;
         last_state_num = this->last_state.size();
@@ -641,15 +842,21 @@ void Policy::gen_values_aim(Values *val){
     }
 
     else{ // not a internal array traversal variable
+        PayloadWindows win = this->value_windows(val);
         int count = 0;
-        for (count = 0; count < val_num; count++){
+        for (count = 0; count < win.size(); count++){
             rd_qpn = this->avail_state -1; // sequential load primitives concatenated together // debug
             this->avail_state ++;
             // cout << red << rd_qpn << reset << endl;
-            ReadLoad* rload = new ReadLoad(stoi(val->fields.at(count))-this->cur_pos);
+            ReadLoad* rload = this->arena.make<ReadLoad>(win.start[count]-this->cur_pos);
             rload->set_post_qpn(rd_qpn);
+            if (win.fields[count].size() > 1){ // one wide read for the fields of the window
+                rload->set_window(win.width[count], this->cur_pos);
+                for (int f: win.fields[count])
+                    rload->add_field(stoi(val->fields.at(f))-this->cur_pos);
+            }
             if (range_check){
-                rload->set_range_check(1); // mark as range check readload
+                rload->set_range_check(1);
                 rload->set_high(val->get_high());
                 rload->set_low(val->get_low());
             }
@@ -670,10 +877,21 @@ void Policy::gen_values_aim(Values *val){
     }
 }
 
+// windows of the fields, wide reads with set_coalesce() unless the values are asserted:
+// range_match_tab checks the first 8 bytes of a payload only
+PayloadWindows Policy::value_windows(Values *val){
+    vector<int> offsets;
+    for (const string &f: val->fields)
+        offsets.push_back(stoi(f));
+    PayloadWindows win;
+    win.pack(offsets, this->coalesce && stoi(val->get_smtbit()) != 2);
+    return win;
+}
+
 void Policy::gen_end_aim(End* ed){
     // assign exit of the last load onto nearest exiting point
     Aim* last = head_aims.back();
-    if (last->get_aim_name() != "ReadLoad"){
+    if (last->get_kind() != AIM_READLOAD){
         throw_error("policy didn't terminate properly");
     }
     else {
@@ -686,301 +904,327 @@ void Policy::gen_end_aim(End* ed){
 // begin code gen
 
 // PC transition helper function
-string gen_direct_transfer_tab(int qpn, int end_bit, int iter_entry, int dqpn){
-    string str = "pd direct_transfer_tab add_entry mod_dqpn ib_aeth_valid 1 md_qpn " + to_string(qpn) + " md_end_bit " 
-        + to_string(end_bit) + " md_iter_entry " + to_string(iter_entry) + " action_dqpn " 
-        + to_string(dqpn) + '\n';
-    return str;
+void gen_direct_transfer_tab(RuleSet &rules, int qpn, int end_bit, int iter_entry, int dqpn){
+    rules.add("direct_transfer_tab", "mod_dqpn")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_end_bit", end_bit)
+        .key("md_iter_entry", iter_entry).param_dqpn("dqpn", dqpn);
 }
 
-string gen_check_null_tab(int qpn, int p_qpn, int dqpn){
-    string str = "pd check_null_tab add_entry mod_qpn_dqpn ib_aeth_valid 1 md_qpn " + to_string(qpn) + 
-        " md_aeth_addr_h 0x0 md_aeth_addr_l 0x0 action_qpn " +
-        to_string(p_qpn) + " action_dqpn " + to_string(dqpn) + '\n';
-    return str;
+void gen_check_null_tab(RuleSet &rules, int qpn, int p_qpn, int dqpn){
+    rules.add("check_null_tab", "mod_qpn_dqpn")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_hex("md_aeth_addr_h", "0")
+        .key_hex("md_aeth_addr_l", "0").param_qpn("qpn", p_qpn).param_dqpn("dqpn", dqpn);
 }
 
-string gen_check_traverse_end_tab(int qpn, string addr_h, string addr_l){
-    string str = "pd check_traverse_end_tab add_entry set_end_bit ib_aeth_valid 1 md_qpn " + to_string(qpn) + 
-        " md_aeth_addr_h 0x" + addr_h + " md_aeth_addr_l 0x" + addr_l + '\n';
-    return str;
+void gen_check_traverse_end_tab(RuleSet &rules, int qpn, string addr_h, string addr_l){
+    uint64_t end = stoull(addr_h, 0, 16) << 32 | stoull(addr_l, 0, 16);
+    rules.add("check_traverse_end_tab", "set_end_bit")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_hex("md_aeth_addr_h", addr_h)
+        .key_hex("md_aeth_addr_l", addr_l)
+        .kaslr("md_aeth_addr_h", end, 32, 32).kaslr("md_aeth_addr_l", end, 0, 32);
 }
 
-string gen_read_update_max_entry_tab(int qpn, int idx, int act){
-    string str;
+void gen_read_update_max_entry_tab(RuleSet &rules, int qpn, int idx, int act){
     switch(act){
         case 1: 
-            str = "pd read_update_max_entry_tab add_entry read_const_length ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-                " action_idx " + to_string(idx) + '\n';
+            rules.add("read_update_max_entry_tab", "read_const_length")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).param("idx", idx).rel("idx", REL_REG);
             break;
         case 2:
-            str = "pd read_update_max_entry_tab add_entry read_max_entry ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-                " action_idx " + to_string(idx) + '\n';
+            rules.add("read_update_max_entry_tab", "read_max_entry")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).param("idx", idx).rel("idx", REL_REG);
             break;
         case 3:
-            str = "pd read_update_max_entry_tab add_entry update_max_entry ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-                " action_idx " + to_string(idx) + '\n';
+            rules.add("read_update_max_entry_tab", "update_max_entry")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).param("idx", idx).rel("idx", REL_REG);
             break;
     }
-    return str;
 }
 
-string gen_end_transfer_tab(int qpn, int p_qpn, int dqpn){
-    string str = "pd end_transfer_tab add_entry mod_qpn_dqpn ib_aeth_valid 1 md_qpn " + to_string(qpn) 
-        + " action_qpn " + to_string(p_qpn) + " action_dqpn " + to_string(dqpn) + '\n';
-    return str;
+void gen_end_transfer_tab(RuleSet &rules, int qpn, int p_qpn, int dqpn){
+    rules.add("end_transfer_tab", "mod_qpn_dqpn")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).param_qpn("qpn", p_qpn).param_dqpn("dqpn", dqpn);
 }
 
 // cloning tab helper function
-string gen_cloning_tab(int qpn){
-    string str = "pd cloning_tab add_entry cloning ib_aeth_valid 1 md_qpn " + to_string(qpn) + '\n';
-    return str;
+void gen_cloning_tab(RuleSet &rules, int qpn){
+    rules.add("cloning_tab", "cloning")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn);
 }
 
 int Policy::find_next_post_qpn(int i){
-    int j = 0;
-    int post_qpn = 0;
-    for (j = i+1; j < this->all_aims.size(); j++){
-        if (this->all_aims[j]->get_aim_name() == "ReadMove"){
-            post_qpn = ((ReadMove *)(this->all_aims[j]))->get_post_qpn();
-            break;
-        }
-        if (this->all_aims[j]->get_aim_name() == "ReadLoad"){
-            post_qpn = ((ReadLoad *)(this->all_aims[j]))->get_post_qpn();
-            break;
-        }
-        if (this->all_aims[j]->get_aim_name() == "DecJump" or (this->all_aims[j]->get_aim_name() == "NegJump")){
-            post_qpn = -1; // use end transfer tab
-            break;
-        }
-    }
-    return post_qpn;
+    return this->cfg.get_next_post_qpn(i);
 }
 
 // PC transtition main function
-string Policy::gen_pc_tran(){
-    cout << "Start generating QPN transition rule" << endl;
-    string trans;
+void Policy::gen_pc_tran(RuleSet &rules){
+    LOG(LOG_DEBUG) << "Start generating QPN transition rule" << endl;
     for (int i = 0; i < this->all_aims.size(); i++){
         Aim* it = this->all_aims[i];
-        if (it->get_aim_name() == "Init"){
+        switch (it->get_kind()){
+        case AIM_INIT: {
             // generate first transition from init to next move/load
             int post_qpn = this->find_next_post_qpn(i);
             // if (post == -1)
-            trans += gen_end_transfer_tab(((Init*)it)->get_init_qpn(), ((Init*)it)->get_init_qpn(), post_qpn);
+            gen_end_transfer_tab(rules, ((Init*)it)->get_init_qpn(), ((Init*)it)->get_init_qpn(), post_qpn);
+            break;
         }
-        if (it->get_aim_name() == "ReadLoad"){
+        case AIM_READLOAD:
             if (((ReadLoad *)it)->get_tran_qpn() != -1){ // last load statement, use end trans
-                trans += gen_end_transfer_tab(this->qpn_tran(((ReadLoad *)it)->get_post_qpn()), 
+                gen_end_transfer_tab(rules, this->qpn_tran(((ReadLoad *)it)->get_post_qpn()), 
                     ((ReadLoad *)it)->get_tran_qpn(), ((ReadLoad *)it)->get_tran_dqpn()); // QPN_TRAN
+                if (this->is_rebase(((ReadLoad *)it)->get_tran_qpn())) // on into the next body
+                    gen_direct_transfer_tab(rules, ((ReadLoad *)it)->get_tran_qpn(), 0, 0, this->find_next_post_qpn(i));
             }
             else {
                 int post_qpn = this->find_next_post_qpn(i); // Jmp will be covered in the first case
-                trans += gen_end_transfer_tab(this->qpn_tran(((ReadLoad*)it)->get_post_qpn()), 
+                gen_end_transfer_tab(rules, this->qpn_tran(((ReadLoad*)it)->get_post_qpn()), 
                      this->qpn_tran(((ReadLoad*)it)->get_post_qpn()), post_qpn); // QPN_TRAN
             }
-        }
-        if (it->get_aim_name() == "ReadMove"){
+            break;
+        case AIM_READMOVE:
             if (((ReadMove *)it)->get_qpn_null() != -1){ // not last Move before Jmp
-                trans += gen_check_null_tab(this->qpn_tran(((ReadMove *)it)->get_post_qpn()), // QPN_TRAN 
+                gen_check_null_tab(rules, this->qpn_tran(((ReadMove *)it)->get_post_qpn()), // QPN_TRAN 
                     ((ReadMove *)it)->get_qpn_null(), ((ReadMove *)it)->get_dqpn_null()); // checking the NULL criteria
                 // if base is not Null
                 int post_qpn = this->find_next_post_qpn(i); // Jmp will not be covered
-                trans += gen_direct_transfer_tab(this->qpn_tran(((ReadMove *)it)->get_post_qpn()),
+                gen_direct_transfer_tab(rules, this->qpn_tran(((ReadMove *)it)->get_post_qpn()),
                      0, 0, post_qpn); // QPN_TRAN
             }
             else {
                 // indicate this is a Traverse Mov, no action
             }
-        }
-        if (it->get_aim_name() == "NegJump"){ // No need to use QPN_TRAN
-            trans += gen_check_traverse_end_tab(((NegJump *)it)->get_post_qpn(), ((NegJump *)it)->get_addr_h(), 
+            break;
+        case AIM_NEGJUMP: // No need to use QPN_TRAN
+            gen_check_traverse_end_tab(rules, ((NegJump *)it)->get_post_qpn(), ((NegJump *)it)->get_addr_h(), 
                 ((NegJump *)it)->get_addr_l());
-            trans += gen_direct_transfer_tab(((NegJump *)it)->get_post_qpn(), 0, 0,
+            gen_direct_transfer_tab(rules, ((NegJump *)it)->get_post_qpn(), 0, 0,
                 ((NegJump *)it)->get_true_post_qpn());  // traverse ends here
-            trans += gen_direct_transfer_tab(((NegJump *)it)->get_post_qpn(), 1, 0,
+            gen_direct_transfer_tab(rules, ((NegJump *)it)->get_post_qpn(), 1, 0,
                 ((NegJump *)it)->get_false_post_qpn());  // traverse is not ended
-            trans += gen_direct_transfer_tab(((NegJump *)it)->get_fake_qpn(), 0, 0, 
+            gen_direct_transfer_tab(rules, ((NegJump *)it)->get_fake_qpn(), 0, 0, 
                 this->qpn_rtran(((NegJump *)it)->get_post_qpn())); // last trans table transfer from fake state to move state
                                                   // QPN_TRAN
-        }
-        if (it->get_aim_name() == "DecJump"){ // No need to use QPN_TRAN
-            trans += gen_read_update_max_entry_tab(((DecJump *)it)->get_post_qpn(), ((DecJump *)it)->get_reg_idx(),
+            break;
+        case AIM_DECJUMP: // No need to use QPN_TRAN
+            gen_read_update_max_entry_tab(rules, ((DecJump *)it)->get_post_qpn(), ((DecJump *)it)->get_reg_idx(),
                 3); // update max entry. If reg_lo != 1, md.iter_end = 2; if reg_lo == 1, md.iter_end = 1;
-            trans += gen_direct_transfer_tab(((DecJump *)it)->get_post_qpn(), 0, 1, 
+            gen_direct_transfer_tab(rules, ((DecJump *)it)->get_post_qpn(), 0, 1, 
                 ((DecJump *)it)->get_false_post_qpn());
-            trans += gen_direct_transfer_tab(((DecJump *)it)->get_post_qpn(), 0, 2, 
+            gen_direct_transfer_tab(rules, ((DecJump *)it)->get_post_qpn(), 0, 2, 
                 ((DecJump *)it)->get_true_post_qpn());
+            break;
+        default:
+            break;
         }
     }
-    return trans;
 }
 
-string Policy::backend_compile(){
-    cout << "Start backend compiling" << endl;
-    string code;
+void Policy::backend_compile(RuleSet &rules){
+    LOG(LOG_DEBUG) << "Start backend compiling" << endl;
     for (int i = 0; i < this->all_aims.size(); i++){
-        if (this->all_aims[i]->get_aim_name() == "Init"){
-            code += this->gen_init_code((Init *)(this->all_aims[i]));
-            cout<< blue << "Initialization code gen finished" << reset <<endl;
-        }
-        if (this->all_aims[i]->get_aim_name() == "ConstLoad"){
-            code += this->gen_constload_code((ConstLoad *)(this->all_aims[i]));
-            cout<< blue << "Const load(Load($)) code gen finished" << reset <<endl;
-        }
-        if (this->all_aims[i]->get_aim_name() == "ConstMove"){
-            code += this->gen_constmove_code((ConstMove *)(this->all_aims[i]));
-            cout<< blue << "Const move(Move($)) code gen finished" << reset <<endl;
-        }
-        if (this->all_aims[i]->get_aim_name() == "ReadLoad"){
-            code += this->gen_readload_code((ReadLoad *)(this->all_aims[i]));
-            cout<< blue << "Read load(Load()) code gen finished" << reset <<endl;
-        }
-        if (this->all_aims[i]->get_aim_name() == "ReadMove"){
-            code += this->gen_readmove_code((ReadMove *)(this->all_aims[i]));
-            cout<< blue << "Read move(Move())) code gen finished" << reset <<endl;
-        }
-        if (this->all_aims[i]->get_aim_name() == "Push"){
-            code += this->gen_push_code((Push *)(this->all_aims[i]));
-            cout<< blue << "Push code gen finished" << reset <<endl;
-        }
-        if (this->all_aims[i]->get_aim_name() == "Pop"){
-            code += this->gen_pop_code((Pop *)(this->all_aims[i]));
-            cout<< blue << "Pop code gen finished" << reset <<endl;
-        }
-        if (this->all_aims[i]->get_aim_name() == "DecJump"){
-            code += this->gen_decjump_code((DecJump *)(this->all_aims[i]));
-            cout<< blue << "DecJump(R0--, L1, L2) code gen finished" << reset <<endl;
-        }
-        if (this->all_aims[i]->get_aim_name() == "NegJump"){
-            code += this->gen_negjump_code((NegJump *)(this->all_aims[i]));
-            cout<< blue << "NegJump(base == Addr, L1, L2) code gen finished" << reset <<endl;
+        Aim* it = this->all_aims[i];
+        switch (it->get_kind()){
+            case AIM_INIT:
+                this->gen_init_code(rules, (Init *)it);
+                LOG(LOG_DEBUG) << blue << "Initialization code gen finished" << reset <<endl;
+                break;
+            case AIM_CONSTLOAD:
+                this->gen_constload_code(rules, (ConstLoad *)it);
+                LOG(LOG_DEBUG) << blue << "Const load(Load($)) code gen finished" << reset <<endl;
+                break;
+            case AIM_CONSTMOVE:
+                this->gen_constmove_code(rules, (ConstMove *)it);
+                LOG(LOG_DEBUG) << blue << "Const move(Move($)) code gen finished" << reset <<endl;
+                break;
+            case AIM_READLOAD:
+                this->gen_readload_code(rules, (ReadLoad *)it);
+                LOG(LOG_DEBUG) << blue << "Read load(Load()) code gen finished" << reset <<endl;
+                break;
+            case AIM_READMOVE:
+                this->gen_readmove_code(rules, (ReadMove *)it);
+                LOG(LOG_DEBUG) << blue << "Read move(Move())) code gen finished" << reset <<endl;
+                break;
+            case AIM_PUSH:
+                this->gen_push_code(rules, (Push *)it);
+                LOG(LOG_DEBUG) << blue << "Push code gen finished" << reset <<endl;
+                break;
+            case AIM_POP:
+                this->gen_pop_code(rules, (Pop *)it);
+                LOG(LOG_DEBUG) << blue << "Pop code gen finished" << reset <<endl;
+                break;
+            case AIM_DECJUMP:
+                this->gen_decjump_code(rules, (DecJump *)it);
+                LOG(LOG_DEBUG) << blue << "DecJump(R0--, L1, L2) code gen finished" << reset <<endl;
+                break;
+            case AIM_NEGJUMP:
+                this->gen_negjump_code(rules, (NegJump *)it);
+                LOG(LOG_DEBUG) << blue << "NegJump(base == Addr, L1, L2) code gen finished" << reset <<endl;
+                break;
         }
     }
-    return code;
+}
+
+void Policy::payload_layout(PayloadLayout &layout){
+    for (Aim* it: this->all_aims){
+        if (it->get_kind() != AIM_READLOAD || ((ReadLoad *)it)->get_fields().empty())
+            continue;
+        ReadLoad * rload = (ReadLoad *)it;
+        layout.reads++;
+        for (int f: rload->get_fields())
+            layout.fields.push_back(PayloadField{rload->get_post_qpn(), rload->get_pos(), f, f - rload->get_offset(),
+                rload->get_size()});
+    }
+}
+
+void Policy::gen_rules(RuleSet &rules){
+    this->number_psn();
+    if (this->relocatable){ // the QPN fields are marked against the states handed out
+        RelocSpace space;
+        space.on = true;
+        space.first = this->first_state;
+        space.end = this->avail_state;
+        space.coef = this->qpn_tran_coef;
+        space.fake_first = this->fake_base;
+        space.fake_end = this->fake_state;
+        space.task = this->task_nr;
+        rules.reloc_space = space;
+    }
+    struct Pass {
+        const char *section;
+        CompilePhase phase;
+        void (Policy::*gen)(RuleSet &);
+    };
+    static const Pass passes[] = {
+        {"backend", PH_BACKEND, &Policy::backend_compile},
+        {"pc_tran", PH_PC_TRAN, &Policy::gen_pc_tran},
+        {"base_operation", PH_BASE_OPERATION, &Policy::gen_base_operation},
+        {"psn_mapping", PH_PSN_MAPPING, &Policy::gen_psn_mapping},
+        {"offset_encoding", PH_OFFSET_ENCODING, &Policy::gen_offset_encoding},
+        {"load_max", PH_LOAD_MAX, &Policy::gen_load_max},
+        {"pgt_walk", PH_READMOVE_PGT_WALK, &Policy::gen_readmove_pgt_walk_code},
+        {"pgt_aims", PH_PGT_AIMS, &Policy::gen_pgt_aims_code},
+    };
+    for (const Pass &p: passes){
+        PhaseScope scope(this->profile, p.phase, this->arena);
+        rules.begin_section(p.section);
+        (this->*p.gen)(rules);
+    }
+    rules.reloc_space = RelocSpace();
+    this->profile.aims.clear();
+    for (Aim* it: this->all_aims)
+        this->profile.aims[it->get_aim_name()]++;
+    for (Aim* it: this->pgt_aims)
+        this->profile.aims[it->get_aim_name()]++;
 }
 
 // end of fetching helper function
-string gen_end_of_fetching_tab(int qpn){
-    string str;
-    str += "pd end_of_fetching_tab add_entry _drop ib_aeth_valid 1 ib_bth_dqpn " + to_string(qpn) + '\n';
-    return str;
+void gen_end_of_fetching_tab(RuleSet &rules, int qpn){
+    rules.add("end_of_fetching_tab", "_drop")
+        .key("ib_aeth_valid", 1).key_dqpn("ib_bth_dqpn", qpn);
 }
 
 // Cache/Read/Modiify base address helper function
-string gen_cache_process_addr_to_reg_h_tab(int qpn, int dqpn, int idx, int act){ // act is the action NO
-    string str;
+void gen_cache_process_addr_to_reg_h_tab(RuleSet &rules, int qpn, int dqpn, int idx, int act){ // act is the action NO
     switch(act){
         case 1: // read: read_process_addr_from_reg_h
-            str += "pd cache_process_addr_to_reg_h_tab add_entry read_process_addr_from_reg_h ib_aeth_valid 1 md_qpn "
-                + to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) 
-                + " eg_intr_md_from_parser_aux_clone_src 0"  // handling egress clone
-                + " action_state " + to_string(idx) + '\n';
+            rules.add("cache_process_addr_to_reg_h_tab", "read_process_addr_from_reg_h")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0)  // handling egress clone
+                .param("state", idx).rel("state", REL_STACK);
             break;
         case 2: // write: write_process_addr_to_reg_h
-            str += "pd cache_process_addr_to_reg_h_tab add_entry write_process_addr_to_reg_h ib_aeth_valid 1 md_qpn "
-                + to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) 
-                + " eg_intr_md_from_parser_aux_clone_src 0"  // handling egress clone
-                + " action_state " + to_string(idx) + '\n';
+            rules.add("cache_process_addr_to_reg_h_tab", "write_process_addr_to_reg_h")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0)  // handling egress clone
+                .param("state", idx).rel("state", REL_STACK);
             break;
     }
-    return str;
 }
 
-string gen_cache_process_addr_to_reg_l_tab(int qpn, int dqpn, int idx, int act){ // act is the action NO
-    string str;
+void gen_cache_process_addr_to_reg_l_tab(RuleSet &rules, int qpn, int dqpn, int idx, int act){ // act is the action NO
     switch(act){
         case 1: // read: read_process_addr_from_reg_l
-            str += "pd cache_process_addr_to_reg_l_tab add_entry read_process_addr_from_reg_l ib_aeth_valid 1 md_qpn "
-                + to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) 
-                + " eg_intr_md_from_parser_aux_clone_src 0"  // handling egress clone
-                + " action_state " + to_string(idx) + '\n';
+            rules.add("cache_process_addr_to_reg_l_tab", "read_process_addr_from_reg_l")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0)  // handling egress clone
+                .param("state", idx).rel("state", REL_STACK);
             break;
         case 2: // write: write_process_addr_to_reg_l
-            str += "pd cache_process_addr_to_reg_l_tab add_entry write_process_addr_to_reg_l ib_aeth_valid 1 md_qpn "
-                + to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) 
-                + " eg_intr_md_from_parser_aux_clone_src 0"  // handling egress clone
-                + " action_state " + to_string(idx) + '\n';
+            rules.add("cache_process_addr_to_reg_l_tab", "write_process_addr_to_reg_l")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0)  // handling egress clone
+                .param("state", idx).rel("state", REL_STACK);
             break;
         case 3: // modify: read_update_iter_addr_l
-            str += "pd cache_process_addr_to_reg_l_tab add_entry read_update_iter_addr_l ib_aeth_valid 1 md_qpn "
-                + to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) 
-                + " eg_intr_md_from_parser_aux_clone_src 0"  // handling egress clone
-                + " action_state " + to_string(idx) + '\n';
+            rules.add("cache_process_addr_to_reg_l_tab", "read_update_iter_addr_l")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0)  // handling egress clone
+                .param("state", idx).rel("state", REL_STACK);
             break;
     }
-    return str;
 }
 
 // Cache array size/length tab helper function
-string gen_cache_size_into_md_tab(int qpn, int size){
-    string str;
-    str += "pd cache_size_into_md_tab add_entry cache_size_into_md md_qpn " + to_string(qpn) + 
-        " action_entry_size " + to_string(size) + '\n';
-    return str;
-}
-string gen_cache_len_into_md_tab(int qpn, int len){
-    string str;
-    str += "pd cache_len_into_md_tab add_entry cache_len_into_md md_qpn " + to_string(qpn) +
-        " action_max_len " + to_string(len) + '\n';
-    return str;
+void gen_cache_size_into_md_tab(RuleSet &rules, int qpn, int size){
+    rules.add("cache_size_into_md_tab", "cache_size_into_md")
+        .key_qpn("md_qpn", qpn).param("entry_size", size);
+}
+void gen_cache_len_into_md_tab(RuleSet &rules, int qpn, int len){
+    rules.add("cache_len_into_md_tab", "cache_len_into_md")
+        .key_qpn("md_qpn", qpn).param("max_len", len);
 }
 // Mod offset pre table helper function
-string gen_mod_field_parameters_pre_tab(int qpn, int dqpn, int offset){
-    string str;
+void gen_mod_field_parameters_pre_tab(RuleSet &rules, int qpn, int dqpn, int offset){
     if (offset < 0){
-        str += "pd encode_mod_offset_pre_tab add_entry encode_mod_offset ib_aeth_valid 1 md_qpn " + 
-            to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) + " action_offset " + to_string(-offset) + '\n';
-        str += "pd mod_field_parameters_pre_tab add_entry mod_field_parameters_subtract ib_aeth_valid 1 md_qpn " +
-            to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) + '\n';
+        rules.add("encode_mod_offset_pre_tab", "encode_mod_offset")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn).param("offset", -offset);
+        rules.add("mod_field_parameters_pre_tab", "mod_field_parameters_subtract")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn);
     }
     else {
-        str += "pd encode_mod_offset_pre_tab add_entry encode_mod_offset ib_aeth_valid 1 md_qpn " + 
-            to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) + " action_offset " + to_string(offset) + '\n';
-        str += "pd mod_field_parameters_pre_tab add_entry mod_field_parameters_add ib_aeth_valid 1 md_qpn " +
-            to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) + '\n';
+        rules.add("encode_mod_offset_pre_tab", "encode_mod_offset")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn).param("offset", offset);
+        rules.add("mod_field_parameters_pre_tab", "mod_field_parameters_add")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn);
     }
-    return str;
 }
 
-// PSN table mapping helper function
-string gen_read_update_psn_tab(int dqpn, int idx){
-    string str;
-    str += "pd read_update_psn_tab add_entry read_update_psn ib_aeth_valid 1 ib_bth_dqpn " + 
-        to_string(dqpn) + " eg_intr_md_from_parser_aux_clone_src 0" + " action_state " + to_string(idx) + '\n';
-    return str;
+// PSN table mapping helper function, slots count from the first QPN state of the install, less the task when dense
+void gen_read_update_psn_tab(RuleSet &rules, int dqpn, int idx, bool dense){
+    rules.add("read_update_psn_tab", "read_update_psn")
+        .key("ib_aeth_valid", 1).key_dqpn("ib_bth_dqpn", dqpn).key("eg_intr_md_from_parser_aux_clone_src", 0)
+        .param("state", idx).rel("state", REL_QPN).rel("state", REL_BASE, -1);
+    if (dense)
+        rules.rel("state", REL_TASK, -1);
 }
 
 // PSN table for defense spoof injection
-string gen_read_update_psn_def_tab(int dqpn, int idx){
-    string str;
+void gen_read_update_psn_def_tab(RuleSet &rules, int dqpn, int idx){
     // This can be enabled for defending spoofing disable
-    //str += "pd read_update_psn_def_tab add_entry read_update_psn_def ib_aeth_valid 1 ib_bth_dqpn " +
-        to_string(dqpn) + " action_state " + to_string(idx) + '\n';
-    return str;
+    //out << "pd read_update_psn_def_tab add_entry read_update_psn_def ib_aeth_valid 1 ib_bth_dqpn "
+    //    << dqpn << " action_state " << idx << '\n';
 }
 
 
 // mod offset helper function
-string gen_mod_field_parameters_tab(int qpn, int dqpn, int offset){
-    string str;
+void gen_mod_field_parameters_tab(RuleSet &rules, int qpn, int dqpn, int offset, int len = 8){
     if (offset < 0){
-        str += "pd encode_mod_offset_tab add_entry encode_mod_offset ib_aeth_valid 1 md_qpn " + 
-            to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) + " eg_intr_md_from_parser_aux_clone_src 0" +
-             " action_offset " + to_string(-offset) + '\n';
-        str += "pd mod_field_parameters_tab add_entry mod_field_parameters_subtract ib_aeth_valid 1 md_qpn " +
-            to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) + " eg_intr_md_from_parser_aux_clone_src 0"
-            + " action_len " + to_string(8) + '\n'; // set len as 8 for now
+        rules.add("encode_mod_offset_tab", "encode_mod_offset")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+            .key("eg_intr_md_from_parser_aux_clone_src", 0).param("offset", -offset);
+        rules.add("mod_field_parameters_tab", "mod_field_parameters_subtract")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+            .key("eg_intr_md_from_parser_aux_clone_src", 0).param("len", len);
     }
     else {
-        str += "pd encode_mod_offset_tab add_entry encode_mod_offset ib_aeth_valid 1 md_qpn " + 
-            to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) + " eg_intr_md_from_parser_aux_clone_src 0" +
-             " action_offset " + to_string(offset) + '\n';
-        str += "pd mod_field_parameters_tab add_entry mod_field_parameters_add ib_aeth_valid 1 md_qpn " +
-            to_string(qpn) + " ib_bth_dqpn " + to_string(dqpn) + " eg_intr_md_from_parser_aux_clone_src 0"
-            + " action_len " + to_string(8) + '\n'; // set len as 8 for now
+        rules.add("encode_mod_offset_tab", "encode_mod_offset")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+            .key("eg_intr_md_from_parser_aux_clone_src", 0).param("offset", offset);
+        rules.add("mod_field_parameters_tab", "mod_field_parameters_add")
+            .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_dqpn("ib_bth_dqpn", dqpn)
+            .key("eg_intr_md_from_parser_aux_clone_src", 0).param("len", len);
     }
-    return str;
 }
 
 // Move must cache address: find next post QPN and JMP
@@ -988,59 +1232,74 @@ string gen_mod_field_parameters_tab(int qpn, int dqpn, int offset){
 //      norm load: find post; end load cmove(push): no action; end load rmove(read); end load empty: no action.
 // Cmove after pop will result in modify base, otherwise mod_para_pre. Cmove needs to load constant as well.
 // Push/Pop semantics:
-string Policy::gen_base_operation(){
-    cout << "Start generating base regitser operation rules" << endl;
-    this->base_idx = 0 + 15 * this->task_nr; // initilizing base array // multi_task
-    this->stack_top = -1 + 15 * this->task_nr; // init stack_depth = 0 // multi_task
-    string str;
+void Policy::gen_base_operation(RuleSet &rules){
+    LOG(LOG_DEBUG) << "Start generating base regitser operation rules" << endl;
+    this->base_idx = this->stack_base; // initilizing base array // multi_task
+    this->stack_top = -1 + this->stack_base; // init stack_depth = 0 // multi_task
     for (int i = 0; i < this->all_aims.size(); i++){
         Aim* it = this->all_aims[i];
-        if (it->get_aim_name() == "Init"){ // similar with Move(). Init will not change base_idx
+        switch (it->get_kind()){
+        case AIM_INIT: { // similar with Move(). Init will not change base_idx
             int post_qpn = this->find_next_post_qpn(i);
-            str += gen_cache_process_addr_to_reg_h_tab(((Init*)it)->get_init_qpn(), 
+            gen_cache_process_addr_to_reg_h_tab(rules, ((Init*)it)->get_init_qpn(), 
                 post_qpn, this->stack_top + 1, 2); // write reg
-            str += gen_cache_process_addr_to_reg_l_tab(((Init*)it)->get_init_qpn(), 
+            gen_cache_process_addr_to_reg_l_tab(rules, ((Init*)it)->get_init_qpn(), 
                 post_qpn, this->stack_top + 1, 2); // write reg
+            break;
         }
-        if (it->get_aim_name() == "ReadMove"){
+        case AIM_READMOVE: {
             this->base_idx = this->stack_top + 1; // store new address to stack_top + 1
                                                   // base after rmove() will be read from there.
             if (((ReadMove *)it)->get_qpn_null() != -1){ // not last Move before Jmp 
                 int post_qpn = this->find_next_post_qpn(i); // Jmp will not be covered
-                str += gen_cache_process_addr_to_reg_h_tab(this->qpn_tran(((ReadMove *)it)->get_post_qpn()), 
+                gen_cache_process_addr_to_reg_h_tab(rules, this->qpn_tran(((ReadMove *)it)->get_post_qpn()), 
                     post_qpn, this->stack_top + 1, 2); // write reg_h // QPN_TRAN
-                str += gen_cache_process_addr_to_reg_l_tab(this->qpn_tran(((ReadMove *)it)->get_post_qpn()), 
+                gen_cache_process_addr_to_reg_l_tab(rules, this->qpn_tran(((ReadMove *)it)->get_post_qpn()), 
                     post_qpn, this->stack_top + 1, 2); // write reg_l // QPN_TRAN
             }   
             else{ // this is a jmp after move
                 // find next jmp
-                int j;
-                for (j = i+1; j < this->all_aims.size(); j++){
-                    if (this->all_aims[j]->get_aim_name() == "NegJump"){
-                        NegJump * njump = (NegJump *)(this->all_aims[j]);
-                        str += gen_cache_process_addr_to_reg_h_tab(this->qpn_tran(((ReadMove *)it)->get_post_qpn()), 
-                            njump->get_true_post_qpn(), this->stack_top + 1, 2); // write reg_h // QPN_TRAN
-                        str += gen_cache_process_addr_to_reg_l_tab(this->qpn_tran(((ReadMove *)it)->get_post_qpn()),
-                            njump->get_true_post_qpn(), this->stack_top + 1, 2); // write reg_l // QPN_TRAN
-                        //str += "hello\n"; //debug
-                        str += gen_cache_process_addr_to_reg_h_tab(this->qpn_tran(((ReadMove *)it)->get_post_qpn()),
+                int j = this->cfg.get_next_negjump(i);
+                if (j != -1){
+                    NegJump * njump = (NegJump *)(this->all_aims[j]);
+                    gen_cache_process_addr_to_reg_h_tab(rules, this->qpn_tran(((ReadMove *)it)->get_post_qpn()), 
+                        njump->get_true_post_qpn(), this->stack_top + 1, 2); // write reg_h // QPN_TRAN
+                    gen_cache_process_addr_to_reg_l_tab(rules, this->qpn_tran(((ReadMove *)it)->get_post_qpn()),
+                        njump->get_true_post_qpn(), this->stack_top + 1, 2); // write reg_l // QPN_TRAN
+                    //str += "hello\n"; //debug
+                    if (!njump->get_direct_exit()){ // a threaded exit is read by the Move() it goes to
+                        gen_cache_process_addr_to_reg_h_tab(rules, this->qpn_tran(((ReadMove *)it)->get_post_qpn()),
                             njump->get_false_post_qpn(), this->stack_top + 1, 2); // write reg_h // QPN_TRAN
-                        str += gen_cache_process_addr_to_reg_l_tab(this->qpn_tran(((ReadMove *)it)->get_post_qpn()),
+                        gen_cache_process_addr_to_reg_l_tab(rules, this->qpn_tran(((ReadMove *)it)->get_post_qpn()),
                             njump->get_false_post_qpn(), this->stack_top + 1, 2); // write reg_l // QPN_TRAN
-                        break;
+                    }
+                }
+                // exits threaded into this traverse by optimize_aims(): read its base back
+                // from the stack, for them and for the fake state their load went through
+                if (((ReadMove *)it)->get_prev_qpn_size() > 1){
+                    for (int prev_qpn: ((ReadMove *)it)->get_prev_qpn()){
+                        gen_cache_process_addr_to_reg_h_tab(rules, prev_qpn, ((ReadMove *)it)->get_post_qpn(),
+                            this->stack_top + 1, 1); // read reg_h
+                        gen_cache_process_addr_to_reg_l_tab(rules, prev_qpn, ((ReadMove *)it)->get_post_qpn(),
+                            this->stack_top + 1, 1); // read reg_l
                     }
                 }
             } 
+            break;
         } // end of rmove
-        if (it->get_aim_name() == "ReadLoad"){
-            if (((ReadLoad *)it)->get_tran_qpn() != -1){ // last load statement, use end trans
-                int  j;
-                for (j = i+1; j < this->all_aims.size(); j++){
-                    if (this->all_aims[j]->get_aim_name() == "ConstMove"){
-                        // if cmove, no action. Empty is included
-                        break;
-                    }
-                    if (this->all_aims[j]->get_aim_name() == "ReadMove"){
+        case AIM_READLOAD: {
+            if (this->is_rebase(((ReadLoad *)it)->get_tran_qpn())){ // next body, read the element back
+                int rebase = ((ReadLoad *)it)->get_tran_qpn();
+                int post_qpn = this->find_next_post_qpn(i);
+                gen_cache_process_addr_to_reg_h_tab(rules, rebase, post_qpn, this->stack_top, 1); // read reg_h
+                gen_cache_process_addr_to_reg_l_tab(rules, rebase, post_qpn, this->stack_top, 1); // read reg_l
+                this->base_idx = this->stack_top;
+            }
+            else if (((ReadLoad *)it)->get_tran_qpn() != -1){ // last load statement, use end trans
+                int j = this->cfg.get_next_move(i);
+                if (j != -1){
+                    // if cmove, no action. Empty is included
+                    if (this->all_aims[j]->get_kind() == AIM_READMOVE){
                         // if rmove, read. Should use fake qpn
                         // int post_qpn = this->find_next_post_qpn(i);
                         ReadMove * rmove = (ReadMove *)(this->all_aims[j]);
@@ -1051,27 +1310,27 @@ string Policy::gen_base_operation(){
                         }
                         int prev_qpn = rmove->get_prev_qpn().at(0);
                         
-                        str += gen_cache_process_addr_to_reg_h_tab(prev_qpn, post_qpn, this->stack_top, 1);   // temperor fix: pop indication  // more fix
-                        str += gen_cache_process_addr_to_reg_l_tab(prev_qpn, post_qpn, this->stack_top, 1);  // temperor fix: pop indication  // more fix
-                        break;
+                        gen_cache_process_addr_to_reg_h_tab(rules, prev_qpn, post_qpn, this->stack_top, 1);   // temperor fix: pop indication  // more fix
+                        gen_cache_process_addr_to_reg_l_tab(rules, prev_qpn, post_qpn, this->stack_top, 1);  // temperor fix: pop indication  // more fix
                     }
                 }
             }
             else { // this load is not the last primitive
-                if (this->all_aims[i+1]->get_aim_name() != "ConstMove"){
+                if (this->all_aims[i+1]->get_kind() != AIM_CONSTMOVE){
                     int post_qpn = this->find_next_post_qpn(i); // Jmp will be covered in the first case
-                    str += gen_cache_process_addr_to_reg_h_tab(this->qpn_tran(((ReadLoad*)it)->get_post_qpn()), post_qpn, 
+                    gen_cache_process_addr_to_reg_h_tab(rules, this->qpn_tran(((ReadLoad*)it)->get_post_qpn()), post_qpn, 
                     this->base_idx, 1); // read reg // QPN_TRAN
-                    str += gen_cache_process_addr_to_reg_l_tab(this->qpn_tran(((ReadLoad*)it)->get_post_qpn()), post_qpn, 
+                    gen_cache_process_addr_to_reg_l_tab(rules, this->qpn_tran(((ReadLoad*)it)->get_post_qpn()), post_qpn, 
                     this->base_idx, 1); // read reg // QPN_TRAN
                 }
             }
+            break;
         } // end of rload
-        if (it->get_aim_name() == "ConstMove"){
+        case AIM_CONSTMOVE: {
             if (i == 0){
                 throw_error("ERROR: ConstMove is placed at top!");
             }
-            if (this->all_aims[i-1]->get_aim_name() == "Pop"){
+            if (this->all_aims[i-1]->get_kind() == AIM_POP){
                 //int count;
                 // for (count = 0; count < ((ConstMove *)it)->get_prev_qpn().size(); count++){
                 //     str += gen_cache_process_addr_to_reg_h_tab(((ConstMove *)it)->get_prev_qpn().at(count), 
@@ -1089,53 +1348,60 @@ string Policy::gen_base_operation(){
                 }
                 int j;
                 for (j = i+1; j < this->all_aims.size(); j++){
-                    if (this->all_aims[j]->get_aim_name() == "DecJump"){
+                    if (this->all_aims[j]->get_kind() == AIM_DECJUMP){
                         DecJump * djump = (DecJump *)(this->all_aims[j]);
-                        str += gen_cache_process_addr_to_reg_h_tab(((ConstMove *)it)->get_prev_qpn().at(0), 
-                            djump->get_false_post_qpn(), this->base_idx, 1); // read reg
-                        str += gen_cache_process_addr_to_reg_l_tab(((ConstMove *)it)->get_prev_qpn().at(0), 
-                            djump->get_false_post_qpn(), this->base_idx, 1); // read reg
-                        str += gen_cache_process_addr_to_reg_h_tab(((ConstMove *)it)->get_prev_qpn().at(0), 
+                        if (!djump->get_direct_exit()){ // a threaded exit is read by the Move() it goes to
+                            gen_cache_process_addr_to_reg_h_tab(rules, ((ConstMove *)it)->get_prev_qpn().at(0), 
+                                djump->get_false_post_qpn(), this->base_idx, 1); // read reg
+                            gen_cache_process_addr_to_reg_l_tab(rules, ((ConstMove *)it)->get_prev_qpn().at(0), 
+                                djump->get_false_post_qpn(), this->base_idx, 1); // read reg
+                        }
+                        gen_cache_process_addr_to_reg_h_tab(rules, ((ConstMove *)it)->get_prev_qpn().at(0), 
                             djump->get_true_post_qpn(), this->base_idx, 1); // read reg
-                        str += gen_cache_process_addr_to_reg_l_tab(((ConstMove *)it)->get_prev_qpn().at(0), 
+                        gen_cache_process_addr_to_reg_l_tab(rules, ((ConstMove *)it)->get_prev_qpn().at(0), 
                             djump->get_true_post_qpn(), this->base_idx, 3); // mod reg
-                        str += gen_cache_size_into_md_tab((((ConstMove *)it)->get_prev_qpn().at(0)), 
+                        gen_cache_size_into_md_tab(rules, (((ConstMove *)it)->get_prev_qpn().at(0)), 
                          ((ConstMove *)it)->get_offset()); // max_len is fine
                     }
                     break;
                 }
             }
             // patching, if load is infront of constmove, modify register directly.
-            else if (this->all_aims[i-1]->get_aim_name() == "ReadLoad"){
+            else if (this->all_aims[i-1]->get_kind() == AIM_READLOAD){
                 // handle special situation, semantically there must be a move already
-                str += gen_cache_process_addr_to_reg_h_tab(((ConstMove *)it)->get_prev_qpn().at(0), 
+                gen_cache_process_addr_to_reg_h_tab(rules, ((ConstMove *)it)->get_prev_qpn().at(0), 
                     ((ConstMove *)it)->get_post_qpn(), this->base_idx, 1); // read reg
-                str += gen_cache_process_addr_to_reg_l_tab(((ConstMove *)it)->get_prev_qpn().at(0), 
+                gen_cache_process_addr_to_reg_l_tab(rules, ((ConstMove *)it)->get_prev_qpn().at(0), 
                     ((ConstMove *)it)->get_post_qpn(), this->base_idx, 3);
                 // gen rule for encoding offset
-                str += gen_cache_size_into_md_tab(((ConstMove *)it)->get_prev_qpn().at(0), 
+                gen_cache_size_into_md_tab(rules, ((ConstMove *)it)->get_prev_qpn().at(0), 
                     ((ConstMove *)it)->get_offset());
             }
             else { // add mod_para table for cmove
                 int count;
                 for (count = 0; count < ((ConstMove *)it)->get_prev_qpn().size(); count++){
-                    str += gen_mod_field_parameters_pre_tab(((ConstMove *)it)->get_prev_qpn().at(count), 
+                    gen_mod_field_parameters_pre_tab(rules, ((ConstMove *)it)->get_prev_qpn().at(count), 
                         ((ConstMove *)it)->get_post_qpn(), ((ConstMove *)it)->get_offset()); // direct add offset
                 }
             }
+            break;
         } // end of cmove
-        if (it->get_aim_name() == "Push"){
+        case AIM_PUSH: {
             this->stack_top++; // base_idx remains the same
+            break;
         }
-        if (it->get_aim_name() == "Pop"){
+        case AIM_POP: {
             this->stack_top--;
-            if (this->stack_top <= -2){
+            if (this->stack_top <= this->stack_base - 2){
                 throw_error("Invalid pop behavior!");
             }
             base_idx = this->stack_top + 1;
+            break;
+        }
+        default:
+            break;
         }
     }
-    return str;
 }
 
 //// cache timestamp
@@ -1146,134 +1412,173 @@ string Policy::gen_base_operation(){
 ////    str += "pd read_update_ts_start_tab add_entry read_update_ts_start ib_aeth_valid 1 md_qpn " + to_string(qpn) + " md_sign 0" + '\n';
 //    return str;
 //}
-string gen_read_update_ts_start_tab(int qpn){
-    string str;
-    str += "pd read_update_ts_start_tab add_entry read_update_ts_start ib_aeth_valid 1 ib_bth_dqpn " + to_string(qpn) + '\n';
+void gen_read_update_ts_start_tab(RuleSet &rules, int qpn){
+    rules.add("read_update_ts_start_tab", "read_update_ts_start")
+        .key("ib_aeth_valid", 1).key_dqpn("ib_bth_dqpn", qpn);
 //    str += "pd read_update_ts_start_tab add_entry read_update_ts_start ib_aeth_valid 1 md_qpn " + to_string(qpn) + " md_sign 0" + '\n';
-    return str;
 }
 
-string gen_read_update_toggle_start_tab(int qpn){
-    string str;
-    str += "pd read_update_toggle_start_tab add_entry read_update_toggle_start ib_aeth_valid 1 md_qpn " + to_string(qpn) + '\n';
-    return str;
+void gen_read_update_toggle_start_tab(RuleSet &rules, int qpn){
+    rules.add("read_update_toggle_start_tab", "read_update_toggle_start")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn);
 }
 
 
-string Policy::gen_psn_mapping(){
-    cout << "Start generating PSN mapping" << endl;
-    string code;
+/**
+ * The psn register is indexed by QPN state from the first one of the
+ * install on, so the init state of every policy, which issues no read,
+ * leaves a slot unused. With dense_psn the states that issue reads are
+ * numbered from 0 without gaps: every policy before this one took all
+ * its states but the init state, this one takes them in order.
+ */
+void Policy::number_psn(){
+    this->psn_slots.clear();
+    if (!this->dense_psn)
+        return;
+    vector<int> states;
+    for (Aim* it: this->all_aims){
+        if (it->get_kind() == AIM_READLOAD)
+            states.push_back(((ReadLoad *)it)->get_post_qpn());
+        else if (it->get_kind() == AIM_READMOVE)
+            states.push_back(((ReadMove *)it)->get_post_qpn());
+    }
+    for (Aim* it: this->pgt_aims)
+        states.push_back(((ReadLoad *)it)->get_post_qpn());
+    sort(states.begin(), states.end());
+    states.erase(unique(states.begin(), states.end()), states.end());
+    if ((int)states.size() != this->avail_state - this->first_state - 1)
+        throw_error(to_string(this->avail_state - this->first_state - (int)states.size()) +
+            " QPN states issue no read, only the init state may");
+    int slot = this->first_state - this->base_state + 1 - this->task_nr;
+    for (int q: states)
+        this->psn_slots[q] = slot++;
+}
+
+int Policy::psn_slot(int qpn){
+    if (!this->dense_psn)
+        return qpn - this->base_state;
+    return this->psn_slots.at(qpn);
+}
+
+void Policy::gen_psn_mapping(RuleSet &rules){
+    LOG(LOG_DEBUG) << "Start generating PSN mapping" << endl;
     for (int i = 0; i < this->all_aims.size(); i++){
-        if (this->all_aims[i]->get_aim_name() == "ReadLoad"){
+        switch (this->all_aims[i]->get_kind()){
+        case AIM_READLOAD: {
             ReadLoad * rload = (ReadLoad *)(this->all_aims[i]);
-            code += gen_read_update_psn_tab(rload->get_post_qpn(), rload->get_post_qpn() - this->base_state);
-            code += gen_read_update_psn_def_tab(this->qpn_tran(rload->get_post_qpn()), rload->get_post_qpn() - this->base_state);
+            gen_read_update_psn_tab(rules, rload->get_post_qpn(), this->psn_slot(rload->get_post_qpn()), this->dense_psn);
+            gen_read_update_psn_def_tab(rules, this->qpn_tran(rload->get_post_qpn()), this->psn_slot(rload->get_post_qpn()));
             // caching timestapm
             // temperary disable
-            //code += gen_read_update_ts_start_tab(this->qpn_tran(rload->get_post_qpn()), rload->get_post_qpn() - this->base_state);
+            //code += gen_read_update_ts_start_tab(this->qpn_tran(rload->get_post_qpn()), this->psn_slot(rload->get_post_qpn()));
+            break;
         }
-        if (this->all_aims[i]->get_aim_name() == "ReadMove"){
+        case AIM_READMOVE: {
             ReadMove * rmove = (ReadMove *)(this->all_aims[i]);
-            code += gen_read_update_psn_tab(rmove->get_post_qpn(), rmove->get_post_qpn() - this->base_state);
-            code += gen_read_update_psn_def_tab(this->qpn_tran(rmove->get_post_qpn()), rmove->get_post_qpn() - this->base_state);
+            gen_read_update_psn_tab(rules, rmove->get_post_qpn(), this->psn_slot(rmove->get_post_qpn()), this->dense_psn);
+            gen_read_update_psn_def_tab(rules, this->qpn_tran(rmove->get_post_qpn()), this->psn_slot(rmove->get_post_qpn()));
             // temperary disable
-            //code += gen_read_update_ts_start_tab(this->qpn_tran(rmove->get_post_qpn()), rmove->get_post_qpn() - this->base_state);
+            //code += gen_read_update_ts_start_tab(this->qpn_tran(rmove->get_post_qpn()), this->psn_slot(rmove->get_post_qpn()));
+            break;
+        }
+        default:
+            break;
         }
     }
-    return code;
 }
 
-string Policy::gen_offset_encoding(){
-    cout << "Start encoding offsets" << endl;
-    string code;
+void Policy::gen_offset_encoding(RuleSet &rules){
+    LOG(LOG_DEBUG) << "Start encoding offsets" << endl;
     for (int i = 0; i < this->all_aims.size(); i++){
-        if (this->all_aims[i]->get_aim_name() == "ReadLoad"){
+        switch (this->all_aims[i]->get_kind()){
+        case AIM_READLOAD: {
             ReadLoad * rload = (ReadLoad *)(this->all_aims[i]);
             int j = 0; 
             for (j = 0;  j < rload->get_prev_qpn_size(); j++){
-                code += gen_mod_field_parameters_tab(rload->get_prev_qpn().at(j), rload->get_post_qpn(), 
-                    rload->get_offset());
+                gen_mod_field_parameters_tab(rules, rload->get_prev_qpn().at(j), rload->get_post_qpn(), 
+                    rload->get_offset(), rload->get_size());
             }
+            break;
         }
-        if (this->all_aims[i]->get_aim_name() == "ReadMove"){
+        case AIM_READMOVE: {
             ReadMove * rmove = (ReadMove *)(this->all_aims[i]);
             int j = 0; 
             for (j = 0;  j < rmove->get_prev_qpn_size(); j++){
-                code += gen_mod_field_parameters_tab(rmove->get_prev_qpn().at(j), rmove->get_post_qpn(), 
+                gen_mod_field_parameters_tab(rules, rmove->get_prev_qpn().at(j), rmove->get_post_qpn(), 
                     rmove->get_offset());
             }
+            break;
+        }
+        default:
+            break;
         }
     }
-    return code;
 }
 
-string Policy::gen_load_max(){
-    cout << "Start encoding max entry loading" << endl;
-    string str;
+void Policy::gen_load_max(RuleSet &rules){
+    LOG(LOG_DEBUG) << "Start encoding max entry loading" << endl;
     for (int i = 0; i < this->all_aims.size(); i++){
-        if (this->all_aims[i]->get_aim_name() == "ReadLoad"){
+        switch (this->all_aims[i]->get_kind()){
+        case AIM_READLOAD: {
             ReadLoad * rload = (ReadLoad *)(this->all_aims[i]);
             if (rload->get_reg_index() == -1){
                 // no action
             }
             else { // use rload post QPN as key for loading
-                str += gen_read_update_max_entry_tab(this->qpn_tran(rload->get_post_qpn()), 
+                gen_read_update_max_entry_tab(rules, this->qpn_tran(rload->get_post_qpn()), 
                     rload->get_reg_index(), 2); // load aeth // QPN_TRAN
             }
+            break;
         }
-        if (this->all_aims[i]->get_aim_name() == "ConstLoad"){ // 1. update md.max_len; 2. store into cload->seq
+        case AIM_CONSTLOAD: { // 1. update md.max_len; 2. store into cload->seq
             ConstLoad * cload = (ConstLoad *)(this->all_aims[i]);
             int j = 0;
             for(j = 0; j< cload->get_prev_qpn().size(); j++){
-            str += gen_cache_len_into_md_tab(cload->get_prev_qpn().at(j), cload->get_value()); // size can be 0
-            str += gen_read_update_max_entry_tab(cload->get_prev_qpn().at(j), cload->get_seq(), 1); // const length
+            gen_cache_len_into_md_tab(rules, cload->get_prev_qpn().at(j), cload->get_value()); // size can be 0
+            gen_read_update_max_entry_tab(rules, cload->get_prev_qpn().at(j), cload->get_seq(), 1); // const length
             }
+            break;
+        }
+        default:
+            break;
         }
     }
-    return str;
 }
 
-string Policy::gen_init_code(Init * in){
+void Policy::gen_init_code(RuleSet &rules, Init * in){
     in->set_post_qpn(999 - this->task_nr);
-    string str = gen_end_of_fetching_tab(in->get_post_qpn()); // set dropping table
+    gen_end_of_fetching_tab(rules, in->get_post_qpn()); // set dropping table
     // By default, kgraph is the first base(like a In()/Move())
     // which means address should be put into reg
 
     // cache time stamp in switch
     // removed for now
-      str += gen_read_update_ts_start_tab(in->get_init_qpn());
+      gen_read_update_ts_start_tab(rules, in->get_init_qpn());
 //    str += gen_read_update_toggle_start_tab(in->get_init_qpn());
 
-    return str;
 }
 
-string Policy::gen_constload_code(ConstLoad * cload){ 
-    string str;
-    return str;
+void Policy::gen_constload_code(RuleSet &rules, ConstLoad * cload){ 
 }
 
 
 // range match helper function
-string gen_range_match_tab(int qpn, int range_1, int range_2){
-    string str;
-    str += "pd range_match_tab add_entry mark_range_k2 ib_aeth_valid 1 md_qpn " + to_string(qpn) + 
-        " md_addr_h_16_start " + to_string(range_1) + " md_addr_h_16_end " + to_string(range_2) + " priority 0\n";
-    return str;
+void gen_range_match_tab(RuleSet &rules, int qpn, int range_1, int range_2){
+    rules.add("range_match_tab", "mark_range_k2")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_addr_h_16_start", range_1)
+        .key("md_addr_h_16_end", range_2).prio(0);
 }
 
-string gen_exact_match_tab(int qpn, string addr_h, string range_1, string range_2){
-    string str;
-    str += "pd exact_match_tab add_entry mark_range_k1 ib_aeth_valid 1 md_qpn " + to_string(qpn) + 
-        " md_addr_h_16 0x" + addr_h + " md_addr_l_16_start 0x" + range_1 + " md_addr_l_16_end 0x" + range_2 +
-        " priority 0\n";  
-    return str;
+void gen_exact_match_tab(RuleSet &rules, int qpn, string addr_h, string range_1, string range_2){
+    rules.add("exact_match_tab", "mark_range_k1")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_hex("md_addr_h_16", addr_h)
+        .key_hex("md_addr_l_16_start", range_1).key_hex("md_addr_l_16_end", range_2).prio(0);  
 }
 
-string gen_gen_mali_alarm_tab(int dqpn){
-    string str;
-    str += "pd gen_mali_alarm_tab add_entry gen_mali_alarm ib_bth_dqpn " + to_string(dqpn) + " md_k1 0 md_k2 0 " + 
-        "eg_intr_md_from_parser_aux_clone_src 1\n";
-    return str;
+void gen_gen_mali_alarm_tab(RuleSet &rules, int dqpn){
+    rules.add("gen_mali_alarm_tab", "gen_mali_alarm")
+        .key_dqpn("ib_bth_dqpn", dqpn).key("md_k1", 0).key("md_k2", 0)
+        .key("eg_intr_md_from_parser_aux_clone_src", 1);
 }
 
 // string gen_gen_range_digest_tab(int qpn){
@@ -1283,321 +1588,299 @@ string gen_gen_mali_alarm_tab(int dqpn){
 //     return str;
 // }
 
-string Policy::gen_readload_code(ReadLoad * rload){
+void Policy::gen_readload_code(RuleSet &rules, ReadLoad * rload){
     // return/log the readload result with clone tab
     // range check the result if rload->get_range_check == 1
-    string str;
-    str += gen_cloning_tab(this->qpn_tran(rload->get_post_qpn()));
+    gen_cloning_tab(rules, this->qpn_tran(rload->get_post_qpn()));
     if (rload->get_range_check() == 1){ // need to range check the result
         // todo need to add range check content
         string high_prev = rload->get_high_prev();
         string high_post = rload->get_high_post();
         string low_prev = rload->get_low_prev();
         string low_post = rload->get_low_post();
-        str += gen_exact_match_tab(this->qpn_tran(rload->get_post_qpn()), high_prev, "0", high_post);
-        str += gen_exact_match_tab(this->qpn_tran(rload->get_post_qpn()), low_prev, low_post, "0xffff");
-        str += gen_range_match_tab(this->qpn_tran(rload->get_post_qpn()), stoi(low_prev, 0, 16) + 1, 
+        // the bounds are the low 32 bits of kernel addresses
+        uint64_t high = 0xffffffff00000000ull | stoull(rload->get_high(), 0, 16);
+        uint64_t low = 0xffffffff00000000ull | stoull(rload->get_low(), 0, 16);
+        gen_exact_match_tab(rules, this->qpn_tran(rload->get_post_qpn()), high_prev, "0", high_post);
+        rules.kaslr("md_addr_h_16", high, 16, 16).kaslr("md_addr_l_16_end", high, 0, 16);
+        gen_exact_match_tab(rules, this->qpn_tran(rload->get_post_qpn()), low_prev, low_post, "0xffff");
+        rules.kaslr("md_addr_h_16", low, 16, 16).kaslr("md_addr_l_16_start", low, 0, 16);
+        gen_range_match_tab(rules, this->qpn_tran(rload->get_post_qpn()), stoi(low_prev, 0, 16) + 1, 
             stoi(high_prev, 0, 16) - 1);
+        rules.kaslr("md_addr_h_16_start", low, 16, 16, 1).kaslr("md_addr_h_16_end", high, 16, 16, -1);
         // str += gen_gen_range_digest_tab(this->qpn_tran(rload->get_post_qpn()));
-        str += gen_gen_mali_alarm_tab(this->qpn_tran(rload->get_post_qpn()));
+        gen_gen_mali_alarm_tab(rules, this->qpn_tran(rload->get_post_qpn()));
     }
-    return str;
 }
 
-string Policy::gen_decjump_code(DecJump * djump){
-    string str;
-    return str;
+void Policy::gen_decjump_code(RuleSet &rules, DecJump * djump){
 }
 
-string Policy::gen_negjump_code(NegJump * njump){
-    string str;
-    return str;
+void Policy::gen_negjump_code(RuleSet &rules, NegJump * njump){
 }
 
-string Policy::gen_pop_code(Pop * pop){
-    string str;
-    return str;
+void Policy::gen_pop_code(RuleSet &rules, Pop * pop){
 }
 
-string Policy::gen_push_code(Push * push){
-    string str;
-    return str;
+void Policy::gen_push_code(RuleSet &rules, Push * push){
 }
 
-string Policy::gen_readmove_code(ReadMove * rmove){
-    string str;
-    return str;
+void Policy::gen_readmove_code(RuleSet &rules, ReadMove * rmove){
 }
 
-string Policy::gen_constmove_code(ConstMove * cmove){
-    string str;
-    return str;
+void Policy::gen_constmove_code(RuleSet &rules, ConstMove * cmove){
 }
 
 // page table walk helper function
 // gen page table walk address check table
-string gen_mark_vmalloc_bit_p1_tab(int qpn){
-    string str;
-    str += "pd mark_vmalloc_bit_p1_tab add_entry mark_addr_type ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-        " md_aeth_addr_h 0xffffffff md_aeth_addr_h_mask 0xffffffff priority 10 action_tp 1\n";
-    str += "pd mark_vmalloc_bit_p1_tab add_entry mark_addr_type ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-        " md_aeth_addr_h 0xffff0000 md_aeth_addr_h_mask 0xffff0000 priority 100 action_tp 2\n";
-    return str;
+void gen_mark_vmalloc_bit_p1_tab(RuleSet &rules, int qpn){
+    rules.add("mark_vmalloc_bit_p1_tab", "mark_addr_type")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_hex("md_aeth_addr_h", "ffffffff")
+        .key_hex("md_aeth_addr_h_mask", "ffffffff").prio(10).param("tp", 1);
+    rules.add("mark_vmalloc_bit_p1_tab", "mark_addr_type")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key_hex("md_aeth_addr_h", "ffff0000")
+        .key_hex("md_aeth_addr_h_mask", "ffff0000").prio(100).param("tp", 2);
 }
-string gen_mark_vmalloc_bit_p2_tab(){ // stored in qpn_ts
-    string str;
-    return str;
+void gen_mark_vmalloc_bit_p2_tab(RuleSet &rules){ // stored in qpn_ts
 }
 
 // gen sig page table walk end table
-string gen_mark_walking_bit_tab(int dqpn){
-    string str;
-    str += "pd mark_walking_bit_tab add_entry mark_walking_bit ib_aeth_valid 1 ib_bth_dqpn " +
-        to_string(dqpn) + '\n';
-    return str;
+void gen_mark_walking_bit_tab(RuleSet &rules, int dqpn){
+    rules.add("mark_walking_bit_tab", "mark_walking_bit")
+        .key("ib_aeth_valid", 1).key_dqpn("ib_bth_dqpn", dqpn);
 }
 
 //gen pgt transfer table
-string gen_pgt_transfer_tab(int qpn, int dqpn, int vmalloc_bit){
-    string str;
-    str += "pd pgt_transfer_tab add_entry pgt_mod_dqpn ib_aeth_valid 1 md_qpn " + to_string(qpn) + " md_vmalloc_bit " +
-        to_string(vmalloc_bit) + " action_dqpn " + to_string(dqpn) + " action_qpn " + to_string(dqpn) + '\n';
-    return str;
+void gen_pgt_transfer_tab(RuleSet &rules, int qpn, int dqpn, int vmalloc_bit){
+    rules.add("pgt_transfer_tab", "pgt_mod_dqpn")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_vmalloc_bit", vmalloc_bit).param_dqpn("dqpn", dqpn)
+        .param_qpn("qpn", dqpn);
 }
 
 // gen QPN/dQPN caching table
-string gen_cache_dqpn_page_walk_tab(int qpn, int vmalloc_bit, int walking_bit, int idx, int act){
-    string str;
+void gen_cache_dqpn_page_walk_tab(RuleSet &rules, int qpn, int vmalloc_bit, int walking_bit, int idx, int act){
     switch(act){
         case 1: // read
-            str += "pd cache_dqpn_page_walk_tab add_entry read_dqpn_page_walk ib_aeth_valid 1 md_qpn " +
-                to_string(qpn) + " md_vmalloc_bit " + to_string(vmalloc_bit) + " md_walking_bit " +
-                to_string(walking_bit) + " action_idx " + to_string(idx) + '\n';
+            rules.add("cache_dqpn_page_walk_tab", "read_dqpn_page_walk")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_vmalloc_bit", vmalloc_bit)
+                .key("md_walking_bit", walking_bit).param("idx", idx).rel("idx", REL_TASK);
             break;
         case 2: // cache
-            str += "pd cache_dqpn_page_walk_tab add_entry cache_dqpn_page_walk ib_aeth_valid 1 md_qpn " +
-                to_string(qpn) + " md_vmalloc_bit " + to_string(vmalloc_bit) + " md_walking_bit " +
-                to_string(walking_bit) + " action_idx " + to_string(idx) + '\n';
+            rules.add("cache_dqpn_page_walk_tab", "cache_dqpn_page_walk")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_vmalloc_bit", vmalloc_bit)
+                .key("md_walking_bit", walking_bit).param("idx", idx).rel("idx", REL_TASK);
             break;
     }
-    return str;
 }
-string gen_cache_qpn_page_walk_tab(int qpn, int vmalloc_bit, int walking_bit, int idx, int act){
-    string str;
+void gen_cache_qpn_page_walk_tab(RuleSet &rules, int qpn, int vmalloc_bit, int walking_bit, int idx, int act){
     switch(act){
         case 1: // read
-            str += "pd cache_qpn_page_walk_tab add_entry read_qpn_page_walk ib_aeth_valid 1 md_qpn " +
-                to_string(qpn) + " md_vmalloc_bit " + to_string(vmalloc_bit) + " md_walking_bit " +
-                to_string(walking_bit) + " action_idx " + to_string(idx) + '\n';
+            rules.add("cache_qpn_page_walk_tab", "read_qpn_page_walk")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_vmalloc_bit", vmalloc_bit)
+                .key("md_walking_bit", walking_bit).param("idx", idx).rel("idx", REL_TASK);
             break;
         case 2: // cache
-            str += "pd cache_qpn_page_walk_tab add_entry cache_qpn_page_walk ib_aeth_valid 1 md_qpn " +
-                to_string(qpn) + " md_vmalloc_bit " + to_string(vmalloc_bit) + " md_walking_bit " +
-                to_string(walking_bit) + " action_idx " + to_string(idx) + '\n';
+            rules.add("cache_qpn_page_walk_tab", "cache_qpn_page_walk")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_vmalloc_bit", vmalloc_bit)
+                .key("md_walking_bit", walking_bit).param("idx", idx).rel("idx", REL_TASK);
             break;
     }
-    return str;
 }
 // gen base addr caching table
-string gen_cache_process_page_addr_to_reg_h_tab(int qpn, int walking_bit, int idx,int act){
-    string str;
+void gen_cache_process_page_addr_to_reg_h_tab(RuleSet &rules, int qpn, int walking_bit, int idx,int act){
     switch(act){
         case 1: // read
-            str += "pd cache_process_page_addr_to_reg_h_tab add_entry read_process_page_addr_to_reg_h ib_aeth_valid 1 md_walking_bit "
-                + to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0" 
-                  " action_idx " + to_string(idx) + '\n'; 
+            rules.add("cache_process_page_addr_to_reg_h_tab", "read_process_page_addr_to_reg_h")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0).param("idx", idx).rel("idx", REL_TASK); 
             break;
         case 2: // cache
-            str += "pd cache_process_page_addr_to_reg_h_tab add_entry cache_process_page_addr_to_reg_h ib_aeth_valid 1 md_walking_bit "
-                + to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0"
-                + " action_idx " + to_string(idx) + '\n';  
+            rules.add("cache_process_page_addr_to_reg_h_tab", "cache_process_page_addr_to_reg_h")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0).param("idx", idx).rel("idx", REL_TASK);  
             break;
     }
-    return str;
 }
-string gen_cache_process_page_addr_to_reg_l_tab(int qpn, int walking_bit, int idx, int act){
-    string str;
+void gen_cache_process_page_addr_to_reg_l_tab(RuleSet &rules, int qpn, int walking_bit, int idx, int act){
     switch(act){
         case 1: // read
-            str += "pd cache_process_page_addr_to_reg_l_tab add_entry read_process_page_addr_to_reg_l ib_aeth_valid 1 md_walking_bit "
-                + to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0" 
-                  " action_idx " + to_string(idx) + '\n';
+            rules.add("cache_process_page_addr_to_reg_l_tab", "read_process_page_addr_to_reg_l")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0).param("idx", idx).rel("idx", REL_TASK);
             break;
         case 2:
-            str += "pd cache_process_page_addr_to_reg_l_tab add_entry cache_process_page_addr_to_reg_l ib_aeth_valid 1 md_walking_bit "
-            + to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0" 
-                  " action_idx " + to_string(idx) + '\n';
+            rules.add("cache_process_page_addr_to_reg_l_tab", "cache_process_page_addr_to_reg_l")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0).param("idx", idx).rel("idx", REL_TASK);
             break;
     }
-    return str;
 }
 // gen 4 level page table walk table
-string gen_add_offset_1_tab(int qpn, int walking_bit, int act){
-    string str;
+void gen_add_offset_1_tab(RuleSet &rules, int qpn, int walking_bit, int act){
     switch(act){
         case 1:
-            str += "pd add_offset_1_tab add_entry calc_pgd_offset_1 ib_aeth_valid 1 md_walking_bit " + 
-                to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0"
-                + " action_addr_l 0xacc0a000 action_addr_h 0x1d\n";
+            rules.add("add_offset_1_tab", "calc_pgd_offset_1")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0).param_hex("addr_l", "acc0a000")
+                .param_hex("addr_h", "1d").cr3("addr_l", 0, 32).cr3("addr_h", 32, 32);
             break;
         case 2: 
-            str += "pd add_offset_1_tab add_entry calc_pud_offset_1 ib_aeth_valid 1 md_walking_bit " + 
-                to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_1_tab", "calc_pud_offset_1")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 3:
-            str += "pd add_offset_1_tab add_entry calc_pmd_offset_1 ib_aeth_valid 1 md_walking_bit " + 
-                to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_1_tab", "calc_pmd_offset_1")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 4:
-            str += "pd add_offset_1_tab add_entry calc_pte_offset_1 ib_aeth_valid 1 md_walking_bit " + 
-                to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_1_tab", "calc_pte_offset_1")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 5:
-            str += "pd add_offset_1_tab add_entry nop ib_aeth_valid 1 md_walking_bit " + 
-                to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_1_tab", "nop")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
     }
-    return str;
 }
-string gen_add_offset_2_tab(int qpn, int act){
-    string str;
+void gen_add_offset_2_tab(RuleSet &rules, int qpn, int act){
     switch(act){
         case 1:
-            str += "pd add_offset_2_tab add_entry calc_pgd_offset_2 ib_aeth_valid 1 md_qpn " 
-                + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_2_tab", "calc_pgd_offset_2")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 2: 
-            str += "pd add_offset_2_tab add_entry calc_pud_offset_2 ib_aeth_valid 1 md_qpn " 
-                + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_2_tab", "calc_pud_offset_2")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 3:
             break;
     }
-    return str;
 }
-string gen_add_offset_3_tab(int qpn, int walking_bit, int act){
-    string str;
+void gen_add_offset_3_tab(RuleSet &rules, int qpn, int walking_bit, int act){
     switch(act){
         case 1:
-            str += "pd add_offset_3_tab add_entry calc_pgd_offset_3 ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-                + " md_walking_bit " + to_string(walking_bit) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_3_tab", "calc_pgd_offset_3")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_walking_bit", walking_bit)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 2: 
-            str += "pd add_offset_3_tab add_entry calc_pud_offset_3 ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-                + " md_walking_bit " + to_string(walking_bit) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_3_tab", "calc_pud_offset_3")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_walking_bit", walking_bit)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 3:
-            str += "pd add_offset_3_tab add_entry calc_pmd_offset_3 ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-                + " md_walking_bit " + to_string(walking_bit) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_3_tab", "calc_pmd_offset_3")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_walking_bit", walking_bit)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 4:
-            str += "pd add_offset_3_tab add_entry calc_pte_offset_3 ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-                + " md_walking_bit " + to_string(walking_bit) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_3_tab", "calc_pte_offset_3")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_walking_bit", walking_bit)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 5:
-            str += "pd add_offset_3_tab add_entry calc_page_offset_3 ib_aeth_valid 1 md_qpn " + to_string(qpn) +
-                + " md_walking_bit " + to_string(walking_bit) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_3_tab", "calc_page_offset_3")
+                .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_walking_bit", walking_bit)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
         case 6:
-            str += "pd add_offset_3_tab add_entry nop ib_aeth_valid 1 md_walking_bit " + 
-                to_string(walking_bit) + " md_qpn " + to_string(qpn) + " eg_intr_md_from_parser_aux_clone_src 0\n";
+            rules.add("add_offset_3_tab", "nop")
+                .key("ib_aeth_valid", 1).key("md_walking_bit", walking_bit).key_qpn("md_qpn", qpn)
+                .key("eg_intr_md_from_parser_aux_clone_src", 0);
             break;
     }
-    return str;
 }
-string gen_mask_base_addr_tab(int qpn, int walking_bit){
-    string str;
-    str += "pd mask_base_addr_tab add_entry mask_base_addr ib_aeth_valid 1 md_qpn " + to_string(qpn) + " md_walking_bit " + 
-        to_string(walking_bit) + " eg_intr_md_from_parser_aux_clone_src 0\n";
-    return str;
+void gen_mask_base_addr_tab(RuleSet &rules, int qpn, int walking_bit){
+    rules.add("mask_base_addr_tab", "mask_base_addr")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_walking_bit", walking_bit)
+        .key("eg_intr_md_from_parser_aux_clone_src", 0);
 }
-string gen_make_up_addr_tab(int qpn, int walking_bit){
-    string str;
-    str += "pd make_up_addr_tab add_entry make_up_addr ib_aeth_valid 1 md_qpn " + to_string(qpn) + " md_walking_bit " + 
-        to_string(walking_bit) + " eg_intr_md_from_parser_aux_clone_src 0\n";
-    return str;
+void gen_make_up_addr_tab(RuleSet &rules, int qpn, int walking_bit){
+    rules.add("make_up_addr_tab", "make_up_addr")
+        .key("ib_aeth_valid", 1).key_qpn("md_qpn", qpn).key("md_walking_bit", walking_bit)
+        .key("eg_intr_md_from_parser_aux_clone_src", 0);
 }
 
 
-string Policy::gen_readmove_pgt_walk_code(){ // only target for Move
-    string str; 
-    cout << "Start encoding page table walk rule" << endl;
+void Policy::gen_readmove_pgt_walk_code(RuleSet &rules){ // only target for Move
+    LOG(LOG_DEBUG) << "Start encoding page table walk rule" << endl;
     // go through every readmove first
     for (int i = 0; i < this->all_aims.size(); i++){
-        if (this->all_aims[i]->get_aim_name() == "ReadMove"){
+        if (this->all_aims[i]->get_kind() == AIM_READMOVE){
             ReadMove * rmove = (ReadMove *)(this->all_aims[i]);
             // 2 situations: 1, end move; 2, normal move
             // we don't care about dqpn
-            str += gen_mark_vmalloc_bit_p1_tab(qpn_tran(rmove->get_post_qpn())); // check whether is vmalloc or not
-            str += gen_cache_dqpn_page_walk_tab(qpn_tran(rmove->get_post_qpn()), 1, 0, this->task_nr, 2); // cache into reg
-            str += gen_cache_qpn_page_walk_tab(qpn_tran(rmove->get_post_qpn()), 1, 0, this->task_nr, 2); // cache into reg
+            gen_mark_vmalloc_bit_p1_tab(rules, qpn_tran(rmove->get_post_qpn())); // check whether is vmalloc or not
+            gen_cache_dqpn_page_walk_tab(rules, qpn_tran(rmove->get_post_qpn()), 1, 0, this->task_nr, 2); // cache into reg
+            gen_cache_qpn_page_walk_tab(rules, qpn_tran(rmove->get_post_qpn()), 1, 0, this->task_nr, 2); // cache into reg
             // transit to pgt walk qpn
-            str += gen_pgt_transfer_tab(qpn_tran(rmove->get_post_qpn()), ((ReadLoad *)(this->pgt_aims.at(0)))->get_post_qpn(), 1);
+            gen_pgt_transfer_tab(rules, qpn_tran(rmove->get_post_qpn()), ((ReadLoad *)(this->pgt_aims.at(0)))->get_post_qpn(), 1);
             // handle last round pte
-            str += gen_add_offset_3_tab(qpn_tran(rmove->get_post_qpn()), 1, 5);
-            str += gen_mask_base_addr_tab(qpn_tran(rmove->get_post_qpn()), 1);
-            str += gen_make_up_addr_tab(qpn_tran(rmove->get_post_qpn()), 1);
-            str += gen_cache_process_page_addr_to_reg_h_tab(qpn_tran(rmove->get_post_qpn()), 1, this->task_nr, 1); // cache
-            str += gen_cache_process_page_addr_to_reg_l_tab(qpn_tran(rmove->get_post_qpn()), 1, this->task_nr, 1); // cache
+            gen_add_offset_3_tab(rules, qpn_tran(rmove->get_post_qpn()), 1, 5);
+            gen_mask_base_addr_tab(rules, qpn_tran(rmove->get_post_qpn()), 1);
+            gen_make_up_addr_tab(rules, qpn_tran(rmove->get_post_qpn()), 1);
+            gen_cache_process_page_addr_to_reg_h_tab(rules, qpn_tran(rmove->get_post_qpn()), 1, this->task_nr, 1); // cache
+            gen_cache_process_page_addr_to_reg_l_tab(rules, qpn_tran(rmove->get_post_qpn()), 1, this->task_nr, 1); // cache
         }
     }
-    return str;
 }
 
 // go through every pgt_aims
 
-string Policy::gen_pgt_aims_code(){
-    string str;
+void Policy::gen_pgt_aims_code(RuleSet &rules){
     for (int i = 0; i < this->pgt_aims.size(); i++){
         ReadLoad * rload = (ReadLoad *)(this->pgt_aims.at(i));
-        str += gen_read_update_psn_tab(rload->get_post_qpn(), rload->get_post_qpn()-this->base_state);
-        str += gen_read_update_psn_def_tab(this->qpn_tran(rload->get_post_qpn()), rload->get_post_qpn()-this->base_state);
+        gen_read_update_psn_tab(rules, rload->get_post_qpn(), this->psn_slot(rload->get_post_qpn()), this->dense_psn);
+        gen_read_update_psn_def_tab(rules, this->qpn_tran(rload->get_post_qpn()), this->psn_slot(rload->get_post_qpn()));
         // cache timestamp
         // temperary disable
-        //str += gen_read_update_ts_start_tab(this->qpn_tran(rload->get_post_qpn()), rload->get_post_qpn()-this->base_state);
-        str += gen_mod_field_parameters_tab(rload->get_post_qpn(), rload->get_post_qpn(), 0);
+        //str += gen_read_update_ts_start_tab(this->qpn_tran(rload->get_post_qpn()), this->psn_slot(rload->get_post_qpn()));
+        gen_mod_field_parameters_tab(rules, rload->get_post_qpn(), rload->get_post_qpn(), 0);
 
         if (i == 0){ // pgd walk
-            str += gen_cache_process_page_addr_to_reg_h_tab(rload->get_post_qpn(), 0, this->task_nr, 2); // cache
-            str += gen_cache_process_page_addr_to_reg_l_tab(rload->get_post_qpn(), 0, this->task_nr, 2); // cache
-            str += gen_add_offset_1_tab(rload->get_post_qpn(), 0, 1); 
-            str += gen_add_offset_2_tab(rload->get_post_qpn(), 1);
-            str += gen_add_offset_3_tab(rload->get_post_qpn(), 0, 1); 
-            str += gen_make_up_addr_tab(rload->get_post_qpn(), 0);
-            str += gen_pgt_transfer_tab(qpn_tran(rload->get_post_qpn()), ((ReadLoad *)(this->pgt_aims.at(1)))->get_post_qpn(), 0);
+            gen_cache_process_page_addr_to_reg_h_tab(rules, rload->get_post_qpn(), 0, this->task_nr, 2); // cache
+            gen_cache_process_page_addr_to_reg_l_tab(rules, rload->get_post_qpn(), 0, this->task_nr, 2); // cache
+            gen_add_offset_1_tab(rules, rload->get_post_qpn(), 0, 1); 
+            gen_add_offset_2_tab(rules, rload->get_post_qpn(), 1);
+            gen_add_offset_3_tab(rules, rload->get_post_qpn(), 0, 1); 
+            gen_make_up_addr_tab(rules, rload->get_post_qpn(), 0);
+            gen_pgt_transfer_tab(rules, qpn_tran(rload->get_post_qpn()), ((ReadLoad *)(this->pgt_aims.at(1)))->get_post_qpn(), 0);
         }
         if (i == 1){ // pud walk
-            str += gen_cache_process_page_addr_to_reg_h_tab(rload->get_post_qpn(), 0, this->task_nr, 1); // read
-            str += gen_cache_process_page_addr_to_reg_l_tab(rload->get_post_qpn(), 0, this->task_nr, 1); // read
-            str += gen_add_offset_1_tab(rload->get_post_qpn(), 0, 2); 
-            str += gen_add_offset_2_tab(rload->get_post_qpn(), 2);
-            str += gen_add_offset_3_tab(rload->get_post_qpn(), 0, 2); 
-            str += gen_mask_base_addr_tab(rload->get_post_qpn(), 0);
-            str += gen_make_up_addr_tab(rload->get_post_qpn(), 0);
-            str += gen_pgt_transfer_tab(qpn_tran(rload->get_post_qpn()), ((ReadLoad *)(this->pgt_aims.at(2)))->get_post_qpn(), 0);
+            gen_cache_process_page_addr_to_reg_h_tab(rules, rload->get_post_qpn(), 0, this->task_nr, 1); // read
+            gen_cache_process_page_addr_to_reg_l_tab(rules, rload->get_post_qpn(), 0, this->task_nr, 1); // read
+            gen_add_offset_1_tab(rules, rload->get_post_qpn(), 0, 2); 
+            gen_add_offset_2_tab(rules, rload->get_post_qpn(), 2);
+            gen_add_offset_3_tab(rules, rload->get_post_qpn(), 0, 2); 
+            gen_mask_base_addr_tab(rules, rload->get_post_qpn(), 0);
+            gen_make_up_addr_tab(rules, rload->get_post_qpn(), 0);
+            gen_pgt_transfer_tab(rules, qpn_tran(rload->get_post_qpn()), ((ReadLoad *)(this->pgt_aims.at(2)))->get_post_qpn(), 0);
         }
         if (i == 2){ // pmd walk
-            str += gen_cache_process_page_addr_to_reg_h_tab(rload->get_post_qpn(), 0, this->task_nr, 1); // read
-            str += gen_cache_process_page_addr_to_reg_l_tab(rload->get_post_qpn(), 0, this->task_nr, 1); // read
-            str += gen_add_offset_1_tab(rload->get_post_qpn(), 0, 3); 
-            str += gen_add_offset_3_tab(rload->get_post_qpn(), 0, 3); 
-            str += gen_mask_base_addr_tab(rload->get_post_qpn(), 0);
-            str += gen_make_up_addr_tab(rload->get_post_qpn(), 0);
-            str += gen_pgt_transfer_tab(qpn_tran(rload->get_post_qpn()), ((ReadLoad *)(this->pgt_aims.at(3)))->get_post_qpn(), 0);
+            gen_cache_process_page_addr_to_reg_h_tab(rules, rload->get_post_qpn(), 0, this->task_nr, 1); // read
+            gen_cache_process_page_addr_to_reg_l_tab(rules, rload->get_post_qpn(), 0, this->task_nr, 1); // read
+            gen_add_offset_1_tab(rules, rload->get_post_qpn(), 0, 3); 
+            gen_add_offset_3_tab(rules, rload->get_post_qpn(), 0, 3); 
+            gen_mask_base_addr_tab(rules, rload->get_post_qpn(), 0);
+            gen_make_up_addr_tab(rules, rload->get_post_qpn(), 0);
+            gen_pgt_transfer_tab(rules, qpn_tran(rload->get_post_qpn()), ((ReadLoad *)(this->pgt_aims.at(3)))->get_post_qpn(), 0);
         }
         if (i == 3){ // pte walk
-            str += gen_cache_process_page_addr_to_reg_h_tab(rload->get_post_qpn(), 0, this->task_nr, 1); // read
-            str += gen_cache_process_page_addr_to_reg_l_tab(rload->get_post_qpn(), 0, this->task_nr, 1); // read
-            str += gen_add_offset_1_tab(rload->get_post_qpn(), 0, 4); 
-            str += gen_add_offset_3_tab(rload->get_post_qpn(), 0, 4); 
-            str += gen_mask_base_addr_tab(rload->get_post_qpn(), 0);
-            str += gen_make_up_addr_tab(rload->get_post_qpn(), 0);
+            gen_cache_process_page_addr_to_reg_h_tab(rules, rload->get_post_qpn(), 0, this->task_nr, 1); // read
+            gen_cache_process_page_addr_to_reg_l_tab(rules, rload->get_post_qpn(), 0, this->task_nr, 1); // read
+            gen_add_offset_1_tab(rules, rload->get_post_qpn(), 0, 4); 
+            gen_add_offset_3_tab(rules, rload->get_post_qpn(), 0, 4); 
+            gen_mask_base_addr_tab(rules, rload->get_post_qpn(), 0);
+            gen_make_up_addr_tab(rules, rload->get_post_qpn(), 0);
             // mark walking
-            str += gen_mark_walking_bit_tab(qpn_tran(rload->get_post_qpn()));
-            str += gen_cache_dqpn_page_walk_tab(qpn_tran(rload->get_post_qpn()), 0, 1, this->task_nr, 1); // cache into reg
-            str += gen_cache_qpn_page_walk_tab(qpn_tran(rload->get_post_qpn()), 0, 1, this->task_nr, 1); // cache into reg
+            gen_mark_walking_bit_tab(rules, qpn_tran(rload->get_post_qpn()));
+            gen_cache_dqpn_page_walk_tab(rules, qpn_tran(rload->get_post_qpn()), 0, 1, this->task_nr, 1); // cache into reg
+            gen_cache_qpn_page_walk_tab(rules, qpn_tran(rload->get_post_qpn()), 0, 1, this->task_nr, 1); // cache into reg
         }
 
     }
-    return str;
 }
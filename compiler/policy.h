@@ -4,9 +4,16 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <unordered_map>
 
 #include "./operators/op.h"
 #include "./utils/colors.h"
+#include "./ir/rule_ir.h"
+#include "./ir/payload.h"
+#include "./ir/regalloc.h"
+#include "./utils/profile.h"
+#include "./utils/log.h"
 
 #include "./operators/kernel.h"
 #include "./operators/traverse.h"
@@ -16,6 +23,7 @@
 #include "./operators/in.h"
 #include "./operators/end.h"
 #include "./operators/asser.h" // adding assert logic
+#include "./operators/rebase.h"
 
 // aim header file
 #include "./aim/aim.h"
@@ -28,7 +36,11 @@
 #include "./aim/negjump.h"
 #include "./aim/push.h"
 #include "./aim/readmove.h"
+#include "./aim/cfg.h"
+#include "./aim/cost.h"
 
+// DSL front end
+#include "./parser/parser.h"
 
 #include <stack>
 #include "./end_state.h"
@@ -39,13 +51,62 @@ using namespace std;
 #define throw_error(msg) throw std::runtime_error(string(__FILE__)+":"+std::to_string(__LINE__)+" --> "+msg);
 #endif
 
+/**
+ * Resources one policy takes, known before its AIMs are built: the QPN
+ * states handed out from avail_state, the fake states of its loops and
+ * the iter registers.
+ */
+struct Footprint {
+    int qpns = 0;
+    int fake_states = 0;
+    int stack = 0; // slots of the address stack
+    int regs = 0;
+};
+
+/**
+ * What optimize_aims() saved on one policy. Round trips are RDMA reads
+ * the switch no longer issues: once per run for an exit into the drop
+ * state, once per iteration of the enclosing traverse for an exit
+ * threaded into it.
+ */
+struct AimOptStats {
+    int moves_dropped = 0;  // Move($0) with nothing to add to the base
+    int moves_folded = 0;   // Move($x) at an iter head, added to the offsets of its reads
+    int loads_threaded = 0; // recirculation loads replaced by a direct branch
+    int qpns_saved = 0;
+    int trips_per_run = 0;
+    int trips_per_iter = 0;
+};
+
 class Policy {
 private:
+    Arena arena; // owns every Op and Aim of this policy
+    string source;
     vector<string> lines;
     vector<Op*> ops;
     vector<Aim*> head_aims;
     stack<Aim*> tail_aims;
     vector<Aim*> all_aims;
+    AimCFG cfg; // built over all_aims by merge_aims()
+
+    // bodies of the traverse split by .rebase()
+    int element_pos = 0;   // cur_pos of its element
+    end_st element_exit;   // where its last body ends
+    int rebases_left = 0;
+    qpn_list rebase_states; // fake state each body but the last ends in
+
+    // PSN slot of each state that issues a read, with dense_psn
+    int first_state = 0;
+    unordered_map<int, int> psn_slots;
+
+    bool issued_by_other(int q, const Aim* but); // whether an AIM other than but issues QPN state q
+    void renumber_qpns(int freed); // close the gap of a QPN state no AIM issues any more
+    bool fold_iter_move(int i); // add the Move($x) at all_aims[i] to the reads of its base
+    void number_psn(); // dense PSN slots of the states that issue reads
+    int psn_slot(int qpn); // index of qpn into the psn register
+    void mark_rebase(); // check the .rebase() statements and count them per traverse
+    void next_body(); // open the next body of the traverse
+    bool is_rebase(int qpn) { return find(rebase_states.begin(), rebase_states.end(), qpn) != rebase_states.end(); }
 
 public:
 
@@ -63,25 +124,36 @@ public:
     int fake_state; // used for marking the fake state, i.e. r_prev_state
     int cur_pos;
     int task_nr = 0;
+    int fake_base = 0, stack_base = 0, reg_base = 0; // first fake state, stack slot and iter register
 
     int policy_num; // used to specify the number of policy inside DSL.
 
+    bool peephole = false; // run optimize_aims() in frontend_compile()
+    bool coalesce = false; // read the fields of a .values with wide reads
+    bool dense_psn = false; // PSN slots only for the states that issue reads
+    bool relocatable = false; // mark the rule fields that move with the bases
+    AimOptStats aim_opt;
+    PolicyProfile profile; // time, allocations and nodes of each pass, AIMs after gen_rules()
+
 	Policy(){
     };
 	Policy(string input_file, int qpn_s, int qpn_t, int num, int base);
+    void load(const string &text, int qpn_s, int qpn_t, int num, int base);
 
 	void parse();
+    Footprint footprint(); // resources of the parsed and marked policy
+    void set_qpn_base(int qpn_s); // first QPN state of the policy, before frontend_compile()
+    void set_reg_bases(int fake, int stack, int reg); // before frontend_compile(), TASK_STRIDE times the task by default
+    void set_peephole(bool on) { this->peephole = on; } // before footprint()
+    void set_coalesce(bool on) { this->coalesce = on; } // before footprint()
+    void set_dense_psn(bool on) { this->dense_psn = on; } // before gen_rules()
+    void set_relocatable(bool on) { this->relocatable = on; } // before gen_rules(), see RuleSet::relocs
     void frontend_compile(); // frontend
-    string backend_compile(); // backend
-
-// OP gen
-	KernelGraph* parse_kernelgraph(string line);
-	Traverse* parse_traverse(string line);
-	In* parse_in(string line);
-	Iter* parse_iter(string line);
-	Values* parse_values(string line);
-    End* parse_end(string line);
-    Asser* parse_asser(string line);
+    void optimize_aims(); // peephole pass over the merged AIMs
+    void backend_compile(RuleSet &rules); // backend
+    void gen_rules(RuleSet &rules); // run every codegen pass, one section each
+    void payload_layout(PayloadLayout &layout); // fields of the wide reads, after frontend_compile()
+    PolicyCost cost(const CostParams &params) { return AimCost::estimate(this->all_aims, params); } // after frontend_compile()
 
     int qpn_tran(int qpn){return qpn + qpn_tran_coef;} // from 3000 to 300
     int qpn_rtran(int qpn){return qpn - qpn_tran_coef;} // reverse, from 300 to 3000
@@ -93,39 +165,42 @@ public:
     void gen_in_aim(In *in);
     void gen_values_aim(Values *);
     void gen_end_aim(End *);
+    void gen_rebase_aim(Rebase *);
+    PayloadWindows value_windows(Values *); // reads of a .values without iter register
 
 // Code gen
     int find_next_post_qpn(int);
-    string gen_pgt_aims_code(void);
-    string gen_readmove_pgt_walk_code(void); // generate page table walk rule
-    string gen_load_max(void); // generate max entry loading rules
-    string gen_offset_encoding(void); // generate offset encoding rules
-    string gen_pc_tran(void); // generate PC transition rules
-    string gen_psn_mapping(void); // generate PSN mapping rules
-    string gen_base_operation(void); // generate base address operations
-    string gen_init_code(Init *);
-    string gen_constload_code(ConstLoad *);
-    string gen_readload_code(ReadLoad *);
-    string gen_decjump_code(DecJump *);
-    string gen_negjump_code(NegJump *);
-    string gen_pop_code(Pop *);
-    string gen_push_code(Push *);
-    string gen_readmove_code(ReadMove *);
-    string gen_constmove_code(ConstMove *);
+    void gen_pgt_aims_code(RuleSet &rules);
+    void gen_readmove_pgt_walk_code(RuleSet &rules); // generate page table walk rule
+    void gen_load_max(RuleSet &rules); // generate max entry loading rules
+    void gen_offset_encoding(RuleSet &rules); // generate offset encoding rules
+    void gen_pc_tran(RuleSet &rules); // generate PC transition rules
+    void gen_psn_mapping(RuleSet &rules); // generate PSN mapping rules
+    void gen_base_operation(RuleSet &rules); // generate base address operations
+    void gen_init_code(RuleSet &rules, Init *);
+    void gen_constload_code(RuleSet &rules, ConstLoad *);
+    void gen_readload_code(RuleSet &rules, ReadLoad *);
+    void gen_decjump_code(RuleSet &rules, DecJump *);
+    void gen_negjump_code(RuleSet &rules, NegJump *);
+    void gen_pop_code(RuleSet &rules, Pop *);
+    void gen_push_code(RuleSet &rules, Push *);
+    void gen_readmove_code(RuleSet &rules, ReadMove *);
+    void gen_constmove_code(RuleSet &rules, ConstMove *);
 
     void merge_aims(){
         // merge head
         for (int i = 0; i < this->head_aims.size(); i++){
             this->all_aims.push_back(this->head_aims.at(i));
-            this->head_aims.at(i)->print();
+            LOG_IF(LOG_TRACE) this->head_aims.at(i)->print();
         }
         // merge tail
         while (!this->tail_aims.empty()) {
             // TODO: fix this.
             this->all_aims.push_back(this->tail_aims.top());
-            this->tail_aims.top()->print();
+            LOG_IF(LOG_TRACE) this->tail_aims.top()->print();
             this->tail_aims.pop();
         }
+        this->cfg.build(this->all_aims, this->qpn_tran_coef);
     };    
 //    string compile_traverse(Traverse* tt);
 //    string compile_value(Values* vv);
@@ -149,6 +224,15 @@ public:
     void gen_pgt_walk_aim(void);
 
 
+	size_t get_arena_bytes() { return arena.bytes_used(); }
+	size_t get_arena_peak_bytes() { return arena.peak_bytes(); }
+	size_t get_arena_objects() { return arena.num_objects(); }
+	void release() { // drop every node at once, the policy can not be compiled further
+		ops.clear(); head_aims.clear(); all_aims.clear(); pgt_aims.clear();
+		while (!tail_aims.empty()) tail_aims.pop();
+		arena.release();
+	}
+
 	int get_num_stmts() { return ops.size(); }
 	vector<Op*> get_stmts() {return ops;}
 };
@@ -0,0 +1,329 @@
+#include "rdmi.h"
+#include <chrono>
+#include <cstdio>
+
+Compiler::Compiler(int qpn_s, int qpn_r, int threads) : qpn_s(qpn_s), qpn_r(qpn_r), pool(threads) {
+}
+
+Compiler::~Compiler() {
+    delete this->cache;
+}
+
+void Compiler::use_cache(const string &dir) {
+    delete this->cache;
+    this->cache = nullptr;
+    this->cache = new CompileCache(dir);
+}
+
+// rethrow a policy's error with its number in front
+static void policy_error(int i, const exception &e) {
+    throw runtime_error("policy " + to_string(i) + ": " + e.what());
+}
+
+// AIMs of one policy on its own at bases b, as compile() would place it
+static void frontend_at(Policy &d, const string &src, const LinkBases &b, int options) {
+    d.load(src, 0, b.v[REL_COEF], b.v[REL_TASK], b.v[REL_BASE]);
+    d.set_peephole(options & OPT_PEEPHOLE);
+    d.set_coalesce(options & OPT_COALESCE);
+    d.set_dense_psn(options & OPT_DENSE_PSN);
+    d.parse();
+    d.mark_iter();
+    d.mark_assert();
+    d.set_qpn_base(b.v[REL_QPN]);
+    d.set_reg_bases(b.v[REL_FAKE], b.v[REL_STACK], b.v[REL_REG]);
+    d.frontend_compile();
+    d.gen_pgt_walk_aim();
+}
+
+static bool same_footprint(const Footprint &a, const Footprint &b) {
+    return a.qpns == b.qpns && a.fake_states == b.fake_states && a.stack == b.stack && a.regs == b.regs;
+}
+
+static uint32_t elapsed_us(chrono::steady_clock::time_point t0) {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0).count();
+}
+
+/**
+ * Compile in three phases: load every policy and count its footprint,
+ * lay the QPN states out by prefix sum and the register files with the
+ * RegisterAllocator, then compile every policy on its own. Phases 1 and 3
+ * run on the thread pool.
+ *
+ * With a cache, phase 1 hashes the statements and takes the footprint
+ * from the entry under their digest, loading only the policies the cache
+ * has never seen. The cache is looked up in phase 2, once the QPN base of
+ * the policy is known, and only the misses are compiled in phase 3, those
+ * with a known digest loaded there. Phase 2 stays a serial prefix sum.
+ */
+CompileOutput Compiler::compile(const vector<string> &sources) {
+    int num = sources.size();
+    int qpn_tran_coef = this->qpn_r - this->qpn_s;
+    int base = this->qpn_s;
+    CompileOutput out;
+    out.policies.resize(num);
+    vector<Policy*> policies(num, nullptr);
+    vector<CacheKey> keys(num);
+    vector<CacheKey> digests(num);
+    vector<LinkBases> bases(num);
+    RegisterAllocator regs(this->qpn_s, this->qpn_r, num, this->pack, this->budget);
+
+    // parse and mark policy i, its QPN base is set in phase 3
+    auto load = [&](int i) {
+        auto t0 = chrono::steady_clock::now();
+        Policy *d = new Policy();
+        policies[i] = d;
+        d->load(sources[i], 0, qpn_tran_coef, i, base);
+        d->set_peephole(this->peephole);
+        d->set_coalesce(this->coalesce);
+        d->set_dense_psn(this->dense_psn);
+        d->set_relocatable(this->relocatable);
+        d->parse();
+        d->mark_iter();
+        d->mark_assert();
+        out.policies[i].footprint = d->footprint();
+        out.policies[i].compile_us += elapsed_us(t0);
+    };
+
+    try {
+        // phase 1: count the QPN states each policy takes, loading those the cache does not know
+        for (int i = 0; i < num; i++) {
+            this->pool.submit([&, i] {
+                try {
+                    CacheEntry entry;
+                    if (this->cache) {
+                        keys[i] = CompileCache::hash_source(sources[i]);
+                        digests[i] = CompileCache::digest(keys[i], this->options());
+                    }
+                    if (this->cache && this->cache->find(digests[i], entry)) {
+                        Footprint &fp = out.policies[i].footprint;
+                        fp.qpns = entry.avail_state;
+                        fp.fake_states = entry.fake_states;
+                        fp.stack = entry.stack;
+                        fp.regs = entry.regs;
+                    } else {
+                        load(i);
+                    }
+                } catch (const exception &e) {
+                    policy_error(i, e);
+                }
+            });
+        }
+        this->pool.wait();
+
+        // phase 2: prefix sum of the footprints gives the QPN base of each policy, the allocator its registers
+        uint64_t saved_us = this->cache ? this->cache->saved_us : 0;
+        uint64_t lookup_us = this->cache ? this->cache->lookup_us : 0;
+        int avail_state = base;
+        for (int i = 0; i < num; i++) {
+            PolicyOutput &po = out.policies[i];
+            po.qpn_s = avail_state;
+            po.qpn_r = avail_state + qpn_tran_coef;
+            out.summary += to_string(i) + " th policy's state is " + to_string(po.qpn_s) + " and " +
+                to_string(po.qpn_r) + '\n';
+            bases[i] = LinkBases(po.qpn_s, qpn_tran_coef, i, base);
+            regs.peek(i, bases[i]);
+            CacheEntry entry;
+            if (this->cache && this->relocatable) { // the object gives the rules back
+                keys[i] = CompileCache::key(keys[i], bases[i], this->options() | OPT_RELOCATABLE);
+                po.cached = this->cache->lookup(keys[i], entry, po.object);
+                if (po.cached)
+                    po.object.link(bases[i], po.rules);
+            } else if (this->cache) {
+                keys[i] = CompileCache::key(keys[i], bases[i], this->options());
+                po.cached = this->cache->lookup(keys[i], entry, po.rules);
+            }
+            if (po.cached) {
+                delete policies[i]; // loaded in phase 1 by a cache without its digest
+                policies[i] = nullptr;
+                po.footprint.qpns = entry.avail_state - po.qpn_s;
+                po.footprint.fake_states = entry.fake_states;
+                po.footprint.stack = entry.stack;
+                po.footprint.regs = entry.regs;
+                out.cache_hits++;
+            } else if (this->cache) {
+                out.cache_misses++; // loaded in phase 1, or in phase 3 if its digest was known
+            }
+            int need[RF_NUM] = {po.footprint.fake_states, po.footprint.stack, po.footprint.regs};
+            regs.alloc(i, need, bases[i]);
+            avail_state += po.footprint.qpns;
+        }
+        if (this->cache) {
+            out.cache_saved_ms = (this->cache->saved_us - saved_us) / 1e3;
+            out.cache_lookup_ms = (this->cache->lookup_us - lookup_us) / 1e3;
+        }
+
+        // phase 3: compile the policies independently
+        for (int i = 0; i < num; i++) {
+            if (out.policies[i].cached && !this->needs_aims())
+                continue;
+            this->pool.submit([&, i] {
+                try {
+                    PolicyOutput &po = out.policies[i];
+                    if (this->relocatable) {
+                        po.object.qpns = po.footprint.qpns;
+                        po.object.fake_states = po.footprint.fake_states;
+                        po.object.stack = po.footprint.stack;
+                        po.object.regs = po.footprint.regs;
+                    }
+                    const LinkBases &at = bases[i];
+                    if (po.cached) {
+                        if (this->needs_aims()) { // the layout and cost are not cached, its AIMs give them back
+                            Policy d;
+                            frontend_at(d, sources[i], at, this->options());
+                            if (this->wide_reads())
+                                d.payload_layout(po.payload);
+                            if (this->costed)
+                                po.cost = d.cost(this->cost_params);
+                        }
+                        return;
+                    }
+                    if (!policies[i]) {
+                        Footprint fp = po.footprint;
+                        load(i);
+                        if (!same_footprint(po.footprint, fp))
+                            throw_error("footprint differs from the one cached under its digest");
+                    }
+                    auto t0 = chrono::steady_clock::now();
+                    Policy *d = policies[i];
+                    d->set_qpn_base(po.qpn_s);
+                    d->set_reg_bases(at.v[REL_FAKE], at.v[REL_STACK], at.v[REL_REG]);
+                    d->frontend_compile();
+                    d->gen_pgt_walk_aim();
+                    if (d->avail_state != po.qpn_s + po.footprint.qpns)
+                        throw_error("took " + to_string(d->avail_state - po.qpn_s) +
+                            " QPN states, footprint was " + to_string(po.footprint.qpns));
+                    if (d->fake_state != d->fake_base + po.footprint.fake_states)
+                        throw_error("took " + to_string(d->fake_state - d->fake_base) + " fake states, footprint was " +
+                            to_string(po.footprint.fake_states));
+                    d->gen_rules(po.rules);
+                    if (this->relocatable) {
+                        po.object.take(po.rules, at);
+                        po.rules.relocs.clear();
+                    }
+                    po.aim_opt = d->aim_opt;
+                    po.profile = d->profile;
+                    if (this->costed)
+                        po.cost = d->cost(this->cost_params);
+                    if (this->wide_reads()) {
+                        d->payload_layout(po.payload);
+                        PayloadModel::verify(po.rules, po.payload);
+                    }
+                    po.nodes = d->get_arena_objects();
+                    po.arena_bytes = d->get_arena_bytes();
+                    po.arena_peak = d->get_arena_peak_bytes();
+                    policies[i] = nullptr;
+                    delete d; // releases every node of the policy at once
+                    po.compile_us += elapsed_us(t0);
+                    if (this->relocatable)
+                        po.object.payload = po.payload.moved(-po.qpn_s);
+                } catch (const exception &e) {
+                    policy_error(i, e);
+                }
+            });
+        }
+        this->pool.wait();
+    } catch (...) {
+        for (Policy *d: policies)
+            delete d;
+        throw;
+    }
+
+    if (this->cache) {
+        for (int i = 0; i < num; i++) {
+            PolicyOutput &po = out.policies[i];
+            if (po.cached)
+                continue;
+            CacheEntry entry;
+            entry.avail_state = po.qpn_s + po.footprint.qpns;
+            entry.fake_states = po.footprint.fake_states;
+            entry.stack = po.footprint.stack;
+            entry.regs = po.footprint.regs;
+            entry.compile_us = po.compile_us;
+            CacheEntry taken = entry;
+            taken.avail_state = po.footprint.qpns;
+            this->cache->insert(digests[i], taken);
+            if (this->relocatable)
+                this->cache->insert(keys[i], entry, po.object);
+            else
+                this->cache->insert(keys[i], entry, po.rules);
+        }
+    }
+    for (const PolicyOutput &po: out.policies)
+        out.payload.add(po.payload);
+    for (int f = 0; f < RF_NUM; f++)
+        out.registers[f] = regs.use(f);
+    if (this->dense_psn && num > 0)
+        out.psn_saved = num - 1;
+    this->minimize_rules(out);
+    check_budget(out);
+    return out;
+}
+
+/**
+ * Lay the objects out as compile() would have placed their policies and
+ * patch the bases in. Only the relocated fields are touched, and the wide
+ * reads of the objects move to their new QPN states.
+ */
+CompileOutput Compiler::link(const vector<RelocatableRules> &objects) {
+    int qpn_tran_coef = this->qpn_r - this->qpn_s;
+    CompileOutput out;
+    out.policies.resize(objects.size());
+    int avail_state = this->qpn_s;
+    RegisterAllocator regs(this->qpn_s, this->qpn_r, objects.size(), this->pack, this->budget);
+    for (int i = 0; i < (int)objects.size(); i++) {
+        const RelocatableRules &obj = objects[i];
+        PolicyOutput &po = out.policies[i];
+        po.qpn_s = avail_state;
+        po.qpn_r = avail_state + qpn_tran_coef;
+        out.summary += to_string(i) + " th policy's state is " + to_string(po.qpn_s) + " and " +
+            to_string(po.qpn_r) + '\n';
+        po.footprint.qpns = obj.qpns;
+        po.footprint.fake_states = obj.fake_states;
+        po.footprint.stack = obj.stack;
+        po.footprint.regs = obj.regs;
+        int need[RF_NUM] = {obj.fake_states, obj.stack, obj.regs};
+        LinkBases b(po.qpn_s, qpn_tran_coef, i, this->qpn_s);
+        regs.alloc(i, need, b);
+        try {
+            obj.link(b, po.rules);
+            po.payload = obj.payload.moved(po.qpn_s); // the wide reads went with the QPN states
+            PayloadModel::verify(po.rules, po.payload);
+        } catch (const exception &e) {
+            policy_error(i, e);
+        }
+        avail_state += obj.qpns;
+        out.payload.add(po.payload);
+    }
+    for (int f = 0; f < RF_NUM; f++)
+        out.registers[f] = regs.use(f);
+    this->minimize_rules(out);
+    check_budget(out);
+    return out;
+}
+
+// with set_minimize(), minimize the rules of every policy on the thread pool
+void Compiler::minimize_rules(CompileOutput &out) {
+    if (!this->minimize)
+        return;
+    for (int i = 0; i < (int)out.policies.size(); i++) {
+        this->pool.submit([&, i] {
+            PolicyOutput &po = out.policies[i];
+            RuleSet generated = po.rules;
+            RuleMinimizer::minimize(po.rules, po.minimized);
+            MatchModel::verify(generated, po.rules);
+        });
+    }
+    this->pool.wait();
+    for (const PolicyOutput &po: out.policies)
+        out.minimized.add(po.minimized);
+}
+
+// with set_budget(), register slots and table entries of the rules as installed, throws past the master pipeline
+void Compiler::check_budget(CompileOutput &out) {
+    if (!this->budget)
+        return;
+    vector<const RuleSet*> rules;
+    for (const PolicyOutput &po: out.policies)
+        rules.push_back(&po.rules);
+    ResourceBudget::check(rules, out.budget);
+}
@@ -0,0 +1,181 @@
+#ifndef _RDMI_H
+#define _RDMI_H
+
+#include <string>
+#include <vector>
+
+#include "policy.h"
+#include "./ir/rule_ir.h"
+#include "./ir/relocation.h"
+#include "./ir/rule_opt.h"
+#include "./ir/payload.h"
+#include "./ir/budget.h"
+#include "./utils/thread_pool.h"
+#include "./cache/compile_cache.h"
+
+using namespace std;
+
+/**
+ * librdmi: the policy compiler as an in-process library.
+ *
+ *   Compiler c(3000, 300);
+ *   CompileOutput out = c.compile({text0, text1});
+ *   BfshellSerializer().write(out.policies[1].rules, sink);
+ *
+ * Policies are given as DSL text and get the task number of their
+ * position. Their QPN states are laid out back to back from qpn_s on, in
+ * order, and their QPN_TRAN images from qpn_r on. Errors are thrown as
+ * runtime_error, prefixed with the policy number.
+ *
+ * With use_cache(), a policy compiled before with the same statements,
+ * QPN base and task number is taken from the cache without parsing it.
+ *
+ * With set_peephole(), every policy goes through Policy::optimize_aims()
+ * before its rules are generated. The QPN layout follows its footprint.
+ *
+ * With set_coalesce(), nearby fields of a .values come back in the payload
+ * of one wide read. PolicyOutput::payload says where, cache hits and
+ * link() included.
+ *
+ * With set_pack(), the fake states, the address stack and the iter
+ * registers of every policy are packed after those of the policies before
+ * it, by footprint, rather than 20, 15 and 3 to a task. More policies fit
+ * the switch; CompileOutput::registers says how much of each is taken.
+ * Relocatable objects link either way.
+ *
+ * With set_dense_psn(), the psn register slots skip the init state of
+ * every policy, which issues no read. Slot s no longer belongs to QPN
+ * state qpn_s + 1 + s, the read_update_psn_tab entries say which it is.
+ *
+ * With set_cost(), every policy comes with the round trips, switch passes
+ * and wire bytes one trigger is expected to take for the given list
+ * lengths, see AimCost. Cache hits included, link() leaves it empty.
+ *
+ * Every policy times its passes, see PolicyProfile: PolicyOutput::profile
+ * has the wall time, heap allocations (when the program counts them into
+ * heap_allocs) and nodes of each, and the AIMs by kind.
+ *
+ * With set_minimize(), the rules of every policy go through the table entry
+ * minimization of RuleMinimizer before they are returned. The cache and the
+ * relocatable objects keep the rules as generated.
+ *
+ * The rules of every compile and link are checked against the register and
+ * table sizes of the master pipeline, see ResourceBudget, what they take is
+ * in CompileOutput::budget. set_budget(false) skips the check, and the
+ * capacity checks of the RegisterAllocator.
+ *
+ * With set_relocatable(), every policy also comes out as a relocatable
+ * object. link() lays such objects out again for other QPN bases or in
+ * another install order, without compiling:
+ *
+ *   Compiler c2(4000, 500);
+ *   CompileOutput moved = c2.link({out.policies[1].object, out.policies[0].object});
+ */
+
+// compile options that change the generated rules, part of the cache key
+enum CompileOption {
+    OPT_PEEPHOLE = 1, // Policy::optimize_aims()
+    OPT_COALESCE = 2, // wide reads for .values
+    OPT_DENSE_PSN = 8, // PSN slots without the init states, see Policy::number_psn()
+    OPT_RELOCATABLE = 16 // relocations marked, the cache keeps the object
+};
+
+// one compiled policy
+struct PolicyOutput {
+    int qpn_s;           // first QPN state of the policy
+    int qpn_r;           // its QPN_TRAN image
+    Footprint footprint; // resources the policy took
+    RuleSet rules;       // generated switch rules
+    size_t nodes = 0;    // Op and Aim nodes built
+    size_t arena_bytes = 0;
+    size_t arena_peak = 0;
+    bool cached = false; // served from the compile cache
+    uint32_t compile_us = 0; // time spent compiling, 0 on a cache hit
+    RelocatableRules object; // with set_relocatable()
+    MinimizeStats minimized; // with set_minimize()
+    AimOptStats aim_opt;     // with set_peephole(), zero on a cache hit
+    PayloadLayout payload;   // with set_coalesce()
+    PolicyCost cost;         // per trigger, with set_cost()
+    PolicyProfile profile;   // time, allocations and nodes of each pass, zero on a cache hit
+};
+
+struct CompileOutput {
+    vector<PolicyOutput> policies;
+    string summary; // QPN state of each policy, as in gencode/summary
+    int cache_hits = 0;
+    int cache_misses = 0;
+    double cache_saved_ms = 0;  // compile time of the policies served from the cache
+    double cache_lookup_ms = 0; // spent in cache lookups
+    MinimizeStats minimized;    // of every policy, with set_minimize()
+    PayloadLayout payload;      // of every policy, with set_coalesce()
+    ResourceUsage budget;       // registers and tables the rules of every policy take
+    RegFileUse registers[RF_NUM]; // fake states, stack slots and iter registers handed out
+    int psn_saved = 0;          // psn slots set_dense_psn() closed, one per policy but the first
+};
+
+class Compiler {
+private:
+    int qpn_s, qpn_r;
+    ThreadPool pool;
+    CompileCache *cache = nullptr;
+    bool relocatable = false;
+    bool minimize = false;
+    bool peephole = false;
+    bool coalesce = false;
+    bool budget = true;
+    bool pack = false;
+    bool dense_psn = false;
+    bool costed = false;
+    CostParams cost_params;
+
+    int options() const {
+        return (this->peephole ? OPT_PEEPHOLE : 0) | (this->coalesce ? OPT_COALESCE : 0) |
+            (this->dense_psn ? OPT_DENSE_PSN : 0);
+    }
+    bool wide_reads() const { return this->coalesce; }
+    bool needs_aims() const { return this->wide_reads() || this->costed; } // of cache hits too
+    void minimize_rules(CompileOutput &out);
+    void check_budget(CompileOutput &out);
+
+public:
+    // threads: policies compiled concurrently, 1 compiles in order on the caller's thread
+    Compiler(int qpn_s, int qpn_r, int threads = 1);
+    ~Compiler();
+
+    // keep compiled policies in dir and reuse them on the next compile
+    void use_cache(const string &dir);
+
+    // also make a relocatable object of every policy, from the fields the generators mark
+    void set_relocatable(bool on) { this->relocatable = on; }
+
+    // drop duplicate entries and merge ternary and range neighbours of the output
+    void set_minimize(bool on) { this->minimize = on; }
+
+    // run the AIM peephole pass of every policy, it takes fewer QPN states and round trips
+    void set_peephole(bool on) { this->peephole = on; }
+
+    // read the fields of a .values that sit close together with one 16 or 32 byte read,
+    // checked on the byte model of PayloadModel
+    void set_coalesce(bool on) { this->coalesce = on; }
+
+    // give each policy the fake states, stack slots and iter registers its footprint asks for,
+    // back to back, instead of a fixed partition per task
+    void set_pack(bool on) { this->pack = on; }
+
+    // number the psn register slots of the states that issue reads without gaps
+    void set_dense_psn(bool on) { this->dense_psn = on; }
+
+    // estimate what a trigger of every policy costs with these cardinalities
+    void set_cost(const CostParams &params) { this->costed = true; this->cost_params = params; }
+
+    // check the rules against the switch, off for compiles that are never installed (benchmarks)
+    void set_budget(bool on) { this->budget = on; }
+
+    CompileOutput compile(const vector<string> &sources);
+
+    // rules of relocatable policies installed in this order from qpn_s/qpn_r on
+    CompileOutput link(const vector<RelocatableRules> &objects);
+};
+
+
+#endif // _RDMI_H
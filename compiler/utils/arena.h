@@ -0,0 +1,168 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+/**
+ * Bump allocator owning the nodes of one compile (Op, Aim and the
+ * prev_qpns storage inside them).
+ *
+ * Memory is carved out of large blocks and handed back in one step by
+ * release() or the destructor, which also runs the node destructors in
+ * reverse order of construction.
+ */
+class Arena {
+private:
+    struct Block {
+        char *base;
+        size_t size;
+    };
+    struct Dtor {
+        void *obj;
+        void (*fn)(void *);
+    };
+
+    static const size_t FIRST_BLOCK = 4 * 1024;  // small policies fit in one page
+    static const size_t BLOCK_SIZE = 64 * 1024;  // blocks double up to this size
+
+    vector<Block> blocks;
+    vector<Dtor> dtors;
+    char *cur = nullptr;
+    char *end = nullptr;
+    size_t used = 0;     // bytes handed out
+    size_t reserved = 0; // bytes held in blocks
+    size_t peak = 0;     // high-water mark of reserved
+    size_t next_size = FIRST_BLOCK;
+
+    static Arena*& current_slot() {
+        static thread_local Arena *cur = nullptr;
+        return cur;
+    }
+
+    template <class T>
+    static void destroy(void *p) { ((T *)p)->~T(); }
+
+    char* new_block(size_t size) {
+        char *base = (char *)malloc(size);
+        if (!base)
+            throw bad_alloc();
+        blocks.push_back(Block{base, size});
+        reserved += size;
+        if (reserved > peak)
+            peak = reserved;
+        return base;
+    }
+
+public:
+    Arena(){};
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { release(); }
+
+    /**
+     * Arena whose make() call is constructing an object on this thread.
+     * Allocators constructed during that time bind to it.
+     */
+    static Arena* current() { return current_slot(); }
+
+    // align must not exceed alignof(max_align_t)
+    void* allocate(size_t n, size_t align = alignof(max_align_t)) {
+        used += n;
+        if (n > BLOCK_SIZE / 4) // large request, dedicated block
+            return new_block(n);
+        size_t pad = (align - ((size_t)cur & (align - 1))) & (align - 1);
+        if (cur == nullptr || (size_t)(end - cur) < n + pad) {
+            size_t size = next_size;
+            next_size = next_size * 2 > BLOCK_SIZE ? BLOCK_SIZE : next_size * 2;
+            if (size < n + align)
+                size = BLOCK_SIZE;
+            cur = new_block(size);
+            end = cur + size;
+            pad = 0;
+        }
+        char *p = cur + pad;
+        cur = p + n;
+        return p;
+    }
+
+    // construct a T inside the arena, its destructor runs on release()
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        void *mem = allocate(sizeof(T), alignof(T));
+        Arena *saved = current_slot();
+        current_slot() = this;
+        T *obj;
+        try {
+            obj = new (mem) T(std::forward<Args>(args)...);
+        } catch (...) {
+            current_slot() = saved;
+            throw;
+        }
+        current_slot() = saved;
+        dtors.push_back(Dtor{obj, &Arena::destroy<T>});
+        return obj;
+    }
+
+    // destroy every object and hand all blocks back at once
+    void release() {
+        for (size_t i = dtors.size(); i > 0; i--)
+            dtors[i - 1].fn(dtors[i - 1].obj);
+        dtors.clear();
+        for (Block &b: blocks)
+            free(b.base);
+        blocks.clear();
+        cur = end = nullptr;
+        next_size = FIRST_BLOCK;
+        used = 0;
+        reserved = 0;
+    }
+
+    size_t bytes_used() { return used; }
+    size_t bytes_reserved() { return reserved; }
+    size_t peak_bytes() { return peak; }
+    size_t num_blocks() { return blocks.size(); }
+    size_t num_objects() { return dtors.size(); }
+};
+
+/**
+ * STL allocator drawing from the arena current at construction time
+ * (see Arena::current()); falls back to the heap outside of Arena::make.
+ * Memory given back by a container is reclaimed when the arena is released.
+ */
+template <class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    Arena *arena;
+
+    ArenaAllocator() : arena(Arena::current()) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if (arena)
+            return (T *)arena->allocate(n * sizeof(T), alignof(T));
+        return (T *)::operator new(n * sizeof(T));
+    }
+    void deallocate(T *p, size_t) {
+        if (!arena)
+            ::operator delete(p);
+    }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <class U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+// QPN list stored in the arena of the owning node
+typedef vector<int, ArenaAllocator<int> > qpn_list;
+
+
+#endif // _ARENA_H
@@ -0,0 +1,47 @@
+#ifndef _LOG_H
+#define _LOG_H
+
+#include <iostream>
+
+using namespace std;
+
+/**
+ * Leveled progress output of the compiler passes.
+ *
+ *   LOG_INFO   what RDMI reports on every run
+ *   LOG_DEBUG  each pass and AIM as it is generated
+ *   LOG_TRACE  the dump of every Op and AIM node
+ *
+ * A message goes out when its level is at most log_level() (run time,
+ * LOG_INFO unless set_log_level() raised it) and at most RDMI_LOG_MAX
+ * (compile time, make LOG_MAX=1 drops the rest from the binary). Below
+ * the level the operands are not even evaluated:
+ *
+ *   LOG(LOG_DEBUG) << "Start compiling" << endl;
+ *   LOG_IF(LOG_TRACE) rload->print();
+ */
+enum LogLevel {
+    LOG_ERROR,
+    LOG_INFO,
+    LOG_DEBUG,
+    LOG_TRACE
+};
+
+#ifndef RDMI_LOG_MAX
+#define RDMI_LOG_MAX LOG_TRACE
+#endif
+
+// one level for the whole program, the static of an inline function is shared by every translation unit
+inline int& log_level() {
+    static int level = LOG_INFO;
+    return level;
+}
+
+inline void set_log_level(int level) { log_level() = level; }
+inline bool log_on(int level) { return level <= RDMI_LOG_MAX && level <= log_level(); }
+
+#define LOG_IF(level) if (!log_on(level)) {} else
+#define LOG(level) LOG_IF(level) cout
+
+
+#endif // _LOG_H
@@ -0,0 +1,81 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "arena.h"
+
+using namespace std;
+
+// passes a policy goes through, in the order Compiler::compile() runs them
+enum CompilePhase {
+    PH_PARSE,
+    PH_MARK_ITER,
+    PH_MARK_ASSERT,
+    PH_FRONTEND,
+    PH_PGT_WALK_AIM,
+    PH_BACKEND,
+    PH_PC_TRAN,
+    PH_BASE_OPERATION,
+    PH_PSN_MAPPING,
+    PH_OFFSET_ENCODING,
+    PH_LOAD_MAX,
+    PH_READMOVE_PGT_WALK,
+    PH_PGT_AIMS,
+    PH_NUM
+};
+
+static const char *const PHASE_NAMES[PH_NUM] = {
+    "parse", "mark_iter", "mark_assert", "frontend_compile", "gen_pgt_walk_aim",
+    "backend_compile", "gen_pc_tran", "gen_base_operation", "gen_psn_mapping", "gen_offset_encoding",
+    "gen_load_max", "gen_readmove_pgt_walk_code", "gen_pgt_aims_code",
+};
+
+/**
+ * Heap allocations of the calling thread. Nothing counts them unless the
+ * program replaces operator new to bump it, as RDMI does; the phases of a
+ * policy run on one thread, so the difference over a phase is its own.
+ */
+extern thread_local uint64_t heap_allocs;
+
+struct PhaseStats {
+    uint64_t ns = 0;
+    uint64_t heap_allocs = 0;
+    uint64_t arena_nodes = 0; // Op and Aim nodes built
+};
+
+// what each phase of one policy took, and what came out of it
+struct PolicyProfile {
+    PhaseStats phases[PH_NUM];
+    map<string, int> aims; // AIMs by kind, page walk loads included
+};
+
+/**
+ * Adds the wall time, heap allocations and arena nodes from its
+ * construction to its destruction to one phase of a profile.
+ */
+class PhaseScope {
+private:
+    PhaseStats &stats;
+    Arena &arena;
+    chrono::steady_clock::time_point t0;
+    uint64_t allocs0;
+    uint64_t nodes0;
+
+public:
+    PhaseScope(PolicyProfile &profile, CompilePhase phase, Arena &arena)
+        : stats(profile.phases[phase]), arena(arena), t0(chrono::steady_clock::now()), allocs0(heap_allocs),
+          nodes0(arena.num_objects()) {}
+
+    ~PhaseScope() {
+        this->stats.ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - this->t0).count();
+        this->stats.heap_allocs += heap_allocs - this->allocs0;
+        this->stats.arena_nodes += this->arena.num_objects() - this->nodes0;
+    }
+};
+
+
+#endif // _PROFILE_H
@@ -0,0 +1,144 @@
+#ifndef _RULE_SINK_H
+#define _RULE_SINK_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * Destination of the generated switch rules. The code generators stream
+ * into a sink piece by piece instead of concatenating strings, so the
+ * output is copied once, straight into its final buffer.
+ */
+class RuleSink {
+public:
+    virtual ~RuleSink(){};
+    virtual void write(const char *s, size_t n) = 0;
+    virtual void flush(){};
+
+    RuleSink& operator<<(const char *s) {
+        write(s, strlen(s));
+        return *this;
+    }
+    RuleSink& operator<<(const string &s) {
+        write(s.data(), s.size());
+        return *this;
+    }
+    RuleSink& operator<<(char c) {
+        write(&c, 1);
+        return *this;
+    }
+    RuleSink& operator<<(int v) {
+        char buf[12];
+        char *p = buf + sizeof(buf);
+        unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+        do {
+            *--p = '0' + u % 10;
+            u /= 10;
+        } while (u);
+        if (v < 0)
+            *--p = '-';
+        write(p, buf + sizeof(buf) - p);
+        return *this;
+    }
+};
+
+/**
+ * In-memory sink, the rules end up in one string.
+ */
+class BufferSink : public RuleSink {
+private:
+    string buf;
+
+public:
+    BufferSink(size_t reserve = 0) { buf.reserve(reserve); }
+    void write(const char *s, size_t n) { buf.append(s, n); }
+    const string& str() { return buf; }
+    void clear() { buf.clear(); }
+};
+
+/**
+ * Buffered file sink, written out in large chunks. A write the file does
+ * not take throws; close() throws if the data did not make it out. The
+ * destructor closes too, but cannot report, so a file that matters is
+ * close()d before it is used.
+ */
+class FileSink : public RuleSink {
+private:
+    static const size_t BUF_SIZE = 64 * 1024;
+    string path;
+    FILE *fp;
+    char buf[BUF_SIZE];
+    size_t len = 0;
+
+    void put(const char *s, size_t n) {
+        if (fwrite(s, 1, n, fp) != n)
+            throw std::runtime_error("cannot write " + path);
+    }
+
+public:
+    FileSink(const string &path) : path(path) {
+        fp = fopen(path.c_str(), "w");
+        if (!fp)
+            throw std::runtime_error("cannot open " + path + " for writing");
+    }
+    ~FileSink() {
+        if (!fp)
+            return;
+        try {
+            flush();
+        } catch (const std::runtime_error &) {} // close() is the one to report
+        fclose(fp);
+    }
+
+    void write(const char *s, size_t n) {
+        if (len + n > BUF_SIZE) {
+            flush();
+            if (n > BUF_SIZE) {
+                put(s, n);
+                return;
+            }
+        }
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+    void flush() {
+        size_t n = len;
+        len = 0;
+        if (n)
+            put(buf, n);
+        if (fflush(fp) != 0)
+            throw std::runtime_error("cannot write " + path);
+    }
+    void close() {
+        flush();
+        FILE *f = fp;
+        fp = nullptr;
+        if (fclose(f) != 0)
+            throw std::runtime_error("cannot write " + path);
+    }
+};
+
+/**
+ * Discards the rules, only counts bytes and rule lines.
+ */
+class CountingSink : public RuleSink {
+private:
+    size_t bytes = 0;
+    size_t lines = 0;
+
+public:
+    void write(const char *s, size_t n) {
+        bytes += n;
+        for (size_t i = 0; i < n; i++)
+            lines += s[i] == '\n';
+    }
+    size_t get_bytes() { return bytes; }
+    size_t get_lines() { return lines; }
+};
+
+
+#endif // _RULE_SINK_H
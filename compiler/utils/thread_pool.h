@@ -0,0 +1,106 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Fixed set of worker threads running submitted jobs in FIFO order.
+ *
+ * wait() blocks until every submitted job has finished and rethrows the
+ * first exception a job raised. With one thread no worker is started and
+ * jobs run inline in submit(), in order, on the caller's thread.
+ */
+class ThreadPool {
+private:
+    vector<thread> workers;
+    queue<function<void()> > jobs;
+    mutex mtx;
+    condition_variable job_ready;
+    condition_variable all_done;
+    int pending = 0; // submitted and not yet finished
+    bool stopping = false;
+    exception_ptr error;
+
+    void run(function<void()> &job) {
+        try {
+            job();
+        } catch (...) {
+            lock_guard<mutex> lock(this->mtx);
+            if (!this->error)
+                this->error = current_exception();
+        }
+    }
+
+    void worker() {
+        for (;;) {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(this->mtx);
+                this->job_ready.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+                if (this->jobs.empty())
+                    return;
+                job = move(this->jobs.front());
+                this->jobs.pop();
+            }
+            this->run(job);
+            lock_guard<mutex> lock(this->mtx);
+            if (--this->pending == 0)
+                this->all_done.notify_all();
+        }
+    }
+
+public:
+    ThreadPool(int threads) {
+        if (threads > 1)
+            for (int i = 0; i < threads; i++)
+                this->workers.emplace_back(&ThreadPool::worker, this);
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(this->mtx);
+            this->stopping = true;
+        }
+        this->job_ready.notify_all();
+        for (thread &t: this->workers)
+            t.join();
+    }
+
+    int size() { return this->workers.empty() ? 1 : this->workers.size(); }
+
+    void submit(function<void()> job) {
+        if (this->workers.empty()) {
+            this->run(job);
+            return;
+        }
+        {
+            lock_guard<mutex> lock(this->mtx);
+            this->jobs.push(move(job));
+            this->pending++;
+        }
+        this->job_ready.notify_one();
+    }
+
+    void wait() {
+        unique_lock<mutex> lock(this->mtx);
+        this->all_done.wait(lock, [this] { return this->pending == 0; });
+        if (this->error) {
+            exception_ptr e = this->error;
+            this->error = nullptr;
+            rethrow_exception(e);
+        }
+    }
+};
+
+
+#endif // _THREAD_POOL_H
@@ -15,9 +15,21 @@ for k in line2[2:]:
     cc = cc.replace('p', '')
     print(cc)
     line3.append(int(cc))
+# slot i holds the PSN of connection i, unless the policies were compiled with -q:
+# then compiler/gencode/psn_slots, given as the first argument, says which slot takes which
+slots = list(range(len(line3)))
+if len(sys.argv) > 1:
+    pairs = [l.split() for l in open(sys.argv[1]) if l.startswith("slot ")]
+    first = min(int(p[3]) for p in pairs)
+    slots = [None] * len(line3)
+    for p in pairs:
+        if int(p[3]) - first < len(slots):
+            slots[int(p[3]) - first] = int(p[1])
 fl = open("new.txt", "w")
 for i in range(len(line3)):
-    string = "        p4_pd.register_write_psn(" + str(i) + ", unsigned_to_signed(" + str(line3[i] - 1) + " + pow(2, 31), 32))\n"
+    if slots[i] is None: # an init state, its QP takes no PSN slot
+        continue
+    string = "        p4_pd.register_write_psn(" + str(slots[i]) + ", unsigned_to_signed(" + str(line3[i] - 1) + " + pow(2, 31), 32))\n"
     #string += "        p4_pd.register_write_psn_def(" + str(i) + ", " + str(line3[i] - 1) + ")\n"
     fl.write(string)
 fl.close()
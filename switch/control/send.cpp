@@ -170,24 +170,31 @@ int main(int argc, char** argv){
         qpn_2 = atoi (argv[7]);
     }
 	uint64_t va;
+	uint64_t sym = 0;
 
 // #######################################
 // Policy_num used for specifying address
 // #######################################
 	if (qpn == 1)
-		va = htonll(0xffffffffa1013480); // task_s
+		sym = 0xffffffffa1013480; // task_s
 	if (qpn == 2) 
-		va = htonll(0xffffffffa11e5e40); // init_net
+		sym = 0xffffffffa11e5e40; // init_net
 	if (qpn == 3)
-		va = htonll(0xffffffffa0a00260); // syscall
+		sym = 0xffffffffa0a00260; // syscall
 	if (qpn == 4)
-		va = htonll(0xffffffffa113d1c0); // proc_root
+		sym = 0xffffffffa113d1c0; // proc_root
 	if (qpn == 5)
-		va = htonll(0xffffffffae1f9860); // tcp4_afinfo
+		sym = 0xffffffffae1f9860; // tcp4_afinfo
 	if (qpn == 6)
-		va = htonll(0xffffffffa1188520); // tty
+		sym = 0xffffffffa1188520; // tty
 	if (qpn == 7)
-		va = htonll(0xffffffffa1713800); // keyboard
+		sym = 0xffffffffa1713800; // keyboard
+	// KASLR slide of the introspected host relative to the addresses above,
+	// the same value given to ./RDMI patch
+	const char *slide = getenv("KASLR_SLIDE");
+	if (slide)
+		sym += strtoll(slide, NULL, 0);
+	va = htonll(sym);
 //    uint64_t va = atol(argv[5]);
 //    uint64_t va = htonll(0xffffffffa11e5e40); // init_net
 //    uint64_t va = htonll(0xffffffffa1013480); // task_s